@@ -2,8 +2,14 @@
 
 #include <math/frustum.hpp>
 
+#include <cmath>
 #include <vector>
 
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define NOGGIT_FRUSTUM_SSE
+  #include <emmintrin.h>
+#endif
+
 namespace math
 {
   frustum::frustum (matrix_4x4 const& matrix)
@@ -92,4 +98,63 @@ namespace math
     }
     return true;
   }
+
+  void frustum::intersectsSpheres ( float const* x
+                                  , float const* y
+                                  , float const* z
+                                  , float const* radius
+                                  , std::size_t count
+                                  , std::uint8_t* visible
+                                  ) const
+  {
+    std::size_t i (0);
+
+#ifdef NOGGIT_FRUSTUM_SSE
+    __m128 const sign_mask (_mm_set1_ps (-0.0f));
+
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128 const px (_mm_loadu_ps (x + i));
+      __m128 const py (_mm_loadu_ps (y + i));
+      __m128 const pz (_mm_loadu_ps (z + i));
+      __m128 const r (_mm_loadu_ps (radius + i));
+      __m128 const negative_r (_mm_xor_ps (r, sign_mask));
+
+      // intersectsSphere() stops at the first plane the sphere is either
+      // completely behind or straddling, so track which lanes are decided
+      __m128 rejected (_mm_setzero_ps());
+      __m128 decided (_mm_setzero_ps());
+
+      for (auto const& plane : _planes)
+      {
+        __m128 const distance
+          ( _mm_add_ps ( _mm_add_ps ( _mm_add_ps ( _mm_mul_ps (_mm_set1_ps (plane.normal().x), px)
+                                                 , _mm_mul_ps (_mm_set1_ps (plane.normal().y), py)
+                                                 )
+                                    , _mm_mul_ps (_mm_set1_ps (plane.normal().z), pz)
+                                    )
+                       , _mm_set1_ps (plane.distance())
+                       )
+          );
+
+        __m128 const outside (_mm_cmplt_ps (distance, negative_r));
+        __m128 const straddling (_mm_cmplt_ps (_mm_andnot_ps (sign_mask, distance), r));
+
+        rejected = _mm_or_ps (rejected, _mm_andnot_ps (decided, outside));
+        decided = _mm_or_ps (decided, _mm_or_ps (outside, straddling));
+      }
+
+      int const mask (_mm_movemask_ps (rejected));
+      for (std::size_t l (0); l < 4; ++l)
+      {
+        visible[i + l] = !(mask & (1 << l));
+      }
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+      visible[i] = intersectsSphere ({x[i], y[i], z[i]}, radius[i]);
+    }
+  }
 }
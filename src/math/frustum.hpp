@@ -7,6 +7,8 @@
 #include <math/matrix_4x4.hpp>
 
 #include <array>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 namespace math
@@ -69,5 +71,14 @@ namespace math
     bool intersectsSphere ( const vector_3d& position
                           , const float& radius
                           ) const;
+    //! visible[i] = intersectsSphere ({x[i], y[i], z[i]}, radius[i]) for
+    //! all i in [0, count), testing four spheres at once where possible.
+    void intersectsSpheres ( float const* x
+                           , float const* y
+                           , float const* z
+                           , float const* radius
+                           , std::size_t count
+                           , std::uint8_t* visible
+                           ) const;
   };
 }
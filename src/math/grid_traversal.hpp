@@ -0,0 +1,116 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#pragma once
+
+#include <math/ray.hpp>
+#include <math/vector_3d.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace math
+{
+  //! Calls visit (x, z) for the cells of the count_x * count_z grid
+  //! spanning [min, max] on the xz plane that the ray passes through, front
+  //! to back (Amanatides & Woo), until visit returns true. The part of the
+  //! ray outside of [min.y, max.y] is skipped.
+  template<typename Fun>
+    void traverse_grid ( ray const& ray
+                       , vector_3d const& min
+                       , vector_3d const& max
+                       , int count_x
+                       , int count_z
+                       , Fun&& visit
+                       )
+  {
+    if (count_x <= 0 || count_z <= 0)
+    {
+      return;
+    }
+
+    float const o[3] = {ray.origin().x, ray.origin().y, ray.origin().z};
+    float const d[3] = {ray.direction().x, ray.direction().y, ray.direction().z};
+    float const lower[3] = {min.x, min.y, min.z};
+    float const upper[3] = {max.x, max.y, max.z};
+
+    float t_enter (0.f);
+    float t_exit (std::numeric_limits<float>::max());
+
+    for (int axis (0); axis < 3; ++axis)
+    {
+      if (d[axis] == 0.f)
+      {
+        if (o[axis] < lower[axis] || o[axis] > upper[axis])
+        {
+          return;
+        }
+        continue;
+      }
+
+      float const t1 ((lower[axis] - o[axis]) / d[axis]);
+      float const t2 ((upper[axis] - o[axis]) / d[axis]);
+      t_enter = std::max (t_enter, std::min (t1, t2));
+      t_exit = std::min (t_exit, std::max (t1, t2));
+    }
+
+    if (t_enter > t_exit)
+    {
+      return;
+    }
+
+    float const cell_x ((max.x - min.x) / count_x);
+    float const cell_z ((max.z - min.z) / count_z);
+
+    auto const cell_of ([&] (float t, int axis, float size, int count)
+    {
+      int const cell (static_cast<int> (std::floor ((o[axis] + d[axis] * t - lower[axis]) / size)));
+      return std::min (std::max (cell, 0), count - 1);
+    });
+
+    int x (cell_of (t_enter, 0, cell_x, count_x));
+    int z (cell_of (t_enter, 2, cell_z, count_z));
+    int const end_x (cell_of (t_exit, 0, cell_x, count_x));
+    int const end_z (cell_of (t_exit, 2, cell_z, count_z));
+
+    int const step_x (d[0] > 0.f ? 1 : d[0] < 0.f ? -1 : 0);
+    int const step_z (d[2] > 0.f ? 1 : d[2] < 0.f ? -1 : 0);
+
+    float const infinity (std::numeric_limits<float>::infinity());
+    float t_next_x ( step_x
+                   ? (min.x + (x + (step_x > 0 ? 1 : 0)) * cell_x - o[0]) / d[0]
+                   : infinity
+                   );
+    float t_next_z ( step_z
+                   ? (min.z + (z + (step_z > 0 ? 1 : 0)) * cell_z - o[2]) / d[2]
+                   : infinity
+                   );
+    float const t_delta_x (step_x ? cell_x / std::abs (d[0]) : infinity);
+    float const t_delta_z (step_z ? cell_z / std::abs (d[2]) : infinity);
+
+    for (;;)
+    {
+      if (visit (x, z) || (x == end_x && z == end_z))
+      {
+        return;
+      }
+
+      if (t_next_x < t_next_z)
+      {
+        x += step_x;
+        t_next_x += t_delta_x;
+      }
+      else
+      {
+        z += step_z;
+        t_next_z += t_delta_z;
+      }
+
+      // only reached through rounding errors
+      if (x < 0 || x >= count_x || z < 0 || z >= count_z)
+      {
+        return;
+      }
+    }
+  }
+}
@@ -15,6 +15,7 @@ namespace math
   matrix_4x4::translation_t matrix_4x4::translation;
   matrix_4x4::scale_t matrix_4x4::scale;
   matrix_4x4::rotation_t matrix_4x4::rotation;
+  matrix_4x4::translation_rotation_scale_t matrix_4x4::translation_rotation_scale;
   matrix_4x4::rotation_xyz_t matrix_4x4::rotation_xyz;
   matrix_4x4::rotation_yzx_t matrix_4x4::rotation_yzx;
 
@@ -41,6 +42,25 @@ namespace math
     _m[3][3] = 1.0f;
   }
 
+  matrix_4x4::matrix_4x4 ( translation_rotation_scale_t
+                         , vector_3d const& tr
+                         , quaternion const& rot
+                         , vector_3d const& sc
+                         )
+    : matrix_4x4 (rotation, rot)
+  {
+    for (std::size_t j (0); j < 3; ++j)
+    {
+      _m[j][0] *= sc.x;
+      _m[j][1] *= sc.y;
+      _m[j][2] *= sc.z;
+    }
+
+    _m[0][3] = tr.x;
+    _m[1][3] = tr.y;
+    _m[2][3] = tr.z;
+  }
+
   namespace
   {
     enum axis
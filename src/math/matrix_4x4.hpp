@@ -65,6 +65,14 @@ namespace math
     static struct rotation_t {} rotation;
     matrix_4x4 (rotation_t, quaternion const&);
 
+    //! translation * rotation * scale, without multiplying matrices
+    static struct translation_rotation_scale_t {} translation_rotation_scale;
+    matrix_4x4 ( translation_rotation_scale_t
+               , vector_3d const& tr
+               , quaternion const& rot
+               , vector_3d const& sc
+               );
+
     static struct rotation_xyz_t {} rotation_xyz;
     matrix_4x4 (rotation_xyz_t, degrees::vec3 const&);
     static struct rotation_yzx_t {} rotation_yzx;
@@ -115,11 +123,11 @@ namespace math
       return {_m[0][i], _m[1][i], _m[2][i], _m[3][i]};
     }
 
-    bool operator== (matrix_4x4 const& rhs)
+    bool operator== (matrix_4x4 const& rhs) const
     {
       for (std::size_t i (0); i < 16; ++i)
       {
-        if (_m[i] != rhs._m[i])
+        if (_data[i] != rhs._data[i])
         {
           return false;
         }
@@ -0,0 +1,190 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#include <math/skinning.hpp>
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define NOGGIT_SKINNING_SSE
+  #include <emmintrin.h>
+#endif
+
+namespace math
+{
+  void skinned_vertices::push_back ( vector_3d const& position
+                                   , vector_3d const& normal
+                                   , std::uint8_t const* bones
+                                   , std::uint8_t const* weights
+                                   )
+  {
+    x.push_back (position.x);
+    y.push_back (position.y);
+    z.push_back (position.z);
+    normal_x.push_back (normal.x);
+    normal_y.push_back (normal.y);
+    normal_z.push_back (normal.z);
+
+    for (std::size_t b (0); b < influences; ++b)
+    {
+      bone[b].push_back (weights[b] ? bones[b] : 0);
+      weight[b].push_back (static_cast<float> (weights[b]) / 255.0f);
+    }
+  }
+
+  void skinned_vertices::reserve (std::size_t count)
+  {
+    for (auto* component : {&x, &y, &z, &normal_x, &normal_y, &normal_z})
+    {
+      component->reserve (count);
+    }
+    for (std::size_t b (0); b < influences; ++b)
+    {
+      bone[b].reserve (count);
+      weight[b].reserve (count);
+    }
+  }
+
+  namespace
+  {
+    template<typename T>
+      T& at_stride (T* base, std::size_t i, std::size_t stride)
+    {
+      return *reinterpret_cast<T*> (reinterpret_cast<char*> (base) + i * stride);
+    }
+  }
+
+  void skin_scalar ( skinned_vertices const& vertices
+                   , std::size_t first
+                   , std::size_t last
+                   , matrix_4x4 const* transforms
+                   , matrix_4x4 const* normal_transforms
+                   , vector_3d* positions
+                   , vector_3d* normals
+                   , std::size_t stride
+                   )
+  {
+    for (std::size_t i (first); i < last; ++i)
+    {
+      vector_3d const position (vertices.x[i], vertices.y[i], vertices.z[i]);
+      vector_3d const normal (vertices.normal_x[i], vertices.normal_y[i], vertices.normal_z[i]);
+      vector_3d v (0.f, 0.f, 0.f);
+      vector_3d n (0.f, 0.f, 0.f);
+
+      for (std::size_t b (0); b < skinned_vertices::influences; ++b)
+      {
+        float const weight (vertices.weight[b][i]);
+        if (weight <= 0.f)
+        {
+          continue;
+        }
+
+        v += (transforms[vertices.bone[b][i]] * position) * weight;
+        n += (normal_transforms[vertices.bone[b][i]] * normal) * weight;
+      }
+
+      at_stride (positions, i, stride) = v;
+      at_stride (normals, i, stride) = n.normalized();
+    }
+  }
+
+#ifdef NOGGIT_SKINNING_SSE
+  namespace
+  {
+    // element (j, k) of the matrices of four vertices
+    inline __m128 gather ( matrix_4x4 const* const* matrices
+                         , std::size_t j
+                         , std::size_t k
+                         )
+    {
+      return _mm_setr_ps ( (*matrices[0]) (j, k)
+                         , (*matrices[1]) (j, k)
+                         , (*matrices[2]) (j, k)
+                         , (*matrices[3]) (j, k)
+                         );
+    }
+
+    // rows [0, 3) of matrices * (x, y, z, 1) for four vertices
+    inline void transform ( matrix_4x4 const* const* matrices
+                          , __m128 x
+                          , __m128 y
+                          , __m128 z
+                          , __m128 weight
+                          , __m128* result
+                          )
+    {
+      for (std::size_t j (0); j < 3; ++j)
+      {
+        __m128 const row ( _mm_add_ps ( _mm_add_ps ( _mm_mul_ps (gather (matrices, j, 0), x)
+                                                   , _mm_mul_ps (gather (matrices, j, 1), y)
+                                                   )
+                                      , _mm_add_ps ( _mm_mul_ps (gather (matrices, j, 2), z)
+                                                   , gather (matrices, j, 3)
+                                                   )
+                                      )
+                         );
+        result[j] = _mm_add_ps (result[j], _mm_mul_ps (row, weight));
+      }
+    }
+  }
+#endif
+
+  void skin ( skinned_vertices const& vertices
+            , std::size_t first
+            , std::size_t last
+            , matrix_4x4 const* transforms
+            , matrix_4x4 const* normal_transforms
+            , vector_3d* positions
+            , vector_3d* normals
+            , std::size_t stride
+            )
+  {
+#ifdef NOGGIT_SKINNING_SSE
+    for (; first + 4 <= last; first += 4)
+    {
+      __m128 const x (_mm_loadu_ps (&vertices.x[first]));
+      __m128 const y (_mm_loadu_ps (&vertices.y[first]));
+      __m128 const z (_mm_loadu_ps (&vertices.z[first]));
+      __m128 const normal_x (_mm_loadu_ps (&vertices.normal_x[first]));
+      __m128 const normal_y (_mm_loadu_ps (&vertices.normal_y[first]));
+      __m128 const normal_z (_mm_loadu_ps (&vertices.normal_z[first]));
+
+      __m128 v[3] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+      __m128 n[3] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+
+      for (std::size_t b (0); b < skinned_vertices::influences; ++b)
+      {
+        std::uint8_t const* bones (&vertices.bone[b][first]);
+        matrix_4x4 const* const matrices[4] =
+          {&transforms[bones[0]], &transforms[bones[1]], &transforms[bones[2]], &transforms[bones[3]]};
+        matrix_4x4 const* const normal_matrices[4] =
+          { &normal_transforms[bones[0]], &normal_transforms[bones[1]]
+          , &normal_transforms[bones[2]], &normal_transforms[bones[3]]
+          };
+        __m128 const weight (_mm_loadu_ps (&vertices.weight[b][first]));
+
+        transform (matrices, x, y, z, weight, v);
+        transform (normal_matrices, normal_x, normal_y, normal_z, weight, n);
+      }
+
+      __m128 const length_squared ( _mm_add_ps ( _mm_add_ps (_mm_mul_ps (n[0], n[0]), _mm_mul_ps (n[1], n[1]))
+                                               , _mm_mul_ps (n[2], n[2])
+                                               )
+                                  );
+      __m128 const inverse_length (_mm_div_ps (_mm_set1_ps (1.0f), _mm_sqrt_ps (length_squared)));
+
+      float result[6][4];
+      for (std::size_t j (0); j < 3; ++j)
+      {
+        _mm_storeu_ps (result[j], v[j]);
+        _mm_storeu_ps (result[j + 3], _mm_mul_ps (n[j], inverse_length));
+      }
+
+      for (std::size_t l (0); l < 4; ++l)
+      {
+        at_stride (positions, first + l, stride) = {result[0][l], result[1][l], result[2][l]};
+        at_stride (normals, first + l, stride) = {result[3][l], result[4][l], result[5][l]};
+      }
+    }
+#endif
+
+    skin_scalar (vertices, first, last, transforms, normal_transforms, positions, normals, stride);
+  }
+}
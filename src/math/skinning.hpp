@@ -0,0 +1,64 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#pragma once
+
+#include <math/matrix_4x4.hpp>
+#include <math/vector_3d.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace math
+{
+  //! Bind pose of vertices influenced by up to four bones each, stored as
+  //! structure of arrays so several vertices can be skinned at once.
+  struct skinned_vertices
+  {
+    static std::size_t const influences = 4;
+
+    //! bones and weights have `influences` entries, weights are in [0, 255]
+    void push_back ( vector_3d const& position
+                   , vector_3d const& normal
+                   , std::uint8_t const* bones
+                   , std::uint8_t const* weights
+                   );
+    void reserve (std::size_t);
+
+    std::size_t size() const { return x.size(); }
+
+    std::vector<float> x, y, z;
+    std::vector<float> normal_x, normal_y, normal_z;
+    //! unweighted influences refer to bone 0
+    std::vector<std::uint8_t> bone[influences];
+    //! in [0, 1]
+    std::vector<float> weight[influences];
+  };
+
+  //! For every vertex i in [first, last):
+  //!   position = sum (weight * transforms[bone] * position)
+  //!   normal = normalized (sum (weight * normal_transforms[bone] * normal))
+  //! The results are written to positions[i] and normals[i], where both
+  //! pointers advance by `stride` bytes per vertex so interleaved vertex
+  //! buffers can be written directly.
+  void skin ( skinned_vertices const&
+            , std::size_t first
+            , std::size_t last
+            , matrix_4x4 const* transforms
+            , matrix_4x4 const* normal_transforms
+            , vector_3d* positions
+            , vector_3d* normals
+            , std::size_t stride
+            );
+
+  //! the same as skin() without SIMD
+  void skin_scalar ( skinned_vertices const&
+                   , std::size_t first
+                   , std::size_t last
+                   , matrix_4x4 const* transforms
+                   , matrix_4x4 const* normal_transforms
+                   , vector_3d* positions
+                   , vector_3d* normals
+                   , std::size_t stride
+                   );
+}
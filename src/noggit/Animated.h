@@ -6,8 +6,8 @@
 #include <noggit/MPQ.h>
 #include <noggit/ModelHeaders.h>
 
+#include <algorithm>
 #include <cassert>
-#include <map>
 #include <vector>
 #include <memory>
 
@@ -75,26 +75,50 @@ namespace Animation
 
     Animation::Interpolation::Type::Type_t _interpolationType;
 
-    std::map<AnimationIdType, TimestampTypeVectorType> times;
-    std::map<AnimationIdType, AnimatedTypeVectorType> data;
+    //! ranges of one animation's keyframes in the flat arrays below
+    struct track
+    {
+      std::size_t first_time = 0;
+      std::size_t time_count = 0;
+      std::size_t first_key = 0;
+      std::size_t key_count = 0;
+    };
+
+    std::vector<track> _tracks;
+    TimestampTypeVectorType _times;
+    AnimatedTypeVectorType _data;
 
     // for nonlinear interpolations:
-    std::map<AnimationIdType, AnimatedTypeVectorType> in;
-    std::map<AnimationIdType, AnimatedTypeVectorType> out;
+    AnimatedTypeVectorType _in;
+    AnimatedTypeVectorType _out;
 
-  public:
-    bool uses(AnimationIdType anim)
+    track const* track_of (AnimationIdType anim) const
     {
       if (_globalSequenceID != NO_GLOBAL_SEQUENCE)
       {
         anim = AnimationIdType();
       }
 
-      return !data[anim].empty();
+      return anim < _tracks.size() ? &_tracks[anim] : nullptr;
     }
 
-    AnimatedType getValue (AnimationIdType anim, TimestampType time, int animtime)
+  public:
+    bool uses(AnimationIdType anim) const
     {
+      track const* animation_track (track_of (anim));
+      return animation_track && animation_track->key_count;
+    }
+
+    //! \note const and free of side effects, thus safe to call concurrently
+    AnimatedType getValue (AnimationIdType anim, TimestampType time, int animtime) const
+    {
+      track const* animation_track (track_of (anim));
+
+      if (!animation_track || !animation_track->key_count)
+      {
+        return AnimatedType();
+      }
+
       if (_globalSequenceID != NO_GLOBAL_SEQUENCE)
       {
         if (_globalSequences[_globalSequenceID])
@@ -105,71 +129,57 @@ namespace Animation
         {
           time = TimestampType();
         }
-        anim = AnimationIdType();
       }
 
-      TimestampTypeVectorType& timestampVector = times[anim];
-      AnimatedTypeVectorType& dataVector = data[anim];
-      AnimatedTypeVectorType& inVector = in[anim];
-      AnimatedTypeVectorType& outVector = out[anim];
+      AnimatedType const* keys (_data.data() + animation_track->first_key);
 
-      if (dataVector.empty())
+      if (!animation_track->time_count)
       {
-        return AnimatedType();
+        return keys[0];
       }
 
-      AnimatedType result = dataVector[0];
+      TimestampType const* timestamps (_times.data() + animation_track->first_time);
+      std::size_t const time_count (animation_track->time_count);
 
-      if (!timestampVector.empty())
+      TimestampType max_time = timestamps[time_count - 1];
+      if (max_time > 0)
       {
-        TimestampType max_time = timestampVector.back();
-        if (max_time > 0)
-        {
-          time %= max_time;
-        }
-        else
-        {
-          time = TimestampType();
-        }
+        time %= max_time;
+      }
+      else
+      {
+        time = TimestampType();
+      }
 
-        size_t pos = 0;
-        for (size_t i = 0; i < timestampVector.size() - 1; ++i)
-        {
-          if (time >= timestampVector[i] && time < timestampVector[i + 1])
-          {
-            pos = i;
-            break;
-          }
-        }
+      // first key with timestamps[pos] <= time < timestamps[pos + 1], or
+      // the first key of the track if there is none
+      std::size_t pos (std::upper_bound (timestamps, timestamps + time_count, time) - timestamps);
+      pos = (pos == 0 || pos == time_count) ? 0 : pos - 1;
 
-        if (pos == timestampVector.size() - 1 || _interpolationType == Animation::Interpolation::Type::NONE)
-        {
-          result = dataVector[pos];
-        }
-        else
-        {
-          TimestampType t1 = timestampVector[pos];
-          TimestampType t2 = timestampVector[pos + 1];
-          const float percentage = (time - t1) / static_cast<float>(t2 - t1);
+      if (pos == time_count - 1 || _interpolationType == Animation::Interpolation::Type::NONE)
+      {
+        return keys[pos];
+      }
 
-          switch (_interpolationType)
-          {
-          case Animation::Interpolation::Type::LINEAR:
-          {
-            result = math::interpolation::linear (percentage, dataVector[pos], dataVector[pos + 1]);
-          }
-            break;
+      TimestampType t1 = timestamps[pos];
+      TimestampType t2 = timestamps[pos + 1];
+      const float percentage = (time - t1) / static_cast<float>(t2 - t1);
 
-          case Animation::Interpolation::Type::HERMITE:
-          {
-            result = math::interpolation::hermite(percentage, dataVector[pos], dataVector[pos + 1], inVector[pos], outVector[pos]);
-          }
-            break;
-          }
-        }
+      switch (_interpolationType)
+      {
+      case Animation::Interpolation::Type::LINEAR:
+        return math::interpolation::linear (percentage, keys[pos], keys[pos + 1]);
+
+      case Animation::Interpolation::Type::HERMITE:
+        return math::interpolation::hermite ( percentage
+                                            , keys[pos]
+                                            , keys[pos + 1]
+                                            , _in[animation_track->first_key + pos]
+                                            , _out[animation_track->first_key + pos]
+                                            );
       }
 
-      return result;
+      return keys[0];
     }
 
     //! \todo Use a vector of MPQFile& for the anim files instead for safety.
@@ -189,16 +199,36 @@ namespace Animation
       const AnimationBlockHeader* timestampHeaders = file.get<AnimationBlockHeader>(animationBlock.ofsTimes);
       const AnimationBlockHeader* keyHeaders = file.get<AnimationBlockHeader>(animationBlock.ofsKeys);
 
+      _tracks.resize (std::max (animationBlock.nTimes, animationBlock.nKeys));
+
+      std::size_t total_times = 0;
+      for (size_t j = 0; j < animationBlock.nTimes; ++j)
+      {
+        total_times += timestampHeaders[j].nEntries;
+      }
+      std::size_t total_keys = 0;
+      for (size_t j = 0; j < animationBlock.nKeys; ++j)
+      {
+        total_keys += keyHeaders[j].nEntries;
+      }
+
+      _times.reserve (total_times);
+      _data.reserve (total_keys);
+      if (_interpolationType == Animation::Interpolation::Type::HERMITE)
+      {
+        _in.reserve (total_keys);
+        _out.reserve (total_keys);
+      }
+
       for (size_t j = 0; j < animationBlock.nTimes; ++j)
       {
         const TimestampType* timestamps = j < animation_files.size() && animation_files[j] ?
           animation_files[j]->get<TimestampType>(timestampHeaders[j].ofsEntries) :
           file.get<TimestampType>(timestampHeaders[j].ofsEntries);
 
-        for (size_t i = 0; i < timestampHeaders[j].nEntries; ++i)
-        {
-          times[j].push_back(timestamps[i]);
-        }
+        _tracks[j].first_time = _times.size();
+        _tracks[j].time_count = timestampHeaders[j].nEntries;
+        _times.insert (_times.end(), timestamps, timestamps + timestampHeaders[j].nEntries);
       }
 
       for (size_t j = 0; j < animationBlock.nKeys; ++j)
@@ -207,22 +237,25 @@ namespace Animation
           animation_files[j]->get<DataType>(keyHeaders[j].ofsEntries) :
           file.get<DataType>(keyHeaders[j].ofsEntries);
 
+        _tracks[j].first_key = _data.size();
+        _tracks[j].key_count = keyHeaders[j].nEntries;
+
         switch (_interpolationType)
         {
         case Animation::Interpolation::Type::NONE:
         case Animation::Interpolation::Type::LINEAR:
           for (size_t i = 0; i < keyHeaders[j].nEntries; ++i)
           {
-            data[j].push_back(_conversion(keys[i]));
+            _data.push_back(_conversion(keys[i]));
           }
           break;
 
         case Animation::Interpolation::Type::HERMITE:
           for (size_t i = 0; i < keyHeaders[j].nEntries; ++i)
           {
-            data[j].push_back(_conversion(keys[i * 3]));
-            in[j].push_back(_conversion(keys[i * 3 + 1]));
-            out[j].push_back(_conversion(keys[i * 3 + 2]));
+            _data.push_back(_conversion(keys[i * 3]));
+            _in.push_back(_conversion(keys[i * 3 + 1]));
+            _out.push_back(_conversion(keys[i * 3 + 2]));
           }
           break;
         }
@@ -231,30 +264,18 @@ namespace Animation
 
     void apply(AnimatedType function(const AnimatedType))
     {
-      switch (_interpolationType)
+      for (AnimatedType& value : _data)
       {
-      case Animation::Interpolation::Type::NONE:
-      case Animation::Interpolation::Type::LINEAR:
-        for (size_t i = 0; i < data.size(); ++i)
-        {
-          for (size_t j = 0; j < data[i].size(); ++j)
-          {
-            data[i][j] = function(data[i][j]);
-          }
-        }
-        break;
+        value = function(value);
+      }
 
-      case Animation::Interpolation::Type::HERMITE:
-        for (size_t i = 0; i < data.size(); ++i)
+      if (_interpolationType == Animation::Interpolation::Type::HERMITE)
+      {
+        for (size_t i = 0; i < _in.size(); ++i)
         {
-          for (size_t j = 0; j < data[i].size(); ++j)
-          {
-            data[i][j] = function(data[i][j]);
-            in[i][j] = function(in[i][j]);
-            out[i][j] = function(out[i][j]);
-          }
+          _in[i] = function(_in[i]);
+          _out[i] = function(_out[i]);
         }
-        break;
       }
     }
   };
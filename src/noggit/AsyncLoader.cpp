@@ -6,11 +6,117 @@
 #include <QtCore/QSettings>
 
 #include <algorithm>
+#include <cmath>
 #include <list>
 
-void AsyncLoader::process()
+namespace
 {
-  AsyncObject* object = nullptr;
+  //! index of the queue owned by the current thread if it's a loader thread
+  thread_local boost::optional<std::size_t> worker_of_this_thread;
+
+  //! moving less than about a chunk doesn't change the order noticeably
+  float const refocus_distance = 32.f;
+
+  float ground_distance (math::vector_3d const& a, math::vector_3d const& b)
+  {
+    float const dx (a.x - b.x);
+    float const dz (a.z - b.z);
+    return std::sqrt (dx * dx + dz * dz);
+  }
+
+  bool closer (std::shared_ptr<async_load_handle> const& lhs, std::shared_ptr<async_load_handle> const& rhs)
+  {
+    return lhs->distance < rhs->distance;
+  }
+}
+
+std::size_t AsyncLoader::thread_count_from_settings()
+{
+  QSettings settings;
+  int const count (settings.value ("loader_thread_count", 0).toInt());
+
+  if (count > 0)
+  {
+    return count;
+  }
+
+  // leave a core for rendering, hardware_concurrency() may be 0 if unknown
+  return std::max (3u, std::thread::hardware_concurrency()) - 1;
+}
+
+AsyncLoader::handle AsyncLoader::take (std::size_t worker)
+{
+  auto const take_closest ([&] (worker_queue& queue, std::size_t priority) -> handle
+  {
+    std::lock_guard<std::mutex> const lock (queue.mutex);
+    auto& to_load (queue.to_load[priority]);
+
+    while (!to_load.empty())
+    {
+      handle next (to_load.front());
+      to_load.pop_front();
+      --_queued;
+
+      // cancelled handles are just dropped here
+      auto expected (async_load_handle::state::queued);
+      if (next->current.compare_exchange_strong (expected, async_load_handle::state::loading))
+      {
+        return next;
+      }
+    }
+
+    return nullptr;
+  });
+
+  for (std::size_t priority (0); priority < (size_t)async_priority::count; ++priority)
+  {
+    if (handle next = take_closest (*_queues[worker], priority))
+    {
+      return next;
+    }
+
+    // help the thread having the most left, with its closest objects as
+    // they are the ones needed first
+    for (;;)
+    {
+      worker_queue* busiest (nullptr);
+      std::size_t most (0);
+
+      for (std::size_t i (0); i < _queues.size(); ++i)
+      {
+        if (i == worker)
+        {
+          continue;
+        }
+
+        std::lock_guard<std::mutex> const lock (_queues[i]->mutex);
+        std::size_t const count (_queues[i]->to_load[priority].size());
+        if (count > most)
+        {
+          most = count;
+          busiest = _queues[i].get();
+        }
+      }
+
+      if (!busiest)
+      {
+        break;
+      }
+
+      // if it only held cancelled handles it's empty now, look again
+      if (handle next = take_closest (*busiest, priority))
+      {
+        return next;
+      }
+    }
+  }
+
+  return nullptr;
+}
+
+void AsyncLoader::process (std::size_t worker)
+{
+  worker_of_this_thread = worker;
 
   QSettings settings;
   bool additional_log = settings.value("additional_file_loading_log", false).toBool();
@@ -20,13 +126,11 @@ void AsyncLoader::process()
     {    
       std::unique_lock<std::mutex> lock (_guard);
 
-      _state_changed.wait 
+      _work_available.wait 
       ( lock
       , [&]
         {
-          return !!_stop || std::any_of ( _to_load.begin(), _to_load.end()
-                                        , [](auto const& to_load) { return !to_load.empty(); }
-                                        );
+          return !!_stop || _queued > 0;
         }
       );
 
@@ -34,22 +138,17 @@ void AsyncLoader::process()
       {
         return;
       }
+    }
 
-      for (auto& to_load : _to_load)
-      {
-        if (to_load.empty())
-        {
-          continue;
-        }
-
-        object = to_load.front();
-        _currently_loading.emplace_back (object);
-        to_load.pop_front();
+    handle const next (take (worker));
 
-        break;
-      }
+    if (!next)
+    {
+      continue;
     }
 
+    AsyncObject* object (next->object);
+
     try
     {
       if (additional_log)
@@ -65,12 +164,6 @@ void AsyncLoader::process()
         std::lock_guard<std::mutex> const lock(_guard);
         LogDebug << "Loaded  '" << object->filename << "'" << std::endl;
       }
-
-      {
-        std::lock_guard<std::mutex> const lock (_guard);
-        _currently_loading.remove (object);
-        _state_changed.notify_all();
-      }
     }
     catch (...)
     {
@@ -82,53 +175,161 @@ void AsyncLoader::process()
         _important_object_failed_loading = true;
       }
     }
+
+    {
+      std::lock_guard<std::mutex> const lock (_guard);
+      next->current = async_load_handle::state::done;
+    }
+    _loading_finished.notify_all();
   }
 }
 
 void AsyncLoader::queue_for_load (AsyncObject* object)
 {
-  std::lock_guard<std::mutex> const lock (_guard);
-  _to_load[(size_t)object->loading_priority()].push_back (object);
-  _state_changed.notify_one();
+  handle const next (std::make_shared<async_load_handle> (object));
+  object->_load_handle = next;
+
+  // objects queued while loading another one are most likely needed by
+  // it, so they stay with the thread loading it
+  worker_queue& queue
+    (*_queues[worker_of_this_thread.value_or (_next_queue++ % _queues.size())]);
+
+  // counted first so that workers never see less than what is queued
+  {
+    std::lock_guard<std::mutex> const lock (_guard);
+    ++_queued;
+  }
+
+  {
+    std::lock_guard<std::mutex> const lock (queue.mutex);
+
+    if (queue.focus && next->position)
+    {
+      next->distance = ground_distance (*queue.focus, *next->position);
+    }
+
+    auto& to_load (queue.to_load[(size_t)next->priority]);
+    to_load.insert (std::upper_bound (to_load.begin(), to_load.end(), next, &closer), next);
+  }
+
+  _work_available.notify_one();
+}
+
+bool AsyncLoader::cancel (AsyncObject* object)
+{
+  if (!object->_load_handle)
+  {
+    return true;
+  }
+
+  // don't load it if it's just to delete it afterward, the handle is
+  // dropped once a worker or prioritize_around() comes across it
+  auto expected (async_load_handle::state::queued);
+  object->_load_handle->current.compare_exchange_strong
+    (expected, async_load_handle::state::cancelled);
+
+  return expected != async_load_handle::state::loading;
+}
+
+void AsyncLoader::reprioritize (AsyncObject* object)
+{
+  if (!object->_load_handle)
+  {
+    return;
+  }
+
+  auto expected (async_load_handle::state::queued);
+  if (object->_load_handle->current.compare_exchange_strong (expected, async_load_handle::state::cancelled))
+  {
+    queue_for_load (object);
+  }
 }
 
 void AsyncLoader::ensure_deletable (AsyncObject* object)
 {
+  if (cancel (object))
+  {
+    return;
+  }
+
+  async_load_handle const& loading (*object->_load_handle);
+
   std::unique_lock<std::mutex> lock (_guard);
-  _state_changed.wait
+  _loading_finished.wait
   ( lock
   , [&]
     {
-      auto& to_load = _to_load[(size_t)object->loading_priority()];
-      auto const& it = std::find (to_load.begin(), to_load.end(), object);
-      
-      // don't load it if it's just to delete it afterward
-      if (it != to_load.end())
-      {
-        to_load.erase(it);
-        return true;
-      }
-      else
+      return loading.current != async_load_handle::state::loading;
+    }
+  );
+}
+
+void AsyncLoader::prioritize_around (math::vector_3d const& position)
+{
+  if (_focus && ground_distance (*_focus, position) < refocus_distance)
+  {
+    return;
+  }
+
+  _focus = position;
+
+  for (auto& queue : _queues)
+  {
+    std::lock_guard<std::mutex> const lock (queue->mutex);
+    queue->focus = position;
+
+    for (auto& to_load : queue->to_load)
+    {
+      std::size_t const before (to_load.size());
+
+      to_load.erase
+        ( std::remove_if ( to_load.begin(), to_load.end()
+                         , [] (handle const& queued)
+                           {
+                             return queued->current == async_load_handle::state::cancelled;
+                           }
+                         )
+        , to_load.end()
+        );
+
+      _queued -= before - to_load.size();
+
+      for (auto& queued : to_load)
       {
-        return std::find (_currently_loading.begin(), _currently_loading.end(), object) == _currently_loading.end();
+        if (queued->position)
+        {
+          queued->distance = ground_distance (position, *queued->position);
+        }
       }
+
+      std::stable_sort (to_load.begin(), to_load.end(), &closer);
     }
-  );
+  }
 }
 
-AsyncLoader::AsyncLoader(int numThreads)
+AsyncLoader::AsyncLoader (std::size_t numThreads)
   : _stop (false)
+  , _queued (0)
+  , _next_queue (0)
 {
-  for (int i = 0; i < numThreads; ++i)
+  for (std::size_t i = 0; i < numThreads; ++i)
+  {
+    _queues.emplace_back (std::make_unique<worker_queue>());
+  }
+
+  for (std::size_t i = 0; i < numThreads; ++i)
   {
-    _threads.emplace_back (&AsyncLoader::process, this);
+    _threads.emplace_back (&AsyncLoader::process, this, i);
   }
 }
 
 AsyncLoader::~AsyncLoader()
 {
-  _stop = true;
-  _state_changed.notify_all();
+  {
+    std::lock_guard<std::mutex> const lock (_guard);
+    _stop = true;
+  }
+  _work_available.notify_all();
 
   for (auto& thread : _threads)
   {
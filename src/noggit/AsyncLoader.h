@@ -4,19 +4,48 @@
 
 #include <noggit/AsyncObject.h>
 
+#include <boost/optional.hpp>
+
 #include <array>
 #include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
+
+struct async_load_handle
+{
+  enum class state
+  {
+    queued,
+    loading,
+    done,
+    cancelled
+  };
+
+  async_load_handle (AsyncObject* object_)
+    : object (object_)
+    , priority (object_->loading_priority())
+    , position (object_->loading_position())
+  {}
+
+  AsyncObject* const object;
+  async_priority const priority;
+  boost::optional<math::vector_3d> const position;
+  std::atomic<state> current = {state::queued};
+  //! guarded by the mutex of the queue containing the handle
+  float distance = 0.f;
+};
 
 class AsyncLoader
 {
 public:
   static AsyncLoader& instance()
   {
-    static AsyncLoader async_loader(2);
+    static AsyncLoader async_loader (thread_count_from_settings());
     return async_loader;
   }
 
@@ -26,20 +55,48 @@ public:
   
   void ensure_deletable (AsyncObject*);
 
-  AsyncLoader(int numThreads);
+  //! Same as ensure_deletable but doesn't wait for an object currently
+  //! being loaded, false is returned instead.
+  bool cancel (AsyncObject*);
+
+  //! Moves a still queued object to the queue matching its current
+  //! loading_priority().
+  void reprioritize (AsyncObject*);
+
+  //! Queued objects having a position are loaded closest to it first.
+  void prioritize_around (math::vector_3d const& position);
+
+  explicit AsyncLoader (std::size_t numThreads);
   ~AsyncLoader();
 
   bool important_object_failed_loading() const { return _important_object_failed_loading; }
   void reset_object_fail() { _important_object_failed_loading = false; }
 
 private:
-  void process();
+  using handle = std::shared_ptr<async_load_handle>;
+
+  //! every thread takes the closest objects of its own queue first and
+  //! then those of the busiest other queue when it runs out of work
+  struct worker_queue
+  {
+    std::mutex mutex;
+    boost::optional<math::vector_3d> focus;
+    std::array<std::deque<handle>, (size_t)async_priority::count> to_load;
+  };
+
+  static std::size_t thread_count_from_settings();
+
+  handle take (std::size_t worker);
+  void process (std::size_t worker);
 
   std::mutex _guard;
-  std::condition_variable _state_changed;
+  std::condition_variable _work_available;
+  std::condition_variable _loading_finished;
   std::atomic<bool> _stop;
-  std::array<std::list<AsyncObject*>, (size_t)async_priority::count> _to_load;
-  std::list<AsyncObject*> _currently_loading;
+  std::atomic<std::size_t> _queued;
+  std::atomic<std::size_t> _next_queue;
+  std::vector<std::unique_ptr<worker_queue>> _queues;
   std::list<std::thread> _threads;
-  bool _important_object_failed_loading = false;
+  boost::optional<math::vector_3d> _focus;
+  std::atomic<bool> _important_object_failed_loading = {false};
 };
@@ -2,10 +2,14 @@
 
 #pragma once
 
+#include <math/vector_3d.hpp>
 #include <noggit/Log.h>
 
+#include <boost/optional.hpp>
+
 #include <atomic>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <string>
 
@@ -17,10 +21,16 @@ enum class async_priority : int
   count
 };
 
+struct async_load_handle;
+
 class AsyncObject
 {
 private: 
   bool _loading_failed = false;
+
+  //! set by AsyncLoader when queued, allows cancelling without a lookup
+  std::shared_ptr<async_load_handle> _load_handle;
+  friend class AsyncLoader;
 protected:
   std::atomic<bool> finished = {false};
   std::mutex _mutex;
@@ -80,5 +90,11 @@ public:
     return async_priority::medium;
   }
 
+  //! objects with a position are loaded closest to the camera first
+  virtual boost::optional<math::vector_3d> loading_position() const
+  {
+    return boost::none;
+  }
+
   virtual void finishLoading() = 0;
 };
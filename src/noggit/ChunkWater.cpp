@@ -129,6 +129,21 @@ void ChunkWater::save(sExtendableArray& adt, int base_pos, int& header_pos, int&
   header_pos += sizeof(MH2O_Header);
 }
 
+std::size_t ChunkWater::max_save_size() const
+{
+  if (!hasData(0))
+  {
+    return 0;
+  }
+
+  // every layer has at most 9x9 vertices with height, uv and depth
+  std::size_t const max_layer_size
+    ( sizeof(MH2O_Information) + sizeof(std::uint64_t)
+    + 9 * 9 * (sizeof(float) + sizeof(mh2o_uv) + sizeof(std::uint8_t))
+    );
+
+  return sizeof(MH2O_Render) + _layers.size() * max_layer_size;
+}
 
 void ChunkWater::autoGen(MapChunk *chunk, float factor)
 {
@@ -29,6 +29,8 @@ public:
   void from_mclq(std::vector<mclq>& layers);
   void fromFile(MPQFile &f, size_t basePos);
   void save(sExtendableArray& adt, int base_pos, int& header_pos, int& current_pos);
+  //! upper bound of what save() writes besides the MH2O header
+  std::size_t max_save_size() const;
 
   void draw ( math::frustum const& frustum
             , const float& cull_distance
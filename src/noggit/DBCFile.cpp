@@ -4,15 +4,20 @@
 #include <noggit/Log.h>
 #include <noggit/MPQ.h>
 
+#include <cstdint>
+#include <memory>
 #include <string>
 
 DBCFile::DBCFile(const std::string& _filename)
   : filename(_filename)
 {}
 
+DBCFile::~DBCFile() = default;
+
 void DBCFile::open()
 {
-  MPQFile f (filename);
+  _file = std::make_unique<MPQFile> (filename);
+  MPQFile& f (*_file);
 
   if (f.isEof())
   {
@@ -21,25 +26,37 @@ void DBCFile::open()
   }
   LogDebug << "Opening DBC \"" << filename << "\"" << std::endl;
 
-  char header[4];
-
-  f.read(header, 4); // Number of records
-  assert(header[0] == 'W' && header[1] == 'D' && header[2] == 'B' && header[3] == 'C');
-  f.read(&recordCount, 4);
-  f.read(&fieldCount, 4);
-  f.read(&recordSize, 4);
-  f.read(&stringSize, 4);
+  struct
+  {
+    char magic[4];
+    std::uint32_t record_count;
+    std::uint32_t field_count;
+    std::uint32_t record_size;
+    std::uint32_t string_size;
+  } header;
+
+  f.read(&header, sizeof (header));
+  assert(header.magic[0] == 'W' && header.magic[1] == 'D' && header.magic[2] == 'B' && header.magic[3] == 'C');
+  recordCount = header.record_count;
+  fieldCount = header.field_count;
+  recordSize = header.record_size;
+  stringSize = header.string_size;
 
   if (fieldCount * 4 != recordSize)
   {
     throw std::logic_error ("non four-byte-columns not supported");
   }
 
-  data.resize (recordSize * recordCount);
-  f.read (data.data(), data.size());
+  if (f.getSize() < sizeof (header) + recordSize * recordCount + stringSize)
+  {
+    throw std::runtime_error ("DBC file \"" + filename + "\" is truncated");
+  }
+
+  // no copy, the file keeps its content after being closed
+  _records = reinterpret_cast<unsigned char const*> (f.getBuffer() + sizeof (header));
+  _strings = f.getBuffer() + sizeof (header) + recordSize * recordCount;
 
-  stringTable.resize (stringSize);
-  f.read (stringTable.data(), stringTable.size());
+  _index = noggit::dbc_index (_records, recordSize, recordCount, 0);
 
   f.close();
 }
@@ -2,15 +2,28 @@
 
 #pragma once
 
+#include <noggit/dbc_index.hpp>
+
+#include <boost/optional.hpp>
+
 #include <cassert>
+#include <memory>
 #include <string>
 #include <vector>
 #include <stdexcept>
 
+class MPQFile;
+
 class DBCFile
 {
 public:
   explicit DBCFile(const std::string& filename);
+  ~DBCFile();
+
+  DBCFile(DBCFile const&) = delete;
+  DBCFile(DBCFile&&) = delete;
+  DBCFile& operator=(DBCFile const&) = delete;
+  DBCFile& operator=(DBCFile&&) = delete;
 
   // Open database. It must be openened before it can be used.
   void open();
@@ -29,24 +42,24 @@ public:
     const float& getFloat(size_t field) const
     {
       assert(field < file.fieldCount);
-      return *reinterpret_cast<float*>(offset + field * 4);
+      return *reinterpret_cast<float const*>(offset + field * 4);
     }
     const unsigned int& getUInt(size_t field) const
     {
       assert(field < file.fieldCount);
-      return *reinterpret_cast<unsigned int*>(offset + field * 4);
+      return *reinterpret_cast<unsigned int const*>(offset + field * 4);
     }
     const int& getInt(size_t field) const
     {
       assert(field < file.fieldCount);
-      return *reinterpret_cast<int*>(offset + field * 4);
+      return *reinterpret_cast<int const*>(offset + field * 4);
     }
     const char *getString(size_t field) const
     {
       assert(field < file.fieldCount);
       size_t stringOffset = getUInt(field);
       assert(stringOffset < file.stringSize);
-      return file.stringTable.data() + stringOffset;
+      return file._strings + stringOffset;
     }
     const char *getLocalizedString(size_t field, int locale = -1) const
     {
@@ -65,12 +78,12 @@ public:
       assert(field + loc < file.fieldCount);
       size_t stringOffset = getUInt(field + loc);
       assert(stringOffset < file.stringSize);
-      return file.stringTable.data() + stringOffset;
+      return file._strings + stringOffset;
     }
   private:
-    Record(const DBCFile &pfile, unsigned char *poffset) : file(pfile), offset(poffset) {}
+    Record(const DBCFile &pfile, unsigned char const* poffset) : file(pfile), offset(poffset) {}
     const DBCFile &file;
-    unsigned char *offset;
+    unsigned char const* offset;
 
     friend class DBCFile;
     friend class DBCFile::Iterator;
@@ -80,7 +93,7 @@ public:
   class Iterator
   {
   public:
-    Iterator(const DBCFile &file, unsigned char *offset) :
+    Iterator(const DBCFile &file, unsigned char const* offset) :
       record(file, offset) {}
     /// Advance (prefix only)
     Iterator & operator++() {
@@ -105,24 +118,43 @@ public:
     Record record;
   };
 
-  inline Record getRecord(size_t id)
+  inline Record getRecord(size_t id) const
   {
-    return Record(*this, data.data() + id*recordSize);
+    return Record(*this, _records + id*recordSize);
   }
 
-  inline Iterator begin()
+  inline Iterator begin() const
   {
-    return Iterator(*this, data.data());
+    return Iterator(*this, _records);
   }
-  inline Iterator end()
+  inline Iterator end() const
   {
-    return Iterator(*this, data.data() + data.size());
+    return Iterator(*this, _records + recordCount * recordSize);
   }
 
   inline size_t getRecordCount() const { return recordCount; }
   inline size_t getFieldCount() const { return fieldCount; }
-  inline Record getByID(unsigned int id, size_t field = 0)
+
+  //! record with the given id in its first field, without throwing
+  inline boost::optional<Record> find(unsigned int id) const
   {
+    if (auto row = _index.row(id))
+    {
+      return getRecord(*row);
+    }
+    return boost::none;
+  }
+  inline Record getByID(unsigned int id, size_t field = 0) const
+  {
+    if (field == 0)
+    {
+      if (auto record = find(id))
+      {
+        return *record;
+      }
+      throw NotFound();
+    }
+
     for (Iterator i = begin(); i != end(); ++i)
     {
       if (i->getUInt(field) == id)
@@ -133,10 +165,16 @@ public:
 
 private:
   std::string filename;
-  size_t recordSize;
-  size_t recordCount;
-  size_t fieldCount;
-  size_t stringSize;
-  std::vector<unsigned char> data;
-  std::vector<char> stringTable;
+  size_t recordSize = 0;
+  size_t recordCount = 0;
+  size_t fieldCount = 0;
+  size_t stringSize = 0;
+
+  //! records and strings point into the file's content, which is either
+  //! mapped from disk or the buffer extracted from the archive
+  std::unique_ptr<MPQFile> _file;
+  unsigned char const* _records = nullptr;
+  char const* _strings = nullptr;
+  //! ids in the first field
+  noggit::dbc_index _index;
 };
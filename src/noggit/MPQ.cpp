@@ -3,14 +3,20 @@
 #include <noggit/AsyncLoader.h> // AsyncLoader
 #include <noggit/Log.h>
 #include <noggit/MPQ.h>
+#include <noggit/directory_files.hpp>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/optional.hpp>
 #include <boost/thread.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 #include <QtCore/QSettings>
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
@@ -18,8 +24,9 @@
 #include <list>
 #include <sstream>
 #include <string>
-#include <vector>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 namespace
 {
@@ -28,7 +35,148 @@ namespace
   ArchivesMap _openArchives;
 
   boost::mutex gListfileLoadingMutex;
-  boost::mutex gMPQFileMutex;
+
+  std::atomic<std::size_t> next_archive_id (0);
+
+  // archive ids are never reused, so entries of archives closed in the
+  // meantime are never hit again and can simply stay in here
+  std::unordered_map<std::size_t, HANDLE>& archive_handles_of_this_thread()
+  {
+    thread_local std::unordered_map<std::size_t, HANDLE> handles;
+    return handles;
+  }
+
+  //! Resolves normalized filenames to where they are read from without
+  //! asking the file system or the archives: the project directory is
+  //! scanned once, archive entries come from the listfiles and from
+  //! successful probes of files missing in them.
+  class file_index
+  {
+  public:
+    boost::filesystem::path project_path()
+    {
+      ensure_project_directory_scanned();
+
+      boost::shared_lock<boost::shared_mutex> const lock (_mutex);
+      return _project_path;
+    }
+
+    boost::optional<boost::filesystem::path> on_disk (std::string const& normalized)
+    {
+      ensure_project_directory_scanned();
+
+      boost::shared_lock<boost::shared_mutex> const lock (_mutex);
+      auto const it (_on_disk.find (normalized));
+      if (it == _on_disk.end())
+      {
+        return boost::none;
+      }
+      return it->second;
+    }
+
+    MPQArchive const* in_archive (std::string const& normalized)
+    {
+      boost::shared_lock<boost::shared_mutex> const lock (_mutex);
+      auto const it (_in_archive.find (normalized));
+      return it == _in_archive.end() ? nullptr : it->second.archive;
+    }
+
+    void add_on_disk (std::string normalized, boost::filesystem::path path)
+    {
+      ensure_project_directory_scanned();
+
+      boost::unique_lock<boost::shared_mutex> const lock (_mutex);
+      _on_disk[std::move (normalized)] = std::move (path);
+    }
+
+    //! archives opened later override the files of earlier ones, so an
+    //! entry is only replaced by an archive with a higher priority
+    void add_in_archive (std::string normalized, MPQArchive const* archive, std::size_t priority)
+    {
+      boost::unique_lock<boost::shared_mutex> const lock (_mutex);
+      auto& entry (_in_archive[std::move (normalized)]);
+      if (!entry.archive || entry.priority < priority)
+      {
+        entry = {archive, priority};
+      }
+    }
+
+    void remove_archive (MPQArchive const* archive)
+    {
+      boost::unique_lock<boost::shared_mutex> const lock (_mutex);
+      for (auto it (_in_archive.begin()); it != _in_archive.end();)
+      {
+        it = it->second.archive == archive ? _in_archive.erase (it) : std::next (it);
+      }
+    }
+
+    void clear_archives()
+    {
+      boost::unique_lock<boost::shared_mutex> const lock (_mutex);
+      _in_archive.clear();
+    }
+
+    void rescan_project_directory()
+    {
+      _project_directory_scanned = false;
+    }
+
+  private:
+    void ensure_project_directory_scanned()
+    {
+      if (_project_directory_scanned)
+      {
+        return;
+      }
+
+      boost::unique_lock<boost::shared_mutex> const lock (_mutex);
+
+      if (_project_directory_scanned)
+      {
+        return;
+      }
+
+      QSettings settings;
+      _project_path = settings.value ("project/path").toString().toStdString();
+      _on_disk.clear();
+
+      for (auto const& file : noggit::directory_files (_project_path))
+      {
+        _on_disk.emplace (noggit::mpq::normalized_filename (file.first), file.second);
+      }
+
+      LogDebug << "Indexed " << _on_disk.size() << " files in project directory "
+               << _project_path << std::endl;
+
+      _project_directory_scanned = true;
+    }
+
+    struct archive_entry
+    {
+      MPQArchive const* archive;
+      std::size_t priority;
+    };
+
+    boost::shared_mutex _mutex;
+    std::atomic<bool> _project_directory_scanned = {false};
+    boost::filesystem::path _project_path;
+    std::unordered_map<std::string, boost::filesystem::path> _on_disk;
+    std::unordered_map<std::string, archive_entry> _in_archive;
+  };
+
+  file_index& index()
+  {
+    static file_index instance;
+    return instance;
+  }
+
+  // until every listfile is in the index a file may still be found in an
+  // archive with a higher priority than the indexed one
+  bool archive_index_complete()
+  {
+    static std::atomic<bool> complete (false);
+    return complete || (complete = MPQArchive::allFinishedLoading());
+  }
 }
 
 std::unordered_set<std::string> gListfile;
@@ -41,9 +189,9 @@ void MPQArchive::loadMPQ (AsyncLoader* loader, std::string const& filename, bool
 
 MPQArchive::MPQArchive(std::string const& filename, bool doListfile)
   : AsyncObject(filename)
-  ,_archiveHandle(nullptr)
+  , _id (next_archive_id++)
 {
-  if (!SFileOpenArchive (filename.c_str(), 0, MPQ_OPEN_NO_LISTFILE | STREAM_FLAG_READ_ONLY, &_archiveHandle))
+  if (!thread_handle())
   {
     LogError << "Error opening archive: " << filename << std::endl;
     return;
@@ -63,10 +211,7 @@ void MPQArchive::finishLoading()
 
   HANDLE fh;
 
-  boost::mutex::scoped_lock lock2(gMPQFileMutex);
-  boost::mutex::scoped_lock lock(gListfileLoadingMutex);
-
-  if (SFileOpenFileEx(_archiveHandle, "(listfile)", 0, &fh))
+  if (openFile("(listfile)", &fh))
   {
     size_t filesize = SFileGetFileSize(fh, nullptr); //last nullptr for newer version of StormLib
 
@@ -74,6 +219,8 @@ void MPQArchive::finishLoading()
     SFileReadFile(fh, readbuffer.data(), filesize, nullptr, nullptr); //last nullptrs for newer version of StormLib
     SFileCloseFile(fh);
 
+    std::vector<std::string> filenames;
+
     std::string current;
     for (char c : readbuffer)
     {
@@ -83,7 +230,7 @@ void MPQArchive::finishLoading()
       }
       if (c == '\n')
       {
-        gListfile.emplace (noggit::mpq::normalized_filename (current));
+        filenames.emplace_back (noggit::mpq::normalized_filename (current));
         current.resize (0);
       }
       else
@@ -94,8 +241,16 @@ void MPQArchive::finishLoading()
 
     if (!current.empty())
     {
-      gListfile.emplace (noggit::mpq::normalized_filename (current));
+      filenames.emplace_back (noggit::mpq::normalized_filename (current));
+    }
+
+    for (auto const& name : filenames)
+    {
+      index().add_in_archive (name, this, priority());
     }
+
+    boost::mutex::scoped_lock lock(gListfileLoadingMutex);
+    gListfile.insert (filenames.begin(), filenames.end());
   }
 
   finished = true;
@@ -109,8 +264,37 @@ void MPQArchive::finishLoading()
 
 MPQArchive::~MPQArchive()
 {
-  if (_archiveHandle)
-    SFileCloseArchive(_archiveHandle);
+  for (HANDLE handle : _thread_handles)
+  {
+    SFileCloseArchive(handle);
+  }
+}
+
+HANDLE MPQArchive::thread_handle() const
+{
+  auto& handles (archive_handles_of_this_thread());
+  auto const it (handles.find (_id));
+
+  if (it != handles.end())
+  {
+    return it->second;
+  }
+
+  HANDLE handle (nullptr);
+
+  if (!SFileOpenArchive (filename.c_str(), 0, MPQ_OPEN_NO_LISTFILE | STREAM_FLAG_READ_ONLY, &handle))
+  {
+    return nullptr;
+  }
+
+  {
+    std::lock_guard<std::mutex> const lock (_thread_handles_mutex);
+    _thread_handles.emplace_back (handle);
+  }
+
+  handles.emplace (_id, handle);
+
+  return handle;
 }
 
 bool MPQArchive::allFinishedLoading()
@@ -133,12 +317,14 @@ void MPQArchive::allFinishLoading()
 
 void MPQArchive::unloadAllMPQs()
 {
+  index().clear_archives();
   _openArchives.clear();
 }
 
 bool MPQArchive::hasFile(std::string const& filename) const
 {
-  return SFileHasFile(_archiveHandle, noggit::mpq::normalized_filename_insane (filename).c_str());
+  HANDLE handle (thread_handle());
+  return handle && SFileHasFile(handle, noggit::mpq::normalized_filename_insane (filename).c_str());
 }
 
 void MPQArchive::unloadMPQ(std::string const& filename)
@@ -147,6 +333,7 @@ void MPQArchive::unloadMPQ(std::string const& filename)
   {
     if (it->first == filename)
     {
+      index().remove_archive (it->second.get());
       _openArchives.erase(it);
     }
   }
@@ -155,26 +342,45 @@ void MPQArchive::unloadMPQ(std::string const& filename)
 bool MPQArchive::openFile(std::string const& filename, HANDLE* fileHandle) const
 {
   assert(fileHandle);
-  return SFileOpenFileEx(_archiveHandle, noggit::mpq::normalized_filename_insane (filename).c_str(), 0, fileHandle);
+  HANDLE handle (thread_handle());
+  return handle && SFileOpenFileEx(handle, noggit::mpq::normalized_filename_insane (filename).c_str(), 0, fileHandle);
 }
 
 namespace
 {
   boost::filesystem::path getDiskPath (std::string const& pFilename)
   {
-    QSettings settings;
-    return boost::filesystem::path (settings.value ("project/path").toString().toStdString())
-      / noggit::mpq::normalized_filename (pFilename);
+    auto const normalized (noggit::mpq::normalized_filename (pFilename));
+    return index().on_disk (normalized).get_value_or (index().project_path() / normalized);
+  }
+
+  MPQArchive const* find_in_archives (std::string const& filename)
+  {
+    auto const normalized (noggit::mpq::normalized_filename (filename));
+
+    if (archive_index_complete())
+    {
+      if (auto archive = index().in_archive (normalized))
+      {
+        return archive;
+      }
+    }
+
+    for (ArchivesMap::reverse_iterator i = _openArchives.rbegin(); i != _openArchives.rend(); ++i)
+    {
+      if (i->second->hasFile (filename))
+      {
+        index().add_in_archive (normalized, i->second.get(), i->second->priority());
+        return i->second.get();
+      }
+    }
+
+    return nullptr;
   }
 
   bool existsInMPQ (std::string const& filename)
   {
-    return std::any_of ( _openArchives.begin(), _openArchives.end()
-                       , [&] (ArchiveEntry const& archive)
-                         {
-                           return archive.second->hasFile (filename);
-                         }
-                       );
+    return !!find_in_archives (filename);
   }
 }
 
@@ -184,15 +390,27 @@ namespace
 MPQFile::MPQFile(std::string const& filename)
   : eof(true)
   , pointer(0)
+  , _data(nullptr)
+  , _size(0)
   , External(false)
   , _disk_path (getDiskPath (filename))
+  , _mpq_path (filename)
 {
   if (filename.empty())
     throw std::runtime_error("MPQFile: filename empty");
 
-  boost::mutex::scoped_lock lock(gMPQFileMutex);
+  std::ifstream input;
+  if (existsOnDisk (filename))
+  {
+    if (map_from_disk())
+    {
+      External = true;
+      eof = false;
+      return;
+    }
 
-  std::ifstream input(_disk_path.string(), std::ios_base::binary | std::ios_base::in);
+    input.open(_disk_path.string(), std::ios_base::binary | std::ios_base::in);
+  }
   if (input.is_open())
   {
     External = true;
@@ -205,39 +423,88 @@ MPQFile::MPQFile(std::string const& filename)
     input.read(buffer.data(), buffer.size());
 
     input.close();
+    use_buffer();
     return;
   }
 
-  for (ArchivesMap::reverse_iterator i = _openArchives.rbegin(); i != _openArchives.rend(); ++i)
-  {
-    HANDLE fileHandle;
+  HANDLE fileHandle;
 
-    if (!i->second->openFile(filename, &fileHandle))
-      continue;
+  if (auto archive = find_in_archives (filename))
+  {
+    if (!archive->openFile(filename, &fileHandle))
+    {
+      throw std::runtime_error ("File '" + filename + "' is indexed but could not be opened.");
+    }
 
     eof = false;
     buffer.resize (SFileGetFileSize(fileHandle, nullptr));
     SFileReadFile(fileHandle, buffer.data(), buffer.size(), nullptr, nullptr); //last nullptrs for newer version of StormLib
     SFileCloseFile(fileHandle);
 
+    use_buffer();
     return;
   }
 
   throw std::invalid_argument ("File '" + filename + "' does not exist.");
 }
 
+MPQFile::MPQFile(MPQFile const& file, size_t position)
+  : eof(position >= file._size)
+  , pointer(position)
+  , _data(file._data)
+  , _size(file._size)
+  , External(file.External)
+  , _disk_path(file._disk_path)
+  , _mpq_path(file._mpq_path)
+{}
+
 MPQFile::~MPQFile()
 {
   close();
 }
 
+bool MPQFile::map_from_disk()
+{
+  try
+  {
+    boost::interprocess::file_mapping const file
+      (_disk_path.string().c_str(), boost::interprocess::read_only);
+    _mapping = std::make_unique<boost::interprocess::mapped_region>
+      (file, boost::interprocess::read_only);
+  }
+  catch (boost::interprocess::interprocess_exception const&)
+  {
+    // e.g. empty files can't be mapped, those are read the usual way
+    _mapping.reset();
+    return false;
+  }
+
+  _data = static_cast<char const*> (_mapping->get_address());
+  _size = _mapping->get_size();
+
+  return true;
+}
+
+void MPQFile::use_buffer()
+{
+  _mapping.reset();
+  _data = buffer.data();
+  _size = buffer.size();
+}
+
+void MPQFile::setBuffer (std::vector<char> const& vec)
+{
+  buffer = vec;
+  use_buffer();
+}
+
 bool MPQFile::exists (std::string const& filename)
 {
   return existsOnDisk (filename) || existsInMPQ (filename);
 }
 bool MPQFile::existsOnDisk (std::string const& filename)
 {
-  return boost::filesystem::exists (getDiskPath (filename));
+  return !!index().on_disk (noggit::mpq::normalized_filename (filename));
 }
 
 size_t MPQFile::read(void* dest, size_t bytes)
@@ -246,12 +513,12 @@ size_t MPQFile::read(void* dest, size_t bytes)
     return 0;
 
   size_t rpos = pointer + bytes;
-  if (rpos > buffer.size()) {
-    bytes = buffer.size() - pointer;
+  if (rpos > _size) {
+    bytes = _size - pointer;
     eof = true;
   }
 
-  memcpy(dest, &(buffer[pointer]), bytes);
+  memcpy(dest, _data + pointer, bytes);
 
   pointer = rpos;
 
@@ -266,13 +533,13 @@ bool MPQFile::isEof() const
 void MPQFile::seek(size_t offset)
 {
   pointer = offset;
-  eof = (pointer >= buffer.size());
+  eof = (pointer >= _size);
 }
 
 void MPQFile::seekRelative(size_t offset)
 {
   pointer += offset;
-  eof = (pointer >= buffer.size());
+  eof = (pointer >= _size);
 }
 
 void MPQFile::close()
@@ -282,7 +549,7 @@ void MPQFile::close()
 
 size_t MPQFile::getSize() const
 {
-  return buffer.size();
+  return _size;
 }
 
 size_t MPQFile::getPos() const
@@ -292,18 +559,25 @@ size_t MPQFile::getPos() const
 
 char const* MPQFile::getBuffer() const
 {
-  return buffer.data();
+  return _data;
 }
 
 char const* MPQFile::getPointer() const
 {
-  return buffer.data() + pointer;
+  return _data + pointer;
 }
 
 void MPQFile::SaveFile()
 {
   LogDebug << "Save file to: " << _disk_path << std::endl;
 
+  // the mapped file is about to be overwritten
+  if (_mapping)
+  {
+    buffer.assign (_data, _data + _size);
+    use_buffer();
+  }
+
   auto const directory_name (_disk_path.parent_path());
   boost::system::error_code ec;
   boost::filesystem::create_directories (directory_name, ec);
@@ -312,15 +586,37 @@ void MPQFile::SaveFile()
     LogError << "Creating directory \"" << directory_name << "\" failed: " << ec << ". Saving is highly likely to fail." << std::endl;
   }
 
-  std::ofstream output(_disk_path.string(), std::ios_base::binary | std::ios_base::out);
+  // written next to the file and moved over it at once, so that neither a
+  // crash nor a concurrent reader ever sees a partially written file
+  boost::filesystem::path temporary_path (_disk_path);
+  temporary_path += ".tmp";
+
+  std::ofstream output(temporary_path.string(), std::ios_base::binary | std::ios_base::out);
   if (output.is_open())
   {
     Log << "Saving file \"" << _disk_path << "\"." << std::endl;
 
-    output.write(buffer.data(), buffer.size());
+    output.write(_data, _size);
     output.close();
 
+    if (!output)
+    {
+      LogError << "Writing \"" << temporary_path << "\" failed, \"" << _disk_path << "\" is left untouched." << std::endl;
+      boost::filesystem::remove (temporary_path, ec);
+      return;
+    }
+
+    boost::filesystem::rename (temporary_path, _disk_path, ec);
+    if (ec)
+    {
+      LogError << "Replacing \"" << _disk_path << "\" failed: " << ec << "." << std::endl;
+      boost::filesystem::remove (temporary_path, ec);
+      return;
+    }
+
     External = true;
+
+    index().add_on_disk (noggit::mpq::normalized_filename (_mpq_path), _disk_path);
   }
 }
 
@@ -339,6 +635,11 @@ namespace noggit
                      );
       return filename;
     }
+    void rescan_project_directory()
+    {
+      index().rescan_project_directory();
+    }
+
     std::string normalized_filename_insane (std::string filename)
     {
       std::transform (filename.begin(), filename.end(), filename.begin(), ::toupper);
@@ -8,11 +8,22 @@
 
 #include <boost/filesystem/path.hpp>
 
+#include <cstddef>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <unordered_set>
 #include <vector>
 
+namespace boost
+{
+  namespace interprocess
+  {
+    class mapped_region;
+  }
+}
+
 class AsyncLoader;
 class MPQArchive;
 class MPQFile;
@@ -21,13 +32,24 @@ extern std::unordered_set<std::string> gListfile;
 
 class MPQArchive : public AsyncObject
 {
-  HANDLE _archiveHandle;
+  //! StormLib archive handles must not be used by several threads at
+  //! once, so every thread reading from an archive gets its own handle.
+  //! Handles are created lazily and all closed when the archive is.
+  HANDLE thread_handle() const;
+
+  std::size_t const _id;
+  mutable std::mutex _thread_handles_mutex;
+  mutable std::vector<HANDLE> _thread_handles;
 
 public:
   MPQArchive(const std::string& filename, bool doListfile);
 
   ~MPQArchive();
 
+  //! archives opened later have a higher priority and override files
+  //! of the ones opened before them
+  std::size_t priority() const { return _id; }
+
   bool hasFile(const std::string& filename) const;
   bool openFile(const std::string& filename, HANDLE* fileHandle) const;
 
@@ -50,6 +72,15 @@ class MPQFile
   std::vector<char> buffer;
   size_t pointer;
 
+  //! Files on disk are mapped read-only instead of being copied into
+  //! buffer. _data and _size describe the content in both cases, the
+  //! mapping is only replaced by a copy once the content is modified.
+  std::unique_ptr<boost::interprocess::mapped_region> _mapping;
+  char const* _data;
+  size_t _size;
+
+  void use_buffer();
+  bool map_from_disk();
 
   bool External;
   boost::filesystem::path _disk_path;
@@ -58,6 +89,10 @@ class MPQFile
 public:
   explicit MPQFile(const std::string& pFilename);  // filenames are not case sensitive, the are if u dont use a filesystem which is kinda shitty...
 
+  //! read-only view of file's content with its own read position, e.g.
+  //! to parse several parts of a file concurrently. file has to outlive it.
+  MPQFile(MPQFile const& file, size_t position);
+
   MPQFile() = delete;
   ~MPQFile();
   MPQFile(MPQFile const&) = delete;
@@ -82,13 +117,10 @@ public:
   template<typename T>
   const T* get(size_t offset) const
   {
-    return reinterpret_cast<T const*>(buffer.data() + offset);
+    return reinterpret_cast<T const*>(_data + offset);
   }
 
-  void setBuffer (std::vector<char> const& vec)
-  {
-    buffer = vec;
-  }
+  void setBuffer (std::vector<char> const& vec);
 
   void SaveFile();
 
@@ -104,5 +136,9 @@ namespace noggit
   {
     std::string normalized_filename (std::string filename);
     std::string normalized_filename_insane (std::string filename);
+
+    //! forget the indexed project directory files, e.g. after the project
+    //! path changed. the directory is scanned again on the next lookup.
+    void rescan_project_directory();
   }
 }
@@ -1,6 +1,7 @@
 // This file is part of Noggit3, licensed under GNU General Public License (version 3).
 
 #include <math/frustum.hpp>
+#include <math/grid_traversal.hpp>
 #include <math/quaternion.hpp>
 #include <math/vector_3d.hpp>
 #include <noggit/Brush.h>
@@ -11,15 +12,39 @@
 #include <noggit/Misc.h>
 #include <noggit/World.h>
 #include <noggit/alphamap.hpp>
+#include <noggit/heightfield.hpp>
+#include <noggit/terrain_brush.hpp>
 #include <noggit/texture_set.hpp>
 #include <noggit/tool_enums.hpp>
 #include <noggit/ui/TexturingGUI.h>
 #include <opengl/scoped.hpp>
+#include <opengl/shader.hpp>
 
 #include <algorithm>
 #include <iostream>
 #include <map>
 
+namespace
+{
+  //! components of the vertices as separate arrays for the brushes
+  struct split_vertices
+  {
+    split_vertices (math::vector_3d const* vertices)
+    {
+      for (int i (0); i < mapbufsize; ++i)
+      {
+        x[i] = vertices[i].x;
+        y[i] = vertices[i].y;
+        z[i] = vertices[i].z;
+      }
+    }
+
+    float x[mapbufsize];
+    float y[mapbufsize];
+    float z[mapbufsize];
+  };
+}
+
 MapChunk::MapChunk(MapTile *maintile, MPQFile *f, bool bigAlpha, tile_mode mode)
   : _mode(mode)
   , mt(maintile)
@@ -238,6 +263,22 @@ void MapChunk::update_intersect_points()
 
   _intersect_points.clear();
   _intersect_points = misc::intersection_points(vmin, vmax);
+
+  for (int x = 0; x < 8; ++x)
+  {
+    for (int z = 0; z < 8; ++z)
+    {
+      float const heights[5] = { mVertices[indexNoLoD(z, x)].y
+                               , mVertices[indexNoLoD(z, x + 1)].y
+                               , mVertices[indexNoLoD(z + 1, x)].y
+                               , mVertices[indexNoLoD(z + 1, x + 1)].y
+                               , mVertices[indexLoD(z, x)].y
+                               };
+      auto const range (std::minmax_element (std::begin (heights), std::end (heights)));
+      _quad_min_y[x * 8 + z] = *range.first;
+      _quad_max_y[x * 8 + z] = *range.second;
+    }
+  }
 }
 
 void MapChunk::upload()
@@ -261,10 +302,38 @@ void MapChunk::upload()
   gl.bufferData<GL_ARRAY_BUFFER> (_normals_vbo, sizeof(mNormals), mNormals, GL_STATIC_DRAW);
   gl.bufferData<GL_ARRAY_BUFFER> (_mccv_vbo, sizeof(mccv), mccv, GL_STATIC_DRAW);
 
+  _need_vertices_buffer_update = false;
+  _need_normals_buffer_update = false;
+  _need_mccv_buffer_update = false;
+
   update_indices_buffer();
   _uploaded = true;
 }
 
+void MapChunk::update_vertex_buffers()
+{
+  if (_need_vertices_buffer_update)
+  {
+    gl.bufferData<GL_ARRAY_BUFFER> (_vertices_vbo, sizeof(mVertices), mVertices, GL_STATIC_DRAW);
+    _need_vertices_buffer_update = false;
+    _need_vao_update = true;
+  }
+
+  if (_need_normals_buffer_update)
+  {
+    gl.bufferData<GL_ARRAY_BUFFER> (_normals_vbo, sizeof(mNormals), mNormals, GL_STATIC_DRAW);
+    _need_normals_buffer_update = false;
+    _need_vao_update = true;
+  }
+
+  if (_need_mccv_buffer_update)
+  {
+    gl.bufferData<GL_ARRAY_BUFFER> (_mccv_vbo, sizeof(mccv), mccv, GL_STATIC_DRAW);
+    _need_mccv_buffer_update = false;
+    _need_vao_update = true;
+  }
+}
+
 void MapChunk::update_indices_buffer()
 {
   {
@@ -442,13 +511,7 @@ void MapChunk::clearHeight()
 
   update_intersect_points();
 
-  if (_uploaded)
-  {
-    gl.bufferData<GL_ARRAY_BUFFER>
-      (_vertices_vbo, sizeof(mVertices), mVertices, GL_STATIC_DRAW);
-
-    _need_vao_update = true;
-  }
+  _need_vertices_buffer_update = true;
 }
 
 bool MapChunk::is_visible ( const float& cull_distance
@@ -513,6 +576,12 @@ bool MapChunk::update_visibility ( const float& cull_distance
   return lod_changed;
 }
 
+namespace
+{
+  opengl::shader_variable const tex_anim_uniforms[4] =
+    {"tex_anim_0", "tex_anim_1", "tex_anim_2", "tex_anim_3"};
+}
+
 void MapChunk::draw ( math::frustum const& frustum
                     , opengl::scoped::use_program& mcnk_shader
                     , GLuint const& tex_coord_vbo
@@ -548,6 +617,10 @@ void MapChunk::draw ( math::frustum const& frustum
     update_visibility(cull_distance, frustum, camera, display);
   }
 
+  update_vertex_buffers();
+  // from edits made outside of the brushes
+  texture_set->release_erased_textures();
+
   // todo update lod too
   if (_need_vao_update)
   {
@@ -569,7 +642,7 @@ void MapChunk::draw ( math::frustum const& frustum
 
       if (texture_set->is_animated(i))
       {
-        mcnk_shader.uniform("tex_anim_"+ std::to_string(i), texture_set->anim_uv_offset(i, animtime));
+        mcnk_shader.uniform(tex_anim_uniforms[i], texture_set->anim_uv_offset(i, animtime));
       }
     }
   }
@@ -611,30 +684,63 @@ void MapChunk::draw ( math::frustum const& frustum
   {
     if (texture_set->is_animated(i))
     {
-      mcnk_shader.uniform("tex_anim_" + std::to_string(i), math::vector_2d());
+      mcnk_shader.uniform(tex_anim_uniforms[i], math::vector_2d());
     }
   }
 }
 
-void MapChunk::intersect (math::ray const& ray, selection_result* results)
+bool MapChunk::intersect (math::ray const& ray, selection_result* results)
 {
   if (!ray.intersect_bounds (vmin, vmax))
   {
-    return;
+    return false;
   }
 
-  for (int i (0); i < strip_without_holes.size(); i += 3)
+  bool hit (false);
+
+  // the quads are visited front to back so the first one hit has the closest hit
+  math::traverse_grid (ray, vmin, vmax, 8, 8, [&] (int x, int z)
   {
-    if ( auto distance = ray.intersect_triangle ( mVertices[strip_without_holes[i + 0]]
-                                                , mVertices[strip_without_holes[i + 1]]
-                                                , mVertices[strip_without_holes[i + 2]]
-                                                )
+    int const quad (x * 8 + z);
+
+    if (!ray.intersect_bounds ( {xbase + x * UNITSIZE, _quad_min_y[quad], zbase + z * UNITSIZE}
+                              , {xbase + (x + 1) * UNITSIZE, _quad_max_y[quad], zbase + (z + 1) * UNITSIZE}
+                              )
        )
     {
-      results->emplace_back
-        (*distance, selected_chunk_type (this, i, ray.position (*distance)));
+      return false;
     }
-  }
+
+    boost::optional<float> closest;
+    int closest_triangle (0);
+
+    // 4 triangles per quad
+    for (int i (quad * 12); i < quad * 12 + 12; i += 3)
+    {
+      auto const distance = ray.intersect_triangle ( mVertices[strip_without_holes[i + 0]]
+                                                   , mVertices[strip_without_holes[i + 1]]
+                                                   , mVertices[strip_without_holes[i + 2]]
+                                                   );
+      if (distance && (!closest || *distance < *closest))
+      {
+        closest = distance;
+        closest_triangle = i;
+      }
+    }
+
+    if (!closest)
+    {
+      return false;
+    }
+
+    results->emplace_back
+      (*closest, selected_chunk_type (this, closest_triangle, ray.position (*closest)));
+    hit = true;
+
+    return true;
+  });
+
+  return hit;
 }
 
 void MapChunk::updateVerticesData()
@@ -650,35 +756,28 @@ void MapChunk::updateVerticesData()
 
   update_intersect_points();
 
-  if (_uploaded)
-  {
-    gl.bufferData<GL_ARRAY_BUFFER>(_vertices_vbo, sizeof(mVertices), mVertices, GL_STATIC_DRAW);
-    _need_vao_update = true;
-  }
+  _need_vertices_buffer_update = true;
 }
 
-void MapChunk::recalcNorms (std::function<boost::optional<float> (float, float)> height)
+void MapChunk::recalcNorms (noggit::heightfield const& heights)
 {
-  auto point
-  (
-    [&] (math::vector_3d& v, float xdiff, float zdiff)
-    {
-      return math::vector_3d
-             ( v.x + xdiff
-             , height (v.x + xdiff, v.z + zdiff).get_value_or (v.y)
-             , v.z + zdiff
-             );
-    }
-  );
-
   float const half_unit = UNITSIZE / 2.f;
 
   for (int i = 0; i<mapbufsize; ++i)
   {
-    math::vector_3d const P1 (point(mVertices[i], -half_unit, -half_unit));
-    math::vector_3d const P2 (point(mVertices[i],  half_unit, -half_unit));
-    math::vector_3d const P3 (point(mVertices[i],  half_unit,  half_unit));
-    math::vector_3d const P4 (point(mVertices[i], -half_unit,  half_unit));
+    int row, column;
+    noggit::heightfield::vertex_index (xbase, zbase, i, row, column);
+
+    // the diagonal neighbours half a unit away are on the rows above and
+    // below, which are shifted by half a unit
+    int const left = row % 2 ? column : column - 1;
+    int const right = left + 1;
+
+    math::vector_3d const& v (mVertices[i]);
+    math::vector_3d const P1 (v.x - half_unit, heights.height (row - 1, left, v.y), v.z - half_unit);
+    math::vector_3d const P2 (v.x + half_unit, heights.height (row - 1, right, v.y), v.z - half_unit);
+    math::vector_3d const P3 (v.x + half_unit, heights.height (row + 1, right, v.y), v.z + half_unit);
+    math::vector_3d const P4 (v.x - half_unit, heights.height (row + 1, left, v.y), v.z + half_unit);
 
     math::vector_3d const N1 ((P2 - mVertices[i]) % (P1 - mVertices[i]));
     math::vector_3d const N2 ((P3 - mVertices[i]) % (P2 - mVertices[i]));
@@ -696,69 +795,35 @@ void MapChunk::recalcNorms (std::function<boost::optional<float> (float, float)>
     mNormals[i] = {-Norm.z, Norm.y, -Norm.x};
   }
 
-  if (_uploaded)
-  {
-    gl.bufferData<GL_ARRAY_BUFFER> (_normals_vbo, sizeof(mNormals), mNormals, GL_STATIC_DRAW);
-    _need_vao_update = true;
-  }
+  _need_normals_buffer_update = true;
 }
 
 bool MapChunk::changeTerrain(math::vector_3d const& pos, float change, float radius, int BrushType, float inner_radius)
 {
-  float dist, xdiff, zdiff;
-  bool changed = false;
+  if (BrushType < eTerrainType_Flat || BrushType > eTerrainType_Gaussian)
+  {
+    LogError << "Invalid terrain edit type (" << BrushType << ")" << std::endl;
+    return false;
+  }
 
-  for (int i = 0; i < mapbufsize; ++i)
+  split_vertices vertices (mVertices);
+
+  bool const changed
+    ( noggit::terrain_brush::change_heights
+        ( BrushType
+        , vertices.x, vertices.z, vertices.y, mapbufsize
+        , pos.x, pos.z
+        , change, radius, inner_radius
+        )
+    );
+
+  if (changed)
   {
-    xdiff = mVertices[i].x - pos.x;
-    zdiff = mVertices[i].z - pos.z;
-    if (BrushType == eTerrainType_Quadra)
+    for (int i = 0; i < mapbufsize; ++i)
     {
-      if ((std::abs(xdiff) < std::abs(radius / 2)) && (std::abs(zdiff) < std::abs(radius / 2)))
-      {
-        dist = std::sqrt(xdiff*xdiff + zdiff*zdiff);
-        mVertices[i].y += change * (1.0f - dist * inner_radius / radius);
-        changed = true;
-      }
+      mVertices[i].y = vertices.y[i];
     }
-    else
-    {
-      dist = std::sqrt(xdiff*xdiff + zdiff*zdiff);
-      if (dist < radius)
-      {
-        changed = true;
 
-        switch (BrushType)
-        {
-          case eTerrainType_Flat:
-            mVertices[i].y += change;
-            break;
-          case eTerrainType_Linear:
-            mVertices[i].y += change * (1.0f - dist * (1.0f - inner_radius) / radius);
-            break;
-          case eTerrainType_Smooth:
-            mVertices[i].y += change / (1.0f + dist / radius);
-            break;
-          case eTerrainType_Polynom:
-            mVertices[i].y += change*((dist / radius)*(dist / radius) + dist / radius + 1.0f);
-            break;
-          case eTerrainType_Trigo:
-            mVertices[i].y += change*cos(dist / radius);
-            break;
-          case eTerrainType_Gaussian:
-            mVertices[i].y += dist < radius * inner_radius ? change * std::exp(-(std::pow(radius * inner_radius / radius, 2) / (2 * std::pow(0.39f, 2)))) : change * std::exp(-(std::pow(dist / radius, 2) / (2 * std::pow(0.39f, 2))));
-
-            break;
-          default:
-            LogError << "Invalid terrain edit type (" << BrushType << ")" << std::endl;
-            changed = false;
-            break;
-        }
-      }
-    }
-  }
-  if (changed)
-  {
     updateVerticesData();
   }
   return changed;
@@ -766,7 +831,6 @@ bool MapChunk::changeTerrain(math::vector_3d const& pos, float change, float rad
 
 bool MapChunk::ChangeMCCV(math::vector_3d const& pos, math::vector_4d const& color, float change, float radius, bool editMode)
 {
-  float dist;
   bool changed = false;
 
   if (!hasMCCV)
@@ -783,36 +847,37 @@ bool MapChunk::ChangeMCCV(math::vector_3d const& pos, math::vector_4d const& col
     hasMCCV = true;
   }
 
+  split_vertices const vertices (mVertices);
+  float r[mapbufsize], g[mapbufsize], b[mapbufsize];
+
   for (int i = 0; i < mapbufsize; ++i)
   {
-    dist = misc::dist(mVertices[i], pos);
-    if (dist <= radius)
-    {
-      float edit = change * (1.0f - dist / radius);
-      if (editMode)
-      {
-        mccv[i].x += (color.x / 0.5f - mccv[i].x)* edit;
-        mccv[i].y += (color.y / 0.5f - mccv[i].y)* edit;
-        mccv[i].z += (color.z / 0.5f - mccv[i].z)* edit;
-      }
-      else
-      {
-        mccv[i].x += (1.0f - mccv[i].x) * edit;
-        mccv[i].y += (1.0f - mccv[i].y) * edit;
-        mccv[i].z += (1.0f - mccv[i].z) * edit;
-      }
-
-      mccv[i].x = std::min(std::max(mccv[i].x, 0.0f), 2.0f);
-      mccv[i].y = std::min(std::max(mccv[i].y, 0.0f), 2.0f);
-      mccv[i].z = std::min(std::max(mccv[i].z, 0.0f), 2.0f);
+    r[i] = mccv[i].x;
+    g[i] = mccv[i].y;
+    b[i] = mccv[i].z;
+  }
 
-      changed = true;
+  if ( noggit::terrain_brush::blend_colors
+         ( vertices.x, vertices.z, r, g, b, mapbufsize
+         , pos.x, pos.z
+         , change, radius
+         , editMode ? color.x / 0.5f : 1.0f
+         , editMode ? color.y / 0.5f : 1.0f
+         , editMode ? color.z / 0.5f : 1.0f
+         )
+     )
+  {
+    for (int i = 0; i < mapbufsize; ++i)
+    {
+      mccv[i] = {r[i], g[i], b[i]};
     }
+
+    changed = true;
   }
-  if (changed && _uploaded)
+
+  if (changed)
   {
-    gl.bufferData<GL_ARRAY_BUFFER> (_mccv_vbo, sizeof(mccv), mccv, GL_STATIC_DRAW);
-    _need_vao_update = true;
+    _need_mccv_buffer_update = true;
   }
 
   return changed;
@@ -853,51 +918,32 @@ bool MapChunk::flattenTerrain ( math::vector_3d const& pos
                               , math::degrees orientation
                               )
 {
-  bool changed (false);
-
-  for (int i(0); i < mapbufsize; ++i)
+  if (BrushType < eFlattenType_Flat || BrushType > eFlattenType_Origin)
   {
-	  float const dist(misc::dist(mVertices[i], pos));
-
-	  if (dist >= radius)
-	  {
-		  continue;
-	  }
-
-	  float const ah(origin.y
-		  + ((mVertices[i].x - origin.x) * math::cos(orientation)
-			  + (mVertices[i].z - origin.z) * math::sin(orientation)
-			  ) * math::tan(angle)
-	  );
-
-	  if ((!mode.lower && ah < mVertices[i].y)
-		  || (!mode.raise && ah > mVertices[i].y)
-		  )
-	  {
-		  continue;
-	  }
-
-	  if (BrushType == eFlattenType_Origin)
-	  {
-		  mVertices[i].y = origin.y;
-		  changed = true;
-		  continue;
-	  }
-
-    mVertices[i].y = math::interpolation::linear
-      ( BrushType == eFlattenType_Flat ? remain
-      : BrushType == eFlattenType_Linear ? remain * (1.f - dist / radius)
-      : BrushType == eFlattenType_Smooth ? pow (remain, 1.f + dist / radius)
-      : throw std::logic_error ("bad brush type")
-      , mVertices[i].y
-      , ah
-      );
-
-    changed = true;
+    throw std::logic_error ("bad brush type");
   }
 
+  split_vertices vertices (mVertices);
+
+  bool const changed
+    ( noggit::terrain_brush::flatten_heights
+        ( BrushType
+        , vertices.x, vertices.z, vertices.y, mapbufsize
+        , pos.x, pos.z
+        , remain, radius
+        , mode.raise, mode.lower
+        , origin.x, origin.y, origin.z
+        , math::cos (orientation), math::sin (orientation), math::tan (angle)
+        )
+    );
+
   if (changed)
   {
+    for (int i (0); i < mapbufsize; ++i)
+    {
+      mVertices[i].y = vertices.y[i];
+    }
+
     updateVerticesData();
   }
 
@@ -909,7 +955,7 @@ bool MapChunk::blurTerrain ( math::vector_3d const& pos
                            , float radius
                            , int BrushType
                            , flatten_mode const& mode
-                           , std::function<boost::optional<float> (float, float)> height
+                           , noggit::blur_kernel const& kernel
                            )
 {
   bool changed (false);
@@ -919,54 +965,49 @@ bool MapChunk::blurTerrain ( math::vector_3d const& pos
     return false;
   }
 
-  for (int i (0); i < mapbufsize; ++i)
+  // averages are computed for a whole row of vertices at once
+  for (int row (0); row < 17; ++row)
   {
-    float const dist(misc::dist(mVertices[i], pos));
+    int const first ((row / 2) * 17 + (row % 2 ? 9 : 0));
+    int const count (row % 2 ? 8 : 9);
 
-    if (dist >= radius)
+    if (std::abs (mVertices[first].z - pos.z) >= radius)
     {
       continue;
     }
 
-    int Rad = (int)(radius / UNITSIZE);
-    float TotalHeight = 0;
-    float TotalWeight = 0;
-    for (int j = -Rad * 2; j <= Rad * 2; ++j)
+    boost::optional<float> averages[9];
+    kernel.average (mVertices[first].z, mVertices[first].x, count, averages);
+
+    for (int n (0); n < count; ++n)
     {
-      float tz = pos.z + j * UNITSIZE / 2;
-      for (int k = -Rad; k <= Rad; ++k)
+      int const i (first + n);
+      float const dist(misc::dist(mVertices[i], pos));
+
+      if (dist >= radius || !averages[n])
       {
-        float tx = pos.x + k*UNITSIZE + (j % 2) * UNITSIZE / 2.0f;
-        float dist2 = misc::dist (tx, tz, mVertices[i].x, mVertices[i].z);
-        if (dist2 > radius)
-          continue;
-        auto h (height (tx, tz));
-        if (h)
-        {
-          TotalHeight += (1.0f - dist2 / radius) * h.get();
-          TotalWeight += (1.0f - dist2 / radius);
-        }
+        continue;
       }
-    }
 
-    float target = TotalHeight / TotalWeight;
-    float& y = mVertices[i].y;
+      float target = *averages[n];
+      float& y = mVertices[i].y;
 
-    if ((target > y && !mode.raise) || (target < y && !mode.lower))
-    {
-      continue;
-    }
+      if ((target > y && !mode.raise) || (target < y && !mode.lower))
+      {
+        continue;
+      }
 
-    y = math::interpolation::linear
-      ( BrushType == eFlattenType_Flat ? remain
-      : BrushType == eFlattenType_Linear ? remain * (1.f - dist / radius)
-      : BrushType == eFlattenType_Smooth ? pow (remain, 1.f + dist / radius)
-      : throw std::logic_error ("bad brush type")
-      , y
-      , target
-      );
+      y = math::interpolation::linear
+        ( BrushType == eFlattenType_Flat ? remain
+        : BrushType == eFlattenType_Linear ? remain * (1.f - dist / radius)
+        : BrushType == eFlattenType_Smooth ? pow (remain, 1.f + dist / radius)
+        : throw std::logic_error ("bad brush type")
+        , y
+        , target
+        );
 
-    changed = true;
+      changed = true;
+    }
   }
 
   if (changed)
@@ -1076,12 +1117,128 @@ void MapChunk::setFlag(bool changeto, uint32_t flag)
   }
 }
 
-void MapChunk::save(sExtendableArray &lADTFile, int &lCurrentPosition, int &lMCIN_Position, std::map<std::string, int> &lTextures, std::vector<WMOInstance> &lObjectInstances, std::vector<ModelInstance>& lModelInstances)
+std::vector<std::uint8_t> MapChunk::save_state() const
+{
+  std::vector<std::uint8_t> state;
+  noggit::state_writer writer(state);
+
+  for (int i = 0; i < mapbufsize; ++i)
+  {
+    writer.write(mVertices[i].y);
+  }
+  for (int i = 0; i < mapbufsize; ++i)
+  {
+    writer.write(mNormals[i]._data, 3);
+  }
+  for (int i = 0; i < mapbufsize; ++i)
+  {
+    writer.write(mccv[i]._data, 3);
+  }
+
+  writer.write(static_cast<std::uint8_t>(hasMCCV));
+  writer.write(header_flags.value);
+  writer.write(holes);
+  writer.write(areaID);
+
+  texture_set->save_state(writer);
+
+  return state;
+}
+
+void MapChunk::restore_state(std::vector<std::uint8_t> const& state)
+{
+  noggit::state_reader reader(state);
+
+  for (int i = 0; i < mapbufsize; ++i)
+  {
+    mVertices[i].y = reader.read<float>();
+  }
+  for (int i = 0; i < mapbufsize; ++i)
+  {
+    reader.read(mNormals[i]._data, 3);
+  }
+  for (int i = 0; i < mapbufsize; ++i)
+  {
+    reader.read(mccv[i]._data, 3);
+  }
+
+  hasMCCV = reader.read<std::uint8_t>() != 0;
+  header_flags.value = reader.read<std::uint32_t>();
+
+  int const old_holes = holes;
+  holes = reader.read<int>();
+  areaID = reader.read<unsigned int>();
+
+  texture_set->restore_state(reader);
+
+  if (holes != old_holes)
+  {
+    initStrip();
+  }
+
+  updateVerticesData();
+  _need_normals_buffer_update = true;
+  _need_mccv_buffer_update = true;
+}
+
+MapChunk::save_data MapChunk::prepare_save(std::vector<WMOInstance> const& lObjectInstances, std::vector<ModelInstance> const& lModelInstances)
+{
+  save_data data;
+
+  data.alphamaps = texture_set->save_alpha(use_big_alphamap);
+
+  math::vector_3d lChunkExtents[2];
+  lChunkExtents[0] = math::vector_3d(xbase, 0.0f, zbase);
+  lChunkExtents[1] = math::vector_3d(xbase + CHUNKSIZE, 0.0f, zbase + CHUNKSIZE);
+
+  // search all wmos that are inside this chunk
+  int lID = 0;
+  for(auto const& wmo : lObjectInstances)
+  {
+    if (wmo.isInsideRect(lChunkExtents))
+    {
+      data.object_refs.push_back(lID);
+    }
+
+    lID++;
+  }
+
+  // search all models that are inside this chunk
+  lID = 0;
+  for(auto const& model : lModelInstances)
+  {
+    if (model.isInsideRect (lChunkExtents))
+    {
+      data.doodad_refs.push_back(lID);
+    }
+    lID++;
+  }
+
+  std::size_t lMCAL_Size = 0;
+  for (size_t j = 1; j < texture_set->num(); ++j)
+  {
+    lMCAL_Size += data.alphamaps[j - 1].size();
+  }
+
+  data.size = 8 + 0x80                                                    // MCNK
+            + 8 + mapbufsize * 4                                          // MCVT
+            + (hasMCCV ? 8 + mapbufsize * sizeof(unsigned int) : 0)       // MCCV
+            + 8 + mapbufsize * 3 + 13                                     // MCNR
+            + 8 + texture_set->num() * 0x10                               // MCLY
+            + 8 + 4 * (data.doodad_refs.size() + data.object_refs.size()) // MCRF
+            + (has_shadows() ? 8 + 0x200 : 0)                             // MCSH
+            + 8 + lMCAL_Size                                              // MCAL
+            + 8;                                                          // MCSE
+
+  return data;
+}
+
+void MapChunk::save(sExtendableArray &lADTFile, int &lCurrentPosition, int &lMCIN_Position, std::map<std::string, int> &lTextures, save_data const& data)
 {
   int lID;
   int lMCNK_Size = 0x80;
   int lMCNK_Position = lCurrentPosition;
-  lADTFile.Extend(8 + 0x80);  // This is only the size of the header. More chunks will increase the size.
+  lADTFile.Extend(8);  // The header is appended below. More chunks will increase the size.
   SetChunkHeader(lADTFile, lCurrentPosition, 'MCNK', lMCNK_Size);
   lADTFile.GetPointer<MCIN>(lMCIN_Position + 8)->mEntries[py * 16 + px].offset = lCurrentPosition; // check this
 
@@ -1215,7 +1372,7 @@ void MapChunk::save(sExtendableArray &lADTFile, int &lCurrentPosition, int &lMCI
   lADTFile.GetPointer<MapChunkHeader>(lMCNK_Position + 8)->ofsLayer = lCurrentPosition - lMCNK_Position;
   lADTFile.GetPointer<MapChunkHeader>(lMCNK_Position + 8)->nLayers = texture_set->num();
 
-  std::vector<std::vector<uint8_t>> alphamaps = texture_set->save_alpha(use_big_alphamap);
+  std::vector<std::vector<uint8_t>> const& alphamaps = data.alphamaps;
   int lMCAL_Size = 0;
 
   // MCLY data
@@ -1248,57 +1405,27 @@ void MapChunk::save(sExtendableArray &lADTFile, int &lCurrentPosition, int &lMCI
 
   // MCRF
   //        {
-  std::list<int> lDoodadIDs;
-  std::list<int> lObjectIDs;
-
-  math::vector_3d lChunkExtents[2];
-  lChunkExtents[0] = math::vector_3d(xbase, 0.0f, zbase);
-  lChunkExtents[1] = math::vector_3d(xbase + CHUNKSIZE, 0.0f, zbase + CHUNKSIZE);
-
-  // search all wmos that are inside this chunk
-  lID = 0;
-  for(auto const& wmo : lObjectInstances)
-  {
-    if (wmo.isInsideRect(lChunkExtents))
-    {
-      lObjectIDs.push_back(lID);
-    }
-
-    lID++;
-  }
-
-  // search all models that are inside this chunk
-  lID = 0;
-  for(auto const& model : lModelInstances)
-  {
-    if (model.isInsideRect (lChunkExtents))
-    {
-      lDoodadIDs.push_back(lID);
-    }
-    lID++;
-  }
-
-  int lMCRF_Size = 4 * (lDoodadIDs.size() + lObjectIDs.size());
+  int lMCRF_Size = 4 * (data.doodad_refs.size() + data.object_refs.size());
   lADTFile.Extend(8 + lMCRF_Size);
   SetChunkHeader(lADTFile, lCurrentPosition, 'MCRF', lMCRF_Size);
 
   lADTFile.GetPointer<MapChunkHeader>(lMCNK_Position + 8)->ofsRefs = lCurrentPosition - lMCNK_Position;
-  lADTFile.GetPointer<MapChunkHeader>(lMCNK_Position + 8)->nDoodadRefs = lDoodadIDs.size();
-  lADTFile.GetPointer<MapChunkHeader>(lMCNK_Position + 8)->nMapObjRefs = lObjectIDs.size();
+  lADTFile.GetPointer<MapChunkHeader>(lMCNK_Position + 8)->nDoodadRefs = data.doodad_refs.size();
+  lADTFile.GetPointer<MapChunkHeader>(lMCNK_Position + 8)->nMapObjRefs = data.object_refs.size();
 
   // MCRF data
   int *lReferences = lADTFile.GetPointer<int>(lCurrentPosition + 8);
 
   lID = 0;
-  for (std::list<int>::iterator it = lDoodadIDs.begin(); it != lDoodadIDs.end(); ++it)
+  for (int doodad : data.doodad_refs)
   {
-    lReferences[lID] = *it;
+    lReferences[lID] = doodad;
     lID++;
   }
 
-  for (std::list<int>::iterator it = lObjectIDs.begin(); it != lObjectIDs.end(); ++it)
+  for (int object : data.object_refs)
   {
-    lReferences[lID] = *it;
+    lReferences[lID] = object;
     lID++;
   }
 
@@ -1342,7 +1469,7 @@ void MapChunk::save(sExtendableArray &lADTFile, int &lCurrentPosition, int &lMCI
 
   char * lAlphaMaps = lADTFile.GetPointer<char>(lCurrentPosition + 8);
 
-  for (auto alpha : alphamaps)
+  for (auto const& alpha : alphamaps)
   {
     memcpy(lAlphaMaps, alpha.data(), alpha.size());
     lAlphaMaps += alpha.size();
@@ -15,6 +15,7 @@
 #include <opengl/texture.hpp>
 #include <noggit/Misc.h>
 
+#include <array>
 #include <map>
 #include <memory>
 
@@ -24,6 +25,11 @@ namespace math
   class frustum;
   struct vector_4d;
 }
+namespace noggit
+{
+  class blur_kernel;
+  class heightfield;
+}
 class Brush;
 class ChunkWater;
 class sExtendableArray;
@@ -63,6 +69,10 @@ private:
   int indexLoD(int x, int y);
 
   std::vector<math::vector_3d> _intersect_points;
+  //! height range of the 8x8 quads, indexed by x * 8 + z like the
+  //! triangles of strip_without_holes
+  std::array<float, 64> _quad_min_y;
+  std::array<float, 64> _quad_max_y;
 
   void update_intersect_points();
 
@@ -73,9 +83,15 @@ private:
   bool _uploaded = false;
   bool _need_indice_buffer_update = true;
   bool _need_vao_update = true;
+  //! edits only flag the buffers so they can run off the gl thread,
+  //! draw() uploads them
+  bool _need_vertices_buffer_update = false;
+  bool _need_normals_buffer_update = false;
+  bool _need_mccv_buffer_update = false;
 
   void upload();
   void update_indices_buffer();
+  void update_vertex_buffers();
   void update_vao(opengl::scoped::use_program& mcnk_shader, GLuint const& tex_coord_vbo);
 
   opengl::scoped::deferred_upload_vertex_arrays<1> _vertex_array;
@@ -140,20 +156,20 @@ public:
             );
   //! \todo only this function should be public, all others should be called from it
 
-  void intersect (math::ray const&, selection_result*);
+  //! adds the closest hit if any and returns whether there was one
+  bool intersect (math::ray const&, selection_result*);
   bool ChangeMCCV(math::vector_3d const& pos, math::vector_4d const& color, float change, float radius, bool editMode);
   math::vector_3d pickMCCV(math::vector_3d const& pos);
 
   ChunkWater* liquid_chunk() const;
 
   void updateVerticesData();
-  void recalcNorms (std::function<boost::optional<float> (float, float)> height);
+  void recalcNorms (noggit::heightfield const& heights);
 
-  //! \todo implement Action stack for these
   bool changeTerrain(math::vector_3d const& pos, float change, float radius, int BrushType, float inner_radius);
   bool flattenTerrain(math::vector_3d const& pos, float remain, float radius, int BrushType, flatten_mode const& mode, const math::vector_3d& origin, math::degrees angle, math::degrees orientation);
   bool blurTerrain ( math::vector_3d const& pos, float remain, float radius, int BrushType, flatten_mode const& mode
-                   , std::function<boost::optional<float> (float, float)> height
+                   , noggit::blur_kernel const& kernel
                    );
 
   void selectVertex(math::vector_3d const& pos, float radius, std::set<math::vector_3d*>& vertices);
@@ -161,7 +177,6 @@ public:
   // for the vertex tool
   bool isBorderChunk(std::set<math::vector_3d*>& selected);
 
-  //! \todo implement Action stack for these
   bool paintTexture(math::vector_3d const& pos, Brush *brush, float strength, float pressure, scoped_blp_texture_reference texture);
   bool replaceTexture(math::vector_3d const& pos, float radius, scoped_blp_texture_reference const& old_texture, scoped_blp_texture_reference new_texture);
   bool canPaintTexture(scoped_blp_texture_reference texture);
@@ -172,7 +187,6 @@ public:
 
   void clear_shadows();
 
-  //! \todo implement Action stack for these
   bool isHole(int i, int j);
   void setHole(math::vector_3d const& pos, bool big, bool add);
 
@@ -187,8 +201,25 @@ public:
 
   void clearHeight();
 
+  //! heights, normals, vertex colours, flags, holes, area and textures,
+  //! for the action history
+  std::vector<std::uint8_t> save_state() const;
+  void restore_state(std::vector<std::uint8_t> const& state);
+
   //! \todo this is ugly create a build struct or sth
-  void save(sExtendableArray &lADTFile, int &lCurrentPosition, int &lMCIN_Position, std::map<std::string, int> &lTextures, std::vector<WMOInstance> &lObjectInstances, std::vector<ModelInstance>& lModelInstances);
+  //! what save() needs besides the chunk itself, gathered beforehand so
+  //! that the size of the whole file is known before writing it
+  struct save_data
+  {
+    std::vector<std::vector<uint8_t>> alphamaps;
+    std::vector<int> doodad_refs;
+    std::vector<int> object_refs;
+    //! of the MCNK, including its chunk header
+    std::size_t size;
+  };
+
+  save_data prepare_save(std::vector<WMOInstance> const& lObjectInstances, std::vector<ModelInstance> const& lModelInstances);
+  void save(sExtendableArray &lADTFile, int &lCurrentPosition, int &lMCIN_Position, std::map<std::string, int> &lTextures, save_data const& data);
 
   // fix the gaps with the chunk to the left
   bool fixGapLeft(const MapChunk* chunk);
@@ -1,5 +1,7 @@
 // This file is part of Noggit3, licensed under GNU General Public License (version 3).
 
+#include <math/grid_traversal.hpp>
+#include <noggit/AsyncLoader.h>
 #include <noggit/Log.h>
 #include <noggit/MapChunk.h>
 #include <noggit/MapTile.h>
@@ -12,13 +14,19 @@
 #include <noggit/alphamap.hpp>
 #include <noggit/map_index.hpp>
 #include <noggit/texture_set.hpp>
+#include <noggit/thread_pool.hpp>
 #include <opengl/scoped.hpp>
 #include <opengl/shader.hpp>
 
 #include <QtCore/QSettings>
 
+#include <boost/range/iterator_range.hpp>
+
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <limits>
 #include <list>
 #include <map>
 #include <string>
@@ -51,21 +59,37 @@ MapTile::MapTile( int pX
 
 MapTile::~MapTile()
 {
+  // tiles may be dropped before they got loaded
+  AsyncLoader::instance().ensure_deletable(this);
+
   _world->remove_models_if_needed(uids);
 }
 
 void MapTile::finishLoading()
 {
+  using clock = std::chrono::steady_clock;
+  auto const milliseconds
+    ( [] (clock::duration duration)
+      {
+        return std::chrono::duration<double, std::milli> (duration).count();
+      }
+    );
+
+  clock::time_point const start (clock::now());
+
   MPQFile theFile(filename);
 
+  clock::time_point const file_read (clock::now());
+
   Log << "Opening tile " << index.x << ", " << index.z << " (\"" << filename << "\") from " << (theFile.isExternal() ? "disk" : "MPQ") << "." << std::endl;
 
   // - Parsing the file itself. --------------------------
 
   // We store this data to load it at the end.
+  // The instances are used straight from the file's buffer.
   uint32_t lMCNKOffsets[256];
-  std::vector<ENTRY_MDDF> lModelInstances;
-  std::vector<ENTRY_MODF> lWMOInstances;
+  boost::iterator_range<ENTRY_MDDF const*> lModelInstances;
+  boost::iterator_range<ENTRY_MODF const*> lWMOInstances;
 
   uint32_t fourcc;
   uint32_t size;
@@ -175,10 +199,7 @@ void MapTile::finishLoading()
     assert(fourcc == 'MDDF');
 
     ENTRY_MDDF const* mddf_ptr = reinterpret_cast<ENTRY_MDDF const*>(theFile.getPointer());
-    for (unsigned int i = 0; i < size / sizeof(ENTRY_MDDF); ++i)
-    {
-      lModelInstances.push_back(mddf_ptr[i]);
-    }
+    lModelInstances = boost::make_iterator_range (mddf_ptr, mddf_ptr + size / sizeof(ENTRY_MDDF));
 
     // - MODF ----------------------------------------------
 
@@ -189,10 +210,7 @@ void MapTile::finishLoading()
     assert(fourcc == 'MODF');
 
     ENTRY_MODF const* modf_ptr = reinterpret_cast<ENTRY_MODF const*>(theFile.getPointer());
-    for (unsigned int i = 0; i < size / sizeof(ENTRY_MODF); ++i)
-    {
-      lWMOInstances.push_back(modf_ptr[i]);
-    }
+    lWMOInstances = boost::make_iterator_range (modf_ptr, modf_ptr + size / sizeof(ENTRY_MODF));
   }
 
   // - MISC ----------------------------------------------
@@ -296,19 +314,32 @@ void MapTile::finishLoading()
     _world->need_model_updates = true;
   }
 
+  clock::time_point const header_parsed (clock::now());
+
   // - Load chunks ---------------------------------------
 
-  for (int nextChunk = 0; nextChunk < 256; ++nextChunk)
-  {
-    theFile.seek(lMCNKOffsets[nextChunk]);
-    mChunks[nextChunk / 16][nextChunk % 16] = std::make_unique<MapChunk> (this, &theFile, mBigAlpha, _mode);
-  }
+  // chunks only touch their own data and the file's content, each one
+  // reads through its own view of the file
+  noggit::thread_pool::instance().parallel_for
+    ( 256
+    , [&] (std::size_t nextChunk)
+      {
+        MPQFile chunk_file (theFile, lMCNKOffsets[nextChunk]);
+        mChunks[nextChunk / 16][nextChunk % 16] = std::make_unique<MapChunk> (this, &chunk_file, mBigAlpha, _mode);
+      }
+    );
 
   theFile.close();
 
+  clock::time_point const chunks_decoded (clock::now());
+
   // - Really done. --------------------------------------
 
-  LogDebug << "Done loading tile " << index.x << "," << index.z << "." << std::endl;
+  LogDebug << "Done loading tile " << index.x << "," << index.z << " in "
+           << milliseconds (chunks_decoded - start) << " ms (file: "
+           << milliseconds (file_read - start) << " ms, header: "
+           << milliseconds (header_parsed - file_read) << " ms, chunks: "
+           << milliseconds (chunks_decoded - header_parsed) << " ms)." << std::endl;
   finished = true;
   _tile_is_being_reloaded = false;
   _state_changed.notify_all();
@@ -390,13 +421,18 @@ void MapTile::intersect (math::ray const& ray, selection_result* results) const
     return;
   }
 
-  for (size_t j (0); j < 16; ++j)
-  {
-    for (size_t i (0); i < 16; ++i)
-    {
-      mChunks[j][i]->intersect (ray, results);
-    }
-  }
+  // front to back, the first chunk hit has the closest hit
+  math::traverse_grid
+    ( ray
+    , {xbase, std::numeric_limits<float>::lowest(), zbase}
+    , {xbase + TILESIZE, std::numeric_limits<float>::max(), zbase + TILESIZE}
+    , 16
+    , 16
+    , [&] (int x, int z)
+      {
+        return mChunks[z][x]->intersect (ray, results);
+      }
+    );
 }
 
 
@@ -494,9 +530,16 @@ std::vector<MapChunk*> MapTile::chunks_in_range (math::vector_3d const& pos, flo
 {
   std::vector<MapChunk*> chunks;
 
-  for (size_t ty (0); ty < 16; ++ty)
+  auto const chunk_at
+    ( [] (float offset)
+      {
+        return static_cast<std::size_t> (std::max (0.f, std::min (15.f, std::floor (offset / CHUNKSIZE))));
+      }
+    );
+
+  for (size_t ty (chunk_at (pos.z - radius - zbase)); ty <= chunk_at (pos.z + radius - zbase); ++ty)
   {
-    for (size_t tx (0); tx < 16; ++tx)
+    for (size_t tx (chunk_at (pos.x - radius - xbase)); tx <= chunk_at (pos.x + radius - xbase); ++tx)
     {
       if (misc::getShortestDist (pos.x, pos.z, mChunks[ty][tx]->xbase, mChunks[ty][tx]->zbase, CHUNKSIZE) <= radius)
       {
@@ -520,6 +563,18 @@ bool MapTile::GetVertex(float x, float z, math::vector_3d *V)
 /// --- Only saving related below this line. --------------------------
 
 void MapTile::saveTile(World* world)
+{
+  std::vector<char> const content (serialize(world));
+
+  if (!content.empty())
+  {
+    MPQFile f(filename);
+    f.setBuffer(content);
+    f.SaveFile();
+  }
+}
+
+std::vector<char> MapTile::serialize(World* world)
 {
   Log << "Saving ADT \"" << filename << "\"." << std::endl;
 
@@ -616,8 +671,61 @@ void MapTile::saveTile(World* world)
   for (auto& texture : lTextures)
     texture.second = lID++;
 
+  if(world->mapIndex.sort_models_by_size_class())
+  {
+    std::sort(lModelInstances.begin(), lModelInstances.end(), [](ModelInstance const& m1, ModelInstance const& m2)
+    {
+      return m1.size_cat > m2.size_cat;
+    });
+  }
+
+  // Gather everything needed to know the size of the file up front, so
+  // that it's written in one go without growing the buffer.
+  std::vector<MapChunk::save_data> lChunksData;
+  lChunksData.reserve(256);
+
+  for (int y = 0; y < 16; ++y)
+  {
+    for (int x = 0; x < 16; ++x)
+    {
+      lChunksData.emplace_back(mChunks[y][x]->prepare_save(lObjectInstances, lModelInstances));
+    }
+  }
+
+  auto const strings_size
+  (
+    [] (auto const& names)
+    {
+      std::size_t size = 0;
+      for (auto const& name : names)
+      {
+        size += name.first.size() + 1;
+      }
+      return size;
+    }
+  );
+
+  std::size_t lFileSize = 8 + 0x4                                          // MVER
+                        + 8 + 0x40                                         // MHDR
+                        + 8 + 256 * 0x10                                   // MCIN
+                        + 8 + strings_size(lTextures)                      // MTEX
+                        + 8 + strings_size(lModels)                        // MMDX
+                        + 8 + 4 * lModels.size()                           // MMID
+                        + 8 + strings_size(lObjects)                       // MWMO
+                        + 8 + 4 * lObjects.size()                          // MWID
+                        + 8 + 0x24 * lModelInstances.size()                // MDDF
+                        + 8 + 0x40 * lObjectInstances.size()               // MODF
+                        + Water.max_save_size()                            // MH2O
+                        + ((mFlags & 1) ? 8 + sizeof(int16_t) * 9 * 2 : 0); // MFBO
+
+  for (auto const& chunk_data : lChunksData)
+  {
+    lFileSize += chunk_data.size;
+  }
+
   // Now write the file.
   sExtendableArray lADTFile;
+  lADTFile.Reserve(lFileSize);
 
   int lCurrentPosition = 0;
 
@@ -745,14 +853,6 @@ void MapTile::saveTile(World* world)
   // MDDF data
   ENTRY_MDDF* lMDDF_Data = lADTFile.GetPointer<ENTRY_MDDF>(lCurrentPosition + 8);
 
-  if(world->mapIndex.sort_models_by_size_class())
-  {
-    std::sort(lModelInstances.begin(), lModelInstances.end(), [](ModelInstance const& m1, ModelInstance const& m2)
-    {
-      return m1.size_cat > m2.size_cat;
-    });
-  }
-
   lID = 0;
   for (auto const& model : lModelInstances)
   {
@@ -760,7 +860,7 @@ void MapTile::saveTile(World* world)
     if (filename_to_offset_and_name == lModels.end())
     {
       LogError << "There is a problem with saving the doodads. We have a doodad that somehow changed the name during the saving function. However this got produced, you can get a reward from schlumpf by pasting him this line." << std::endl;
-      return;
+      return {};
     }
 
     lMDDF_Data[lID].nameID = filename_to_offset_and_name->second.nameID;
@@ -796,7 +896,7 @@ void MapTile::saveTile(World* world)
     if (filename_to_offset_and_name == lObjects.end())
     {
       LogError << "There is a problem with saving the objects. We have an object that somehow changed the name during the saving function. However this got produced, you can get a reward from schlumpf by pasting him this line." << std::endl;
-      return;
+      return {};
     }
 
     lMODF_Data[lID].nameID = filename_to_offset_and_name->second.nameID;
@@ -835,7 +935,7 @@ void MapTile::saveTile(World* world)
   {
     for (int x = 0; x < 16; ++x)
     {
-      mChunks[y][x]->save(lADTFile, lCurrentPosition, lMCIN_Position, lTextures, lObjectInstances, lModelInstances);
+      mChunks[y][x]->save(lADTFile, lCurrentPosition, lMCIN_Position, lTextures, lChunksData[y * 16 + x]);
     }
   }
 
@@ -883,16 +983,7 @@ void MapTile::saveTile(World* world)
 
   lADTFile.Extend(lCurrentPosition - lADTFile.data.size()); // cleaning unused nulls at the end of file
 
-
-  {
-    MPQFile f(filename);
-    f.setBuffer(lADTFile.data);
-    f.SaveFile();
-  }
-
-  lObjectInstances.clear();
-  lModelInstances.clear();
-  lModels.clear();
+  return std::move(lADTFile.data);
 }
 
 
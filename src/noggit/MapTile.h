@@ -102,13 +102,28 @@ public:
   bool GetVertex(float x, float z, math::vector_3d *V);
 
   void saveTile(World*);
+  //! the tile's content as written by saveTile(), empty if it can't be
+  //! saved. Tiles can be serialized concurrently.
+  std::vector<char> serialize(World*);
 	void CropWater();
 
   bool isTile(int pX, int pZ);
 
   virtual async_priority loading_priority() const
   {
-    return async_priority::high;
+    return _loading_priority;
+  }
+
+  //! only has an effect when set before queueing or when followed by
+  //! AsyncLoader::reprioritize()
+  void set_loading_priority (async_priority priority)
+  {
+    _loading_priority = priority;
+  }
+
+  virtual boost::optional<math::vector_3d> loading_position() const
+  {
+    return math::vector_3d (xbase + TILESIZE / 2.f, 0.f, zbase + TILESIZE / 2.f);
   }
 
   bool has_model(uint32_t uid) const
@@ -125,6 +140,7 @@ public:
 
 private:
   tile_mode _mode;
+  async_priority _loading_priority = async_priority::high;
   bool _tile_is_being_reloaded;
 
   // MFBO:
@@ -11,6 +11,7 @@
 #include <noggit/TextureManager.h> // TextureManager, Texture
 #include <noggit/WMOInstance.h> // WMOInstance
 #include <noggit/World.h>
+#include <noggit/alpha_edit_pool.hpp>
 #include <noggit/map_index.hpp>
 #include <noggit/uid_storage.hpp>
 #include <noggit/ui/CurrentTexture.h>
@@ -52,6 +53,7 @@
 #include <QWidgetAction>
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdlib>
 #include <fstream>
@@ -518,6 +520,29 @@ void MapView::createGUI()
   file_menu->addSeparator();
 
 
+  ADD_ACTION ( edit_menu
+             , "Undo"
+             , QKeySequence::Undo
+             , [this]
+               {
+                 makeCurrent();
+                 opengl::context::scoped_setter const _ (::gl, context());
+                 _world->undo();
+                 _rotation_editor_need_update = true;
+               }
+             );
+  ADD_ACTION ( edit_menu
+             , "Redo"
+             , QKeySequence::Redo
+             , [this]
+               {
+                 makeCurrent();
+                 opengl::context::scoped_setter const _ (::gl, context());
+                 _world->redo();
+                 _rotation_editor_need_update = true;
+               }
+             );
+
   edit_menu->addSeparator();
   edit_menu->addAction(createTextSeparator("Selected object"));
   edit_menu->addSeparator();
@@ -1588,7 +1613,34 @@ void MapView::tick (float dt)
 
   // start unloading tiles
   _world->mapIndex.enterTile (tile_index (_camera.position));
+
+  // teleports aren't movements to predict
+  if ( _camera_position_last_tick && dt > 0.f
+     && (_camera.position - *_camera_position_last_tick).length() < TILESIZE
+     )
+  {
+    _world->mapIndex.prefetch_tiles
+      (_camera.position, (_camera.position - *_camera_position_last_tick) / dt);
+  }
+  _camera_position_last_tick = _camera.position;
+
+  if (_tiles_being_written)
+  {
+    std::size_t const pending (_world->mapIndex.tiles_being_written());
+
+    if (pending != _tiles_being_written)
+    {
+      _tiles_being_written = pending;
+      show_save_progress();
+    }
+  }
+
   _world->mapIndex.unloadTiles (tile_index (_camera.position));
+  AsyncLoader::instance().prioritize_around (_camera.position);
+
+  // chunks no longer painted on write their alphamaps back and release
+  // the memory used while editing them
+  noggit::alpha_edit_pool::instance().compact (std::chrono::seconds (10));
 
   dt = std::min(dt, 1.0f);
 
@@ -2058,9 +2110,17 @@ void MapView::tick (float dt)
                         )
       / qreal (_last_frame_durations.size())
       );
-    _status_fps->setText ( "FPS: " + QString::number (int (1. / avg_frame_duration)) 
-                         + " - Average frame time: " + QString::number(avg_frame_duration*1000.0) + "ms"
-                         );
+    QString status_fps ( "FPS: " + QString::number (int (1. / avg_frame_duration)) 
+                       + " - Average frame time: " + QString::number(avg_frame_duration*1000.0) + "ms"
+                       );
+
+    std::size_t const alpha_edit_bytes (noggit::alpha_edit_pool::instance().resident_bytes());
+    if (alpha_edit_bytes)
+    {
+      status_fps += " - Texture edits: " + QString::number (alpha_edit_bytes / 1024) + " KiB";
+    }
+
+    _status_fps->setText (status_fps);
 
     _last_frame_durations.clear();
     _last_fps_update = 0.f;
@@ -2810,6 +2870,12 @@ void MapView::mousePressEvent(QMouseEvent* event)
   {
     look = true;
   }
+
+  // everything done while a button is held is undone at once
+  if (leftMouse || MoveObj)
+  {
+    _world->begin_action();
+  }
 }
 
 void MapView::wheelEvent (QWheelEvent* event)
@@ -2919,6 +2985,23 @@ void MapView::mouseReleaseEvent (QMouseEvent* event)
     MoveObj = false;
     break;
   }
+
+  if (!leftMouse && !MoveObj)
+  {
+    _world->end_action();
+  }
+}
+
+void MapView::show_save_progress()
+{
+  if (_tiles_being_written)
+  {
+    _main_window->statusBar()->showMessage(QString("Saving map, %1 tile(s) left to write...").arg(_tiles_being_written));
+  }
+  else
+  {
+    _main_window->statusBar()->showMessage("Map saved", 2000);
+  }
 }
 
 void MapView::save(save_mode mode)
@@ -2996,8 +3079,9 @@ void MapView::save(save_mode mode)
 
     AsyncLoader::instance().reset_object_fail();
 
-
-    _main_window->statusBar()->showMessage("Map saved", 2000);
+    // the files are written in the background, see tick()
+    _tiles_being_written = _world->mapIndex.tiles_being_written();
+    show_save_progress();
 
   }
   else
@@ -78,6 +78,10 @@ private:
 
   noggit::camera _camera;
   bool _camera_moved_since_last_draw = true;
+  boost::optional<math::vector_3d> _camera_position_last_tick;
+
+  std::size_t _tiles_being_written = 0;
+  void show_save_progress();
 
   noggit::bool_toggle_property _draw_contour = {false};
   noggit::bool_toggle_property _draw_mfbo = {false};
@@ -7,6 +7,7 @@
 
 #include <iomanip>
 #include <map>
+#include <random>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -26,7 +27,10 @@ namespace misc
 
   float frand()
   {
-    return rand() / static_cast<float>(RAND_MAX);
+    // rand() isn't required to be thread safe, but particles are spawned
+    // from several threads at once
+    thread_local std::minstd_rand engine (std::random_device{}());
+    return std::uniform_real_distribution<float> (0.0f, 1.0f) (engine);
   }
 
   float randfloat(float lower, float upper)
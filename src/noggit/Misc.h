@@ -117,6 +117,13 @@ public:
     data.resize (pSize);
 	}
 
+  //! inserting at the end and extending stay within the reserved size
+  //! without reallocating
+  void Reserve (unsigned long pSize)
+  {
+    data.reserve (pSize);
+  }
+
 	void Extend (long pAddition)
 	{
     data.resize (data.size() + pAddition);
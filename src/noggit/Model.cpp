@@ -7,11 +7,13 @@
 #include <noggit/ModelInstance.h>
 #include <noggit/TextureManager.h> // TextureManager, Texture
 #include <noggit/World.h>
+#include <noggit/thread_pool.hpp>
 #include <opengl/scoped.hpp>
 #include <opengl/shader.hpp>
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <map>
 #include <sstream>
 #include <string>
@@ -23,6 +25,14 @@ Model::Model(const std::string& filename)
   memset(&header, 0, sizeof(ModelHeader));
 }
 
+Model::~Model()
+{
+  if (_skinning.valid())
+  {
+    _skinning.wait();
+  }
+}
+
 void Model::finishLoading()
 {
   MPQFile f(filename);
@@ -196,6 +206,18 @@ void Model::initCommon(const MPQFile& f)
   {
     _current_vertices.swap(_vertices);
   }
+  else
+  {
+    // drawn in bind pose until the first skinning is done
+    _current_vertices = _vertices;
+    _skinning_staging = _vertices;
+
+    _skinned_vertices.reserve (_vertices.size());
+    for (auto const& v : _vertices)
+    {
+      _skinned_vertices.push_back (v.position, v.normal, v.bones, v.weights);
+    }
+  }
 
   // textures
   ModelTextureDef const* texdef = reinterpret_cast<ModelTextureDef const*>(f.getBuffer() + header.ofsTextures);
@@ -1014,6 +1036,43 @@ void Model::initAnimated(const MPQFile& f)
     {
       bones.emplace_back(f, mb[i], _global_sequences.data(), animation_files);
     }
+
+    for (auto& bone : bones)
+    {
+      if (bone.parent >= static_cast<int> (bones.size()))
+      {
+        LogError << "Bone with invalid parent " << bone.parent << " in '" << filename << "'" << std::endl;
+        bone.parent = -1;
+      }
+    }
+
+    std::vector<bool> ordered (bones.size(), false);
+    std::vector<std::size_t> ancestors;
+    _bone_order.reserve (bones.size());
+
+    for (std::size_t i = 0; i < bones.size(); ++i)
+    {
+      // walk up to the first ancestor already ordered, the length limit
+      // breaks cyclic hierarchies
+      for ( int bone = static_cast<int> (i)
+          ; bone >= 0 && !ordered[bone] && ancestors.size() < bones.size()
+          ; bone = bones[bone].parent
+          )
+      {
+        ancestors.push_back (bone);
+      }
+
+      for (auto it = ancestors.rbegin(); it != ancestors.rend(); ++it)
+      {
+        if (!ordered[*it])
+        {
+          ordered[*it] = true;
+          _bone_order.push_back (*it);
+        }
+      }
+
+      ancestors.clear();
+    }
   }  
 
   if (animTextures) 
@@ -1062,17 +1121,20 @@ void Model::initAnimated(const MPQFile& f)
   animcalc = false;
 }
 
+namespace
+{
+  //! animation time steps (in ms) smaller than this don't recalculate the pose
+  int const pose_time_resolution = 8;
+}
+
 void Model::calcBones( math::matrix_4x4 const& model_view
                      , int _anim
                      , int time
                      , int animation_time
                      )
 {
-  for (size_t i = 0; i<header.nBones; ++i) {
-    bones[i].calc = false;
-  }
-
-  for (size_t i = 0; i<header.nBones; ++i) {
+  for (std::size_t i : _bone_order)
+  {
     bones[i].calcMatrix(model_view, bones.data(), _anim, time, animation_time);
   }
 }
@@ -1081,15 +1143,7 @@ void Model::animate(math::matrix_4x4 const& model_view, int anim_id, int anim_ti
 {
   if (_animations_seq_per_id.empty() || _animations_seq_per_id[anim_id].empty())
   {
-    // use "default" vertices if the animation hasn't been found
-    if (_current_vertices.empty())
-    {
-      _current_vertices = _vertices;
-
-      opengl::scoped::buffer_binder<GL_ARRAY_BUFFER> const binder(_vertices_buffer);
-      gl.bufferData(GL_ARRAY_BUFFER, _current_vertices.size() * sizeof(ModelVertex), _current_vertices.data(), GL_STATIC_DRAW);
-    }
-
+    // the "default" vertices uploaded by upload() are used if the animation hasn't been found
     return;
   }
 
@@ -1115,49 +1169,100 @@ void Model::animate(math::matrix_4x4 const& model_view, int anim_id, int anim_ti
   _anim_time = t;
   _global_animtime = anim_time;
 
-  if (animBones) 
+  int const pose_time = t - t % pose_time_resolution;
+  int const pose_animtime = anim_time - anim_time % pose_time_resolution;
+
+  if ( _current_pose
+    && _current_pose->anim == _current_anim_seq
+    && _current_pose->time == pose_time
+    && _current_pose->animtime == pose_animtime
+    && (!_per_instance_animation || _current_pose->model_view == model_view)
+     )
   {
-    calcBones(model_view, _current_anim_seq, t, _global_animtime);
+    update_skinning();
+    animate_effects (t, tmax);
+    return;
   }
 
-  if (animGeometry) 
+  _current_pose = pose {_current_anim_seq, pose_time, pose_animtime, model_view};
+
+  if (animBones) 
   {
-    // transform vertices
-    _current_vertices = _vertices;
+    calcBones(model_view, _current_anim_seq, pose_time, pose_animtime);
+  }
 
-    for (auto& vertex : _current_vertices)
+  _skinning_requested = animGeometry;
+  update_skinning();
+
+  for (size_t i=0; i<header.nLights; ++i) 
+  {
+    if (_lights[i].parent >= 0) 
     {
-      ::math::vector_3d v(0, 0, 0), n(0, 0, 0);
+      _lights[i].tpos = bones[_lights[i].parent].mat * _lights[i].pos;
+      _lights[i].tdir = bones[_lights[i].parent].mrot * _lights[i].dir;
+    }
+  }
 
-      for (size_t b (0); b < 4; ++b)
-      {
-        if (vertex.weights[b] <= 0)
-          continue;
+  animate_effects (t, tmax);
+}
 
-        ::math::vector_3d tv = bones[vertex.bones[b]].mat * vertex.position;
-        ::math::vector_3d tn = bones[vertex.bones[b]].mrot * vertex.normal;
+void Model::skin_vertices()
+{
+  std::size_t const vertices_per_part (2048);
+  std::size_t const count (_skinned_vertices.size());
 
-        v += tv * (static_cast<float> (vertex.weights[b]) / 255.0f);
-        n += tn * (static_cast<float> (vertex.weights[b]) / 255.0f);
+  noggit::thread_pool::instance().parallel_for
+    ( (count + vertices_per_part - 1) / vertices_per_part
+    , [&] (std::size_t part)
+      {
+        math::skin ( _skinned_vertices
+                   , part * vertices_per_part
+                   , std::min (count, (part + 1) * vertices_per_part)
+                   , _skinning_transforms.data()
+                   , _skinning_normal_transforms.data()
+                   , &_skinning_staging[0].position
+                   , &_skinning_staging[0].normal
+                   , sizeof (ModelVertex)
+                   );
       }
+    );
+}
 
-      vertex.position = v;
-      vertex.normal = n.normalized();
+void Model::update_skinning()
+{
+  if (_skinning.valid())
+  {
+    if (_skinning.wait_for (std::chrono::seconds (0)) != std::future_status::ready)
+    {
+      return;
     }
 
+    _skinning.get();
+    _current_vertices.swap (_skinning_staging);
+
     opengl::scoped::buffer_binder<GL_ARRAY_BUFFER> const binder (_vertices_buffer);
     gl.bufferData (GL_ARRAY_BUFFER, _current_vertices.size() * sizeof (ModelVertex), _current_vertices.data(), GL_STREAM_DRAW);
   }
 
-  for (size_t i=0; i<header.nLights; ++i) 
+  if (_skinning_requested)
   {
-    if (_lights[i].parent >= 0) 
+    _skinning_requested = false;
+
+    // the job works on a copy, the bones are recalculated for the next pose meanwhile
+    _skinning_transforms.clear();
+    _skinning_normal_transforms.clear();
+    for (Bone const& bone : bones)
     {
-      _lights[i].tpos = bones[_lights[i].parent].mat * _lights[i].pos;
-      _lights[i].tdir = bones[_lights[i].parent].mrot * _lights[i].dir;
+      _skinning_transforms.push_back (bone.mat);
+      _skinning_normal_transforms.push_back (bone.mrot);
     }
+
+    _skinning = noggit::thread_pool::instance().async ([this] { skin_vertices(); });
   }
+}
 
+void Model::animate_effects (int t, int tmax)
+{
   for (auto& particle : _particles)
   {
     // random time distribution for teh win ..?
@@ -1267,14 +1372,12 @@ Bone::Bone( const MPQFile& f,
 }
 
 void Bone::calcMatrix( math::matrix_4x4 const& model_view
-                     , Bone *allbones
+                     , Bone const* allbones
                      , int anim
                      , int time
                      , int animtime
                      )
 {
-  if (calc) return;
-
   math::matrix_4x4 m {math::matrix_4x4::unit};
   math::quaternion q;
 
@@ -1285,22 +1388,15 @@ void Bone::calcMatrix( math::matrix_4x4 const& model_view
     || flags.cylindrical_billboard_lock_z
       )
   {
-    m = {math::matrix_4x4::translation, pivot};
-
-    if (trans.uses(anim))
-    {
-      m *= math::matrix_4x4 (math::matrix_4x4::translation, trans.getValue (anim, time, animtime));
-    }
-
-    if (rot.uses(anim))
+    // pivot * translation * rotation * scale * -pivot, in one go
+    math::vector_3d const tr (trans.uses (anim) ? trans.getValue (anim, time, animtime) : math::vector_3d (0.f, 0.f, 0.f));
+    if (rot.uses (anim))
     {
-      m *= math::matrix_4x4 (math::matrix_4x4::rotation, q = rot.getValue (anim, time, animtime));
+      q = rot.getValue (anim, time, animtime);
     }
+    math::vector_3d const sc (scale.uses (anim) ? scale.getValue (anim, time, animtime) : math::vector_3d (1.f, 1.f, 1.f));
 
-    if (scale.uses(anim))
-    {
-      m *= math::matrix_4x4 (math::matrix_4x4::scale, scale.getValue (anim, time, animtime));
-    }
+    m = {math::matrix_4x4::translation_rotation_scale, pivot + tr, q, sc};
 
     if (flags.billboard)
     {
@@ -1316,12 +1412,14 @@ void Bone::calcMatrix( math::matrix_4x4 const& model_view
       m (2, 1, vUp.z);
     }
 
-    m *= math::matrix_4x4 (math::matrix_4x4::translation, -pivot);
+    for (std::size_t j (0); j < 3; ++j)
+    {
+      m (j, 3, m (j, 3) - m (j, 0) * pivot.x - m (j, 1) * pivot.y - m (j, 2) * pivot.z);
+    }
   }
 
   if (parent >= 0)
   {
-    allbones[parent].calcMatrix (model_view, allbones, anim, time, animtime);
     mat = allbones[parent].mat * m;
   }
   else
@@ -1345,8 +1443,6 @@ void Bone::calcMatrix( math::matrix_4x4 const& model_view
   {
     mrot = math::matrix_4x4::unit;
   }
-
-  calc = true;
 }
 
 void Model::draw( math::matrix_4x4 const& model_view
@@ -1411,7 +1507,8 @@ void Model::draw( math::matrix_4x4 const& model_view
 }
 
 void Model::draw ( math::matrix_4x4 const& model_view
-                 , std::vector<ModelInstance*> instances
+                 , std::vector<ModelInstance*> const& instances
+                 , noggit::model_instance_culling& culling
                  , opengl::scoped::use_program& m2_shader
                  , math::frustum const& frustum
                  , const float& cull_distance
@@ -1441,15 +1538,9 @@ void Model::draw ( math::matrix_4x4 const& model_view
     animcalc = true;
   }
 
-  std::vector<math::matrix_4x4> transform_matrix;
-
-  for (ModelInstance* mi : instances)
-  {
-    if (mi->is_visible(frustum, cull_distance, camera, display))
-    {
-      transform_matrix.push_back(mi->transform_matrix_transposed());
-    }    
-  }
+  culling.update(*this, instances);
+  std::vector<math::matrix_4x4> const& transform_matrix
+    (culling.cull(frustum, cull_distance, camera, display));
 
   if (transform_matrix.empty())
   {
@@ -1610,7 +1701,6 @@ void Model::upload()
   _buffers.upload();
   _vertex_arrays.upload();
 
-  if (!animGeometry)
   {
     opengl::scoped::buffer_binder<GL_ARRAY_BUFFER> const binder (_vertices_buffer);
     gl.bufferData (GL_ARRAY_BUFFER, _current_vertices.size() * sizeof (ModelVertex), _current_vertices.data(), GL_STATIC_DRAW);
@@ -6,6 +6,7 @@
 #include <math/matrix_4x4.hpp>
 #include <math/quaternion.hpp>
 #include <math/ray.hpp>
+#include <math/skinning.hpp>
 #include <math/vector_3d.hpp>
 #include <noggit/Animated.h> // Animation::M2Value
 #include <noggit/AsyncObject.h> // AsyncObject
@@ -13,10 +14,14 @@
 #include <noggit/ModelHeaders.h>
 #include <noggit/Particle.h>
 #include <noggit/TextureManager.h>
+#include <noggit/model_instance_culling.hpp>
 #include <noggit/tool_enums.hpp>
 #include <opengl/scoped.hpp>
 #include <opengl/shader.fwd.hpp>
 
+#include <atomic>
+#include <future>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -56,9 +61,9 @@ public:
   math::matrix_4x4 mat = math::matrix_4x4::uninitialized;
   math::matrix_4x4 mrot = math::matrix_4x4::uninitialized;
 
-  bool calc;
+  //! \note the parent's matrices have to be calculated already
   void calcMatrix( math::matrix_4x4 const& model_view
-                 , Bone* allbones
+                 , Bone const* allbones
                  , int anim
                  , int time
                  , int animtime
@@ -212,6 +217,7 @@ public:
   }
 
   Model(const std::string& name);
+  ~Model();
 
   void draw( math::matrix_4x4 const& model_view
            , ModelInstance& instance
@@ -225,7 +231,8 @@ public:
            , display_mode display
            );
   void draw ( math::matrix_4x4 const& model_view
-            , std::vector<ModelInstance*> instances
+            , std::vector<ModelInstance*> const& instances
+            , noggit::model_instance_culling& culling
             , opengl::scoped::use_program& m2_shader
             , math::frustum const& frustum
             , const float& cull_distance
@@ -291,6 +298,10 @@ public:
   float trans;
   bool animcalc;  
 
+  //! incremented whenever an instance of this model recalculated its
+  //! extents, to invalidate noggit::model_instance_culling
+  std::atomic<std::size_t> instances_generation {0};
+
 private:
   bool _per_instance_animation;
   int _current_anim_seq;
@@ -306,6 +317,8 @@ private:
   void compute_pixel_shader_ids();
 
   void animate(math::matrix_4x4 const& model_view, int anim_id, int anim_time);
+  //! particles, ribbons and texture animations, which don't depend on the pose
+  void animate_effects(int t, int tmax);
   void calcBones(math::matrix_4x4 const& model_view, int anim, int time, int animation_time);
 
   void lightsOn(opengl::light lbase);
@@ -335,6 +348,19 @@ private:
   std::vector<ModelVertex> _vertices;
   std::vector<ModelVertex> _current_vertices;
 
+  //! Animated geometry is skinned in the background into the staging
+  //! buffer, which is swapped with _current_vertices once done, so the
+  //! upload never waits for it.
+  math::skinned_vertices _skinned_vertices;
+  std::vector<ModelVertex> _skinning_staging;
+  std::vector<math::matrix_4x4> _skinning_transforms;
+  std::vector<math::matrix_4x4> _skinning_normal_transforms;
+  std::future<void> _skinning;
+  bool _skinning_requested = false;
+
+  void skin_vertices();
+  void update_skinning();
+
   std::vector<uint16_t> _indices;
 
   std::vector<ModelRenderPass> _render_passes;
@@ -346,6 +372,21 @@ private:
   bool animated;
   bool animGeometry, animTextures, animBones;
 
+  //! bone indices, every parent before its children
+  std::vector<std::size_t> _bone_order;
+
+  //! what the bones and animated vertices were last calculated for.
+  //! Instances drawn with the same pose share the result.
+  struct pose
+  {
+    int anim;
+    int time;
+    int animtime;
+    //! only relevant for billboarded bones
+    math::matrix_4x4 model_view;
+  };
+  boost::optional<pose> _current_pose;
+
   //      <anim_id, <sub_anim_id, animation>
   std::map<uint16_t, std::map<uint16_t, ModelAnimation>> _animations_seq_per_id;
   std::map<int16_t, uint32_t> _animation_length;
@@ -195,6 +195,7 @@ void ModelInstance::recalcExtents()
   {
     _extents[0] = _extents[1] = pos;
     _need_recalc_extents = false;
+    ++model->instances_generation;
     return;
   }
 
@@ -225,6 +226,7 @@ void ModelInstance::recalcExtents()
   size_cat = (bounding_of_rotated_points.max - bounding_of_rotated_points.min).length();
 
   _need_recalc_extents = false;
+  ++model->instances_generation;
 }
 
 
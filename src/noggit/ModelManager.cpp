@@ -4,8 +4,10 @@
 #include <noggit/Log.h> // LogDebug
 #include <noggit/Model.h> // Model
 #include <noggit/ModelManager.h> // ModelManager
+#include <noggit/thread_pool.hpp>
 
 #include <algorithm>
+#include <vector>
 
 namespace
 {
@@ -51,11 +53,21 @@ void ModelManager::resetAnim()
 
 void ModelManager::updateEmitters(float dt)
 {
+  std::vector<Model*> models;
   _.apply ( [&] (std::string const&, Model& model)
             {
-              model.updateEmitters (dt);
+              models.push_back (&model);
             }
           );
+
+  // the emitters of different models are independent
+  noggit::thread_pool::instance().parallel_for
+    ( models.size()
+    , [&] (std::size_t i)
+      {
+        models[i]->updateEmitters (dt);
+      }
+    );
 }
 
 void ModelManager::clear_hidden_models()
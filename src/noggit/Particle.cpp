@@ -9,11 +9,88 @@
 
 static const unsigned int MAX_PARTICLES = 10000;
 
-template<class T>
-T lifeRamp(float life, float mid, const T &a, const T &b, const T &c)
+namespace
+{
+  //! out[i] = a -> b -> c over the relative lifetime of particle i, without
+  //! branches so it vectorizes
+  void lifeRamp ( float const* life
+                , float const* maxlife
+                , std::size_t count
+                , float mid
+                , float a
+                , float b
+                , float c
+                , float* out
+                )
+  {
+    float const to_first_half (1.0f / mid);
+    float const to_second_half (1.0f / (1.0f - mid));
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      float const rlife (life[i] / maxlife[i]);
+      bool const first_half (rlife <= mid);
+      float const percentage (first_half ? rlife * to_first_half : (rlife - mid) * to_second_half);
+      float const start (first_half ? a : b);
+      float const end (first_half ? b : c);
+      out[i] = start * (1.0f - percentage) + end * percentage;
+    }
+  }
+}
+
+template<typename Fun>
+  void particle_pool::for_each_array (Fun&& fun)
+{
+  for (auto* array : { &pos_x, &pos_y, &pos_z
+                     , &speed_x, &speed_y, &speed_z
+                     , &down_x, &down_y, &down_z
+                     , &dir_x, &dir_y, &dir_z
+                     , &life, &maxlife, &particle_size
+                     , &color_r, &color_g, &color_b, &color_a
+                     }
+      )
+  {
+    fun (*array);
+  }
+  fun (origin);
+  fun (corners);
+  fun (tile);
+}
+
+void particle_pool::push_back (Particle const& p)
+{
+  pos_x.push_back (p.pos.x);
+  pos_y.push_back (p.pos.y);
+  pos_z.push_back (p.pos.z);
+  speed_x.push_back (p.speed.x);
+  speed_y.push_back (p.speed.y);
+  speed_z.push_back (p.speed.z);
+  down_x.push_back (p.down.x);
+  down_y.push_back (p.down.y);
+  down_z.push_back (p.down.z);
+  dir_x.push_back (p.dir.x);
+  dir_y.push_back (p.dir.y);
+  dir_z.push_back (p.dir.z);
+  life.push_back (p.life);
+  maxlife.push_back (p.maxlife);
+  particle_size.push_back (p.size);
+  color_r.push_back (p.color.x);
+  color_g.push_back (p.color.y);
+  color_b.push_back (p.color.z);
+  color_a.push_back (p.color.w);
+  origin.push_back (p.origin);
+  corners.push_back ({{p.corners[0], p.corners[1], p.corners[2], p.corners[3]}});
+  tile.push_back (p.tile);
+}
+
+void particle_pool::swap_remove (std::size_t i)
 {
-  if (life <= mid) return math::interpolation::linear(life / mid, a, b);
-  else return math::interpolation::linear((life - mid) / (1.0f - mid), b, c);
+  for_each_array ( [i] (auto& array)
+                   {
+                     array[i] = array.back();
+                     array.pop_back();
+                   }
+                 );
 }
 
 ParticleSystem::ParticleSystem(Model* model_, const MPQFile& f, const ModelParticleEmitterDef &mta, int *globals)
@@ -224,31 +301,58 @@ void ParticleSystem::update(float dt)
     }
   }
 
-  float mspeed = 1.0f;
+  std::size_t const count (particles.size());
 
-  for (ParticleList::iterator it = particles.begin(); it != particles.end();) {
-    Particle &p = *it;
-    p.speed += p.down * grav * dt - p.dir * deaccel * dt;
+  // integrate
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    particles.speed_x[i] += particles.down_x[i] * grav * dt - particles.dir_x[i] * deaccel * dt;
+    particles.speed_y[i] += particles.down_y[i] * grav * dt - particles.dir_y[i] * deaccel * dt;
+    particles.speed_z[i] += particles.down_z[i] * grav * dt - particles.dir_z[i] * deaccel * dt;
+  }
 
-    if (slowdown>0) {
-      mspeed = expf(-1.0f * slowdown * p.life);
+  if (slowdown > 0)
+  {
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      float const mspeed = expf(-1.0f * slowdown * particles.life[i]);
+      particles.pos_x[i] += particles.speed_x[i] * mspeed * dt;
+      particles.pos_y[i] += particles.speed_y[i] * mspeed * dt;
+      particles.pos_z[i] += particles.speed_z[i] * mspeed * dt;
+    }
+  }
+  else
+  {
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      particles.pos_x[i] += particles.speed_x[i] * dt;
+      particles.pos_y[i] += particles.speed_y[i] * dt;
+      particles.pos_z[i] += particles.speed_z[i] * dt;
     }
-    p.pos += p.speed * mspeed * dt;
+  }
+
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    particles.life[i] += dt;
+  }
 
-    p.life += dt;
-    float rlife = p.life / p.maxlife;
-    // calculate size and color based on lifetime
-    p.size = lifeRamp<float>(rlife, mid, sizes[0], sizes[1], sizes[2]);
-    p.color = lifeRamp<math::vector_4d>(rlife, mid, colors[0], colors[1], colors[2]);
+  // calculate size and color based on lifetime
+  lifeRamp (particles.life.data(), particles.maxlife.data(), count, mid, sizes[0], sizes[1], sizes[2], particles.particle_size.data());
+  lifeRamp (particles.life.data(), particles.maxlife.data(), count, mid, colors[0].x, colors[1].x, colors[2].x, particles.color_r.data());
+  lifeRamp (particles.life.data(), particles.maxlife.data(), count, mid, colors[0].y, colors[1].y, colors[2].y, particles.color_g.data());
+  lifeRamp (particles.life.data(), particles.maxlife.data(), count, mid, colors[0].z, colors[1].z, colors[2].z, particles.color_b.data());
+  lifeRamp (particles.life.data(), particles.maxlife.data(), count, mid, colors[0].w, colors[1].w, colors[2].w, particles.color_a.data());
 
-    // kill off old particles
-    if (rlife >= 1.0f)
+  // kill off old particles
+  for (std::size_t i = 0; i < particles.size();)
+  {
+    if (particles.life[i] / particles.maxlife[i] >= 1.0f)
     {
-      it = particles.erase (it);
+      particles.swap_remove (i);
     }
     else
     {
-      ++it;
+      ++i;
     }
   }
 }
@@ -350,62 +454,70 @@ void ParticleSystem::draw( math::matrix_4x4 const& model_view
     if (billboard) 
     {
       //! \todo per-particle rotation in a non-expensive way?? :|
-      for (ParticleList::iterator it = particles.begin(); it != particles.end(); ++it) 
+      for (std::size_t i = 0; i < particles.size(); ++i) 
       {
-        if (tiles.size() - 1 < it->tile) // Alfred, 2009.08.07, error prevent
+        if (tiles.size() - 1 < particles.tile[i]) // Alfred, 2009.08.07, error prevent
         {
           break;
         }
 
-        const float size = it->size;// / 2;
+        TexCoordSet const& tile = tiles[particles.tile[i]];
+        math::vector_3d const position = particles.position (i);
+        math::vector_4d const color = particles.color (i);
+
+        const float size = particles.particle_size[i];// / 2;
 
-        texcoords.push_back(tiles[it->tile].tc[0]);
-        vertices.push_back(it->pos);
+        texcoords.push_back(tile.tc[0]);
+        vertices.push_back(position);
         offsets.push_back(-(vRight + vUp) * size);
-        colors_data.push_back(it->color);
+        colors_data.push_back(color);
 
-        texcoords.push_back(tiles[it->tile].tc[1]);
-        vertices.push_back(it->pos);
+        texcoords.push_back(tile.tc[1]);
+        vertices.push_back(position);
         offsets.push_back((vRight - vUp) * size);
-        colors_data.push_back(it->color);
+        colors_data.push_back(color);
 
-        texcoords.push_back(tiles[it->tile].tc[2]);
-        vertices.push_back(it->pos);
+        texcoords.push_back(tile.tc[2]);
+        vertices.push_back(position);
         offsets.push_back((vRight + vUp) * size);
-        colors_data.push_back(it->color);
+        colors_data.push_back(color);
 
-        texcoords.push_back(tiles[it->tile].tc[3]);
-        vertices.push_back(it->pos);
+        texcoords.push_back(tile.tc[3]);
+        vertices.push_back(position);
         offsets.push_back(-(vRight - vUp) * size);
-        colors_data.push_back(it->color);
+        colors_data.push_back(color);
 
         add_quad_indices(indices, indice);
       }
     }
     else 
     {
-      for (ParticleList::iterator it = particles.begin(); it != particles.end(); ++it) 
+      for (std::size_t i = 0; i < particles.size(); ++i) 
       {
-        if (tiles.size() - 1 < it->tile) // Alfred, 2009.08.07, error prevent
+        if (tiles.size() - 1 < particles.tile[i]) // Alfred, 2009.08.07, error prevent
         {
           break;
         }
 
-        texcoords.push_back(tiles[it->tile].tc[0]);
-        vertices.push_back(it->pos + it->corners[0] * it->size);
-        colors_data.push_back(it->color);
+        TexCoordSet const& tile = tiles[particles.tile[i]];
+        math::vector_3d const position = particles.position (i);
+        math::vector_4d const color = particles.color (i);
 
-        texcoords.push_back(tiles[it->tile].tc[1]);
-        vertices.push_back(it->pos + it->corners[1] * it->size);
-        colors_data.push_back(it->color);
+        texcoords.push_back(tile.tc[0]);
+        vertices.push_back(position + particles.corners[i][0] * particles.particle_size[i]);
+        colors_data.push_back(color);
 
-        texcoords.push_back(tiles[it->tile].tc[2]);
-        vertices.push_back(it->pos + it->corners[2] * it->size);
-        colors_data.push_back(it->color);
+        texcoords.push_back(tile.tc[1]);
+        vertices.push_back(position + particles.corners[i][1] * particles.particle_size[i]);
+        colors_data.push_back(color);
 
-        texcoords.push_back(tiles[it->tile].tc[3]);
-        vertices.push_back(it->pos + it->corners[3] * it->size);
-        colors_data.push_back(it->color);
+        texcoords.push_back(tile.tc[2]);
+        vertices.push_back(position + particles.corners[i][2] * particles.particle_size[i]);
+        colors_data.push_back(color);
+
+        texcoords.push_back(tile.tc[3]);
+        vertices.push_back(position + particles.corners[i][3] * particles.particle_size[i]);
+        colors_data.push_back(color);
 
         add_quad_indices(indices, indice);
       }
@@ -423,28 +535,32 @@ void ParticleSystem::draw( math::matrix_4x4 const& model_view
     bv1 = mbb * math::vector_3d(1.0f,0,0);
     */
 
-    for (ParticleList::iterator it = particles.begin(); it != particles.end(); ++it) 
+    for (std::size_t i = 0; i < particles.size(); ++i) 
     {
-      if (tiles.size() - 1 < it->tile) // Alfred, 2009.08.07, error prevent
+      if (tiles.size() - 1 < particles.tile[i]) // Alfred, 2009.08.07, error prevent
       {
         break;
       }
 
-      texcoords.push_back(tiles[it->tile].tc[0]);
-      vertices.push_back(it->pos + bv0 * it->size);
-      colors_data.push_back(it->color);
+      TexCoordSet const& tile = tiles[particles.tile[i]];
+      math::vector_3d const position = particles.position (i);
+      math::vector_4d const color = particles.color (i);
+
+      texcoords.push_back(tile.tc[0]);
+      vertices.push_back(position + bv0 * particles.particle_size[i]);
+      colors_data.push_back(color);
 
-      texcoords.push_back(tiles[it->tile].tc[1]);
-      vertices.push_back(it->pos + bv1 * it->size);
-      colors_data.push_back(it->color);
+      texcoords.push_back(tile.tc[1]);
+      vertices.push_back(position + bv1 * particles.particle_size[i]);
+      colors_data.push_back(color);
 
-      texcoords.push_back(tiles[it->tile].tc[2]);
-      vertices.push_back(it->origin + bv1 * it->size);
-      colors_data.push_back(it->color);
+      texcoords.push_back(tile.tc[2]);
+      vertices.push_back(particles.origin[i] + bv1 * particles.particle_size[i]);
+      colors_data.push_back(color);
 
-      texcoords.push_back(tiles[it->tile].tc[3]);
-      vertices.push_back(it->origin + bv0 * it->size);
-      colors_data.push_back(it->color);
+      texcoords.push_back(tile.tc[3]);
+      vertices.push_back(particles.origin[i] + bv0 * particles.particle_size[i]);
+      colors_data.push_back(color);
 
       add_quad_indices(indices, indice);
     }
@@ -8,6 +8,7 @@
 #include <opengl/scoped.hpp>
 #include <opengl/shader.fwd.hpp>
 
+#include <array>
 #include <list>
 #include <memory>
 #include <vector>
@@ -26,7 +27,42 @@ struct Particle {
   math::vector_4d color;
 };
 
-typedef std::list<Particle> ParticleList;
+//! All particles of an emitter as structure of arrays, so the per frame
+//! update runs over plain float arrays. Dead particles are removed by
+//! moving the last one into their place, so the order isn't stable.
+class particle_pool
+{
+public:
+  std::size_t size() const { return life.size(); }
+  bool empty() const { return life.empty(); }
+
+  void push_back (Particle const&);
+  void swap_remove (std::size_t);
+
+  math::vector_3d position (std::size_t i) const
+  {
+    return {pos_x[i], pos_y[i], pos_z[i]};
+  }
+  math::vector_4d color (std::size_t i) const
+  {
+    return {color_r[i], color_g[i], color_b[i], color_a[i]};
+  }
+
+  std::vector<float> pos_x, pos_y, pos_z;
+  std::vector<float> speed_x, speed_y, speed_z;
+  std::vector<float> down_x, down_y, down_z;
+  std::vector<float> dir_x, dir_y, dir_z;
+  std::vector<float> life, maxlife;
+  std::vector<float> particle_size;
+  std::vector<float> color_r, color_g, color_b, color_a;
+
+  std::vector<math::vector_3d> origin;
+  std::vector<std::array<math::vector_3d, 4>> corners;
+  std::vector<unsigned int> tile;
+
+private:
+  template<typename Fun> void for_each_array (Fun&&);
+};
 
 class ParticleEmitter {
 public:
@@ -63,7 +99,7 @@ class ParticleSystem
   float mid, slowdown;
   math::vector_3d pos;
   uint16_t _texture_id;
-  ParticleList particles;
+  particle_pool particles;
   int blend, order, type;
   int manim, mtime;
   int manimtime;
@@ -107,6 +107,26 @@ void TileWater::saveToFile(sExtendableArray &lADTFile, int &lMHDR_Position, int
   SetChunkHeader(lADTFile, ofsW - 8, 'MH2O', lCurrentPosition - ofsW);
 }
 
+std::size_t TileWater::max_save_size()
+{
+  if (!hasData(0))
+  {
+    return 0;
+  }
+
+  std::size_t size = 8 + 256 * sizeof(MH2O_Header);
+
+  for (int z = 0; z < 16; ++z)
+  {
+    for (int x = 0; x < 16; ++x)
+    {
+      size += chunks[z][x]->max_save_size();
+    }
+  }
+
+  return size;
+}
+
 bool TileWater::hasData(size_t layer)
 {
   for (int z = 0; z < 16; ++z)
@@ -22,6 +22,8 @@ public:
 
   void readFromFile(MPQFile &theFile, size_t basePos);
   void saveToFile(sExtendableArray &lADTFile, int &lMHDR_Position, int &lCurrentPosition);
+  //! upper bound of what saveToFile() writes
+  std::size_t max_save_size();
 
   void draw ( math::frustum const& frustum
             , const float& cull_distance
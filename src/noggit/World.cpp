@@ -16,6 +16,7 @@
 #include <noggit/WMOInstance.h> // WMOInstance
 #include <noggit/map_index.hpp>
 #include <noggit/texture_set.hpp>
+#include <noggit/thread_pool.hpp>
 #include <noggit/tool_enums.hpp>
 #include <noggit/ui/ObjectEditor.h>
 #include <noggit/ui/TexturingGUI.h>
@@ -34,6 +35,7 @@
 #include <forward_list>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <sstream>
 #include <string>
@@ -107,6 +109,7 @@ World::World(const std::string& name, int map_id)
   , _current_selection()
   , _settings (new QSettings())
   , _view_distance(_settings->value ("view_distance", 1000.f).toFloat())
+  , _history(std::size_t (std::max (0, _settings->value ("undo_memory_mb", 128).toInt())) << 20)
 {
   LogDebug << "Loading world \"" << name << "\"." << std::endl;
 }
@@ -1000,6 +1003,20 @@ void World::draw ( math::matrix_4x4 const& model_view
     });
   }
 
+  // culling data of doodads not drawn anymore would keep pointers to
+  // released models and instances, whose addresses may be reused
+  for (auto it = _wmo_doodads_culling.begin(); it != _wmo_doodads_culling.end();)
+  {
+    if (_wmo_doodads.count(it->first))
+    {
+      ++it;
+    }
+    else
+    {
+      it = _wmo_doodads_culling.erase(it);
+    }
+  }
+
   std::unordered_map<Model*, std::size_t> model_with_particles;
 
   // M2s / models
@@ -1043,6 +1060,7 @@ void World::draw ( math::matrix_4x4 const& model_view
           {
             it.second[0]->model->draw( model_view
                                      , it.second
+                                     , _models_culling[it.first]
                                      , m2_shader
                                      , frustum
                                      , culldistance
@@ -1065,6 +1083,7 @@ void World::draw ( math::matrix_4x4 const& model_view
         {
           it.second[0]->model->draw( model_view
                                    , it.second
+                                   , _wmo_doodads_culling[it.first]
                                    , m2_shader
                                    , frustum
                                    , culldistance
@@ -1351,7 +1370,7 @@ selection_result World::intersect ( math::matrix_4x4 const& model_view
   {
     if (draw_models)
     {
-      _model_instance_storage.for_each_m2_instance([&] (ModelInstance& model_instance)
+      _model_instance_storage.for_each_m2_instance_on_ray(ray, [&] (ModelInstance& model_instance)
       {
         if (draw_hidden_models || !model_instance.model->is_hidden())
         {
@@ -1362,7 +1381,7 @@ selection_result World::intersect ( math::matrix_4x4 const& model_view
 
     if (draw_wmo)
     {
-      _model_instance_storage.for_each_wmo_instance([&] (WMOInstance& wmo_instance)
+      _model_instance_storage.for_each_wmo_instance_on_ray(ray, [&] (WMOInstance& wmo_instance)
       {
         if (draw_hidden_models || !wmo_instance.wmo->is_hidden())
         {
@@ -1392,12 +1411,14 @@ unsigned int World::getAreaID (math::vector_3d const& pos)
 
 void World::clearHeight(math::vector_3d const& pos)
 {
-  for_all_chunks_on_tile(pos, [](MapChunk* chunk) {
+  std::vector<MapChunk*> chunks;
+
+  for_all_chunks_on_tile(pos, [&](MapChunk* chunk) {
     chunk->clearHeight();
+    chunks.emplace_back(chunk);
   });
-  for_all_chunks_on_tile(pos, [this] (MapChunk* chunk) {
-      recalc_norms (chunk);
-  });
+
+  recalc_norms (chunks);
 }
 
 void World::clearAllModelsOnADT(tile_index const& tile)
@@ -1451,6 +1472,8 @@ template<typename Fun>
 
     for (MapChunk* chunk : tile->chunks_in_range (pos, radius))
     {
+      capture_for_history (chunk);
+
       if (fun (chunk))
       {
         changed = true;
@@ -1488,9 +1511,62 @@ template<typename Fun, typename Post>
   return changed;
 }
 
+template<typename Fun>
+  bool World::for_all_chunks_in_range_parallel (math::vector_3d const& pos, float radius, Fun&& fun)
+{
+  return for_all_chunks_in_range_parallel (pos, radius, std::forward<Fun> (fun), [] (MapChunk*) {});
+}
+template<typename Fun, typename Post>
+  bool World::for_all_chunks_in_range_parallel (math::vector_3d const& pos, float radius, Fun&& fun, Post&& post)
+{
+  std::vector<MapChunk*> chunks;
+
+  for (MapTile* tile : mapIndex.tiles_in_range (pos, radius))
+  {
+    if (!tile->finishedLoading())
+    {
+      continue;
+    }
+
+    for (MapChunk* chunk : tile->chunks_in_range (pos, radius))
+    {
+      capture_for_history (chunk);
+      chunks.emplace_back (chunk);
+    }
+  }
+
+  std::vector<char> chunk_changed (chunks.size(), false);
+
+  noggit::thread_pool::instance().parallel_for
+    ( chunks.size()
+    , [&] (std::size_t i)
+      {
+        chunk_changed[i] = fun (chunks[i]);
+      }
+    );
+
+  bool changed (false);
+
+  for (std::size_t i (0); i < chunks.size(); ++i)
+  {
+    // texture references dropped on the workers are released here, on the
+    // thread owning the opengl context
+    chunks[i]->texture_set->release_erased_textures();
+
+    if (chunk_changed[i])
+    {
+      changed = true;
+      mapIndex.setChanged (chunks[i]->mt);
+      post (chunks[i]);
+    }
+  }
+
+  return changed;
+}
+
 void World::changeShader(math::vector_3d const& pos, math::vector_4d const& color, float change, float radius, bool editMode)
 {
-  for_all_chunks_in_range
+  for_all_chunks_in_range_parallel
     ( pos, radius
     , [&] (MapChunk* chunk)
       {
@@ -1516,74 +1592,152 @@ math::vector_3d World::pickShaderColor(math::vector_3d const& pos)
 
 void World::changeTerrain(math::vector_3d const& pos, float change, float radius, int BrushType, float inner_radius)
 {
-  for_all_chunks_in_range
+  std::vector<MapChunk*> changed_chunks;
+
+  for_all_chunks_in_range_parallel
     ( pos, radius
     , [&] (MapChunk* chunk)
       {
         return chunk->changeTerrain(pos, change, radius, BrushType, inner_radius);
       }
-    , [this] (MapChunk* chunk)
+    , [&] (MapChunk* chunk)
       {
-        recalc_norms (chunk);
+        changed_chunks.emplace_back (chunk);
       }
     );
+
+  recalc_norms (changed_chunks);
 }
 
 void World::flattenTerrain(math::vector_3d const& pos, float remain, float radius, int BrushType, flatten_mode const& mode, const math::vector_3d& origin, math::degrees angle, math::degrees orientation)
 {
-  for_all_chunks_in_range
+  std::vector<MapChunk*> changed_chunks;
+
+  for_all_chunks_in_range_parallel
     ( pos, radius
     , [&] (MapChunk* chunk)
       {
         return chunk->flattenTerrain(pos, remain, radius, BrushType, mode, origin, angle, orientation);
       }
-    , [this] (MapChunk* chunk)
+    , [&] (MapChunk* chunk)
       {
-        recalc_norms (chunk);
+        changed_chunks.emplace_back (chunk);
       }
     );
+
+  recalc_norms (changed_chunks);
 }
 
 void World::blurTerrain(math::vector_3d const& pos, float remain, float radius, int BrushType, flatten_mode const& mode)
 {
-  for_all_chunks_in_range
+  // the samples are at most radius and half a unit away from the brush
+  float const extent (radius + UNITSIZE);
+  noggit::blur_kernel const kernel
+    ( gather_heights ( noggit::heightfield::chunk_at (pos.x - extent)
+                     , noggit::heightfield::chunk_at (pos.z - extent)
+                     , noggit::heightfield::chunk_at (pos.x + extent)
+                     , noggit::heightfield::chunk_at (pos.z + extent)
+                     )
+    , pos
+    , radius
+    );
+
+  std::vector<MapChunk*> changed_chunks;
+
+  for_all_chunks_in_range_parallel
     ( pos, radius
     , [&] (MapChunk* chunk)
       {
-        return chunk->blurTerrain ( pos
-                                  , remain
-                                  , radius
-                                  , BrushType
-                                  , mode
-                                  , [this] (float x, float z) -> boost::optional<float>
-                                    {
-                                      math::vector_3d vec;
-                                      auto res (GetVertex (x, z, &vec));
-                                      return boost::make_optional (res, vec.y);
-                                    }
-                                  );
+        return chunk->blurTerrain (pos, remain, radius, BrushType, mode, kernel);
       }
-    , [this] (MapChunk* chunk)
+    , [&] (MapChunk* chunk)
       {
-        recalc_norms (chunk);
+        changed_chunks.emplace_back (chunk);
       }
     );
+
+  recalc_norms (changed_chunks);
 }
 
 void World::recalc_norms (MapChunk* chunk) const
 {
-  chunk->recalcNorms ( [this] (float x, float z) -> boost::optional<float>
-                       {
-                         math::vector_3d vec;
-                         auto res (GetVertex (x, z, &vec));
-                         return boost::make_optional (res, vec.y);
-                       }
-                     );
+  recalc_norms (std::vector<MapChunk*> {chunk});
+}
+
+void World::recalc_norms (std::vector<MapChunk*> const& chunks) const
+{
+  if (chunks.empty())
+  {
+    return;
+  }
+
+  int first_x (std::numeric_limits<int>::max());
+  int first_z (std::numeric_limits<int>::max());
+  int last_x (std::numeric_limits<int>::min());
+  int last_z (std::numeric_limits<int>::min());
+
+  for (MapChunk* chunk : chunks)
+  {
+    int const x (noggit::heightfield::chunk_at (chunk->xbase + CHUNKSIZE / 2.f));
+    int const z (noggit::heightfield::chunk_at (chunk->zbase + CHUNKSIZE / 2.f));
+    first_x = std::min (first_x, x);
+    first_z = std::min (first_z, z);
+    last_x = std::max (last_x, x);
+    last_z = std::max (last_z, z);
+  }
+
+  // the border vertices use the neighbouring chunks
+  noggit::heightfield const heights
+    (gather_heights (first_x - 1, first_z - 1, last_x + 1, last_z + 1));
+
+  noggit::thread_pool::instance().parallel_for
+    ( chunks.size()
+    , [&] (std::size_t i)
+      {
+        chunks[i]->recalcNorms (heights);
+      }
+    );
+}
+
+noggit::heightfield World::gather_heights ( int first_chunk_x
+                                          , int first_chunk_z
+                                          , int last_chunk_x
+                                          , int last_chunk_z
+                                          ) const
+{
+  int const chunks_per_side (64 * 16);
+
+  noggit::heightfield heights
+    ( std::max (0, first_chunk_x), std::max (0, first_chunk_z)
+    , std::min (chunks_per_side - 1, last_chunk_x), std::min (chunks_per_side - 1, last_chunk_z)
+    );
+
+  for (int z (heights.first_chunk_z()); z <= heights.last_chunk_z(); ++z)
+  {
+    for (int x (heights.first_chunk_x()); x <= heights.last_chunk_x(); ++x)
+    {
+      tile_index const tile (x / 16, z / 16);
+
+      if (!mapIndex.tileLoaded (tile))
+      {
+        continue;
+      }
+
+      MapTile* adt (mapIndex.getTile (tile));
+
+      if (adt->finishedLoading())
+      {
+        heights.set_chunk (x, z, adt->getChunk (x % 16, z % 16)->mVertices);
+      }
+    }
+  }
+
+  return heights;
 }
 
 bool World::paintTexture(math::vector_3d const& pos, Brush* brush, float strength, float pressure, scoped_blp_texture_reference texture)
 {
-  return for_all_chunks_in_range
+  return for_all_chunks_in_range_parallel
     ( pos, brush->getRadius()
     , [&] (MapChunk* chunk)
       {
@@ -1613,7 +1767,7 @@ bool World::sprayTexture(math::vector_3d const& pos, Brush *brush, float strengt
 
 bool World::replaceTexture(math::vector_3d const& pos, float radius, scoped_blp_texture_reference const& old_texture, scoped_blp_texture_reference new_texture)
 {
-  return for_all_chunks_in_range
+  return for_all_chunks_in_range_parallel
     ( pos, radius
       , [&](MapChunk* chunk)
       {
@@ -1656,6 +1810,7 @@ template<typename Fun>
     {
       for (size_t tx = 0; tx < 16; ++tx)
       {
+        capture_for_history(tile->getChunk(ty, tx));
         fun(tile->getChunk(ty, tx));
       }
     }
@@ -1670,7 +1825,10 @@ template<typename Fun>
   if (tile && tile->finishedLoading())
   {
     mapIndex.setChanged(tile);
-    fun(tile->getChunk((pos.x - tile->xbase) / CHUNKSIZE, (pos.z - tile->zbase) / CHUNKSIZE));
+
+    MapChunk* chunk (tile->getChunk((pos.x - tile->xbase) / CHUNKSIZE, (pos.z - tile->zbase) / CHUNKSIZE));
+    capture_for_history(chunk);
+    fun(chunk);
   }
 }
 
@@ -1699,6 +1857,192 @@ template<typename Fun>
     }
   }
 
+namespace
+{
+  //! chunks are keyed by their index counted from the origin, instances
+  //! by their uid above them
+  std::uint64_t const instance_history_key = std::uint64_t (1) << 32;
+  int const chunks_per_side = 64 * 16;
+
+  std::uint64_t chunk_history_key (MapChunk const* chunk)
+  {
+    return noggit::heightfield::chunk_at (chunk->zbase + CHUNKSIZE / 2.f) * chunks_per_side
+         + noggit::heightfield::chunk_at (chunk->xbase + CHUNKSIZE / 2.f);
+  }
+}
+
+void World::capture_for_history (MapChunk* chunk)
+{
+  std::uint64_t const key (chunk_history_key (chunk));
+
+  if (_history.needs_capture (key))
+  {
+    _history.capture (key, chunk->save_state());
+  }
+}
+
+noggit::action_history::state World::history_state (std::uint64_t key)
+{
+  noggit::action_history::state state;
+  noggit::state_writer writer (state);
+
+  if (key & instance_history_key)
+  {
+    // a deleted instance has no state, so nothing recorded on it applies
+    auto const instance
+      (_model_instance_storage.get_instance (static_cast<std::uint32_t> (key)));
+
+    if (!instance)
+    {
+      return state;
+    }
+
+    if (instance->which() == eEntry_Model)
+    {
+      ModelInstance const* model (boost::get<selected_model_type> (*instance));
+      writer.write (model->pos._data, 3);
+      writer.write (model->dir._data, 3);
+      writer.write (model->scale);
+    }
+    else
+    {
+      WMOInstance const* wmo (boost::get<selected_wmo_type> (*instance));
+      writer.write (wmo->pos._data, 3);
+      writer.write (wmo->dir._data, 3);
+    }
+
+    return state;
+  }
+
+  int const x (key % chunks_per_side);
+  int const z (key / chunks_per_side);
+
+  // edits are kept in memory, a tile unloaded since was saved with them
+  MapTile* tile (mapIndex.loadTile (tile_index (x / 16, z / 16)));
+  if (!tile)
+  {
+    return state;
+  }
+  tile->wait_until_loaded();
+
+  return tile->getChunk (x % 16, z % 16)->save_state();
+}
+
+void World::restore_history_state (std::uint64_t key, noggit::action_history::state const& state)
+{
+  noggit::state_reader reader (state);
+
+  if (key & instance_history_key)
+  {
+    auto const instance
+      (_model_instance_storage.get_instance (static_cast<std::uint32_t> (key)));
+
+    // deleted instances aren't brought back
+    if (!instance || state.empty())
+    {
+      return;
+    }
+
+    selection_type const& entry (*instance);
+
+    updateTilesEntry (entry, model_update::remove);
+
+    if (entry.which() == eEntry_Model)
+    {
+      ModelInstance* model (boost::get<selected_model_type> (entry));
+      reader.read (model->pos._data, 3);
+      reader.read (model->dir._data, 3);
+      model->scale = reader.read<float>();
+      model->recalcExtents();
+    }
+    else
+    {
+      WMOInstance* wmo (boost::get<selected_wmo_type> (entry));
+      reader.read (wmo->pos._data, 3);
+      reader.read (wmo->dir._data, 3);
+      wmo->recalcExtents();
+    }
+
+    updateTilesEntry (entry, model_update::add);
+    return;
+  }
+
+  int const x (key % chunks_per_side);
+  int const z (key / chunks_per_side);
+  tile_index const tile (x / 16, z / 16);
+
+  mapIndex.getTile (tile)->getChunk (x % 16, z % 16)->restore_state (state);
+  mapIndex.setChanged (tile);
+}
+
+void World::begin_action()
+{
+  if (_history.recording())
+  {
+    return;
+  }
+
+  _history.begin();
+
+  for (selection_type const& entry : _current_selection)
+  {
+    if (entry.which() == eEntry_MapChunk)
+    {
+      continue;
+    }
+
+    std::uint32_t const uid ( entry.which() == eEntry_Model
+                            ? boost::get<selected_model_type> (entry)->uid
+                            : boost::get<selected_wmo_type> (entry)->mUniqueID
+                            );
+
+    _history.capture (instance_history_key | uid, history_state (instance_history_key | uid));
+  }
+}
+
+void World::end_action()
+{
+  _history.end ([this] (std::uint64_t key) { return history_state (key); });
+}
+
+bool World::undo()
+{
+  bool const undone
+    ( _history.undo ( [this] (std::uint64_t key) { return history_state (key); }
+                    , [this] (std::uint64_t key, noggit::action_history::state const& state)
+                      {
+                        restore_history_state (key, state);
+                      }
+                    )
+    );
+
+  if (undone)
+  {
+    update_selection_pivot();
+  }
+
+  return undone;
+}
+
+bool World::redo()
+{
+  bool const redone
+    ( _history.redo ( [this] (std::uint64_t key) { return history_state (key); }
+                    , [this] (std::uint64_t key, noggit::action_history::state const& state)
+                      {
+                        restore_history_state (key, state);
+                      }
+                    )
+    );
+
+  if (redone)
+  {
+    update_selection_pivot();
+  }
+
+  return redone;
+}
+
 void World::convert_alphamap(bool to_big_alpha)
 {
   if (to_big_alpha == mapIndex.hasBigAlpha())
@@ -1906,11 +2250,22 @@ void World::updateTilesEntry(selection_type const& entry, model_update type)
 
 void World::updateTilesWMO(WMOInstance* wmo, model_update type)
 {
+  // removals are handled by the storage when the instance is deleted
+  if (type == model_update::add)
+  {
+    _model_instance_storage.update_bounds(wmo);
+  }
+
   _tile_update_queue.queue_update(wmo, type);
 }
 
 void World::updateTilesModel(ModelInstance* m2, model_update type)
 {
+  if (type == model_update::add)
+  {
+    _model_instance_storage.update_bounds(m2);
+  }
+
   _tile_update_queue.queue_update(m2, type);
 }
 
@@ -2174,8 +2529,9 @@ void World::updateSelectedVertices()
   for (MapChunk* chunk : _vertex_chunks)
   {
     chunk->updateVerticesData();
-    recalc_norms (chunk);
   }
+
+  recalc_norms (std::vector<MapChunk*> (_vertex_chunks.begin(), _vertex_chunks.end()));
 }
 
 void World::orientVertices ( math::vector_3d const& ref_pos
@@ -2258,5 +2614,17 @@ void World::update_models_by_filename()
     model_instance.recalcExtents();
   });
 
+  for (auto it = _models_culling.begin(); it != _models_culling.end();)
+  {
+    if (_models_by_filename.count(it->first))
+    {
+      ++it;
+    }
+    else
+    {
+      it = _models_culling.erase(it);
+    }
+  }
+
   need_model_updates = false;
 }
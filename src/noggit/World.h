@@ -4,7 +4,9 @@
 
 #include <math/frustum.hpp>
 #include <math/trig.hpp>
+#include <noggit/action_history.hpp>
 #include <noggit/cursor_render.hpp>
+#include <noggit/heightfield.hpp>
 #include <noggit/Misc.h>
 #include <noggit/Model.h> // ModelManager
 #include <noggit/Selection.h>
@@ -12,6 +14,7 @@
 #include <noggit/WMO.h> // WMOManager
 #include <noggit/map_horizon.h>
 #include <noggit/map_index.hpp>
+#include <noggit/model_instance_culling.hpp>
 #include <noggit/tile_index.hpp>
 #include <noggit/tool_enums.hpp>
 #include <noggit/world_tile_update_queue.hpp>
@@ -47,6 +50,8 @@ class World
 {
 private:
   std::unordered_map<std::string, std::vector<ModelInstance*>> _models_by_filename;
+  std::unordered_map<std::string, noggit::model_instance_culling> _models_culling;
+  std::unordered_map<std::string, noggit::model_instance_culling> _wmo_doodads_culling;
   noggit::world_model_instances_storage _model_instance_storage;
   noggit::world_tile_update_queue _tile_update_queue;
 public:
@@ -202,6 +207,20 @@ public:
                                  , Fun&& /* MapChunk* -> bool changed */
                                  , Post&& /* MapChunk* -> void; called for all changed chunks */
                                  );
+  //! like for_all_chunks_in_range, but the chunks are split across the
+  //! thread pool, so fun may only touch the chunk it is given. Tiles are
+  //! flagged as changed and post is called afterwards on this thread.
+  template<typename Fun>
+    bool for_all_chunks_in_range_parallel ( math::vector_3d const& pos
+                                          , float radius
+                                          , Fun&& /* MapChunk* -> bool changed */
+                                          );
+  template<typename Fun, typename Post>
+    bool for_all_chunks_in_range_parallel ( math::vector_3d const& pos
+                                          , float radius
+                                          , Fun&& /* MapChunk* -> bool changed */
+                                          , Post&& /* MapChunk* -> void; called for all changed chunks */
+                                          );
   template<typename Fun>
     void for_all_chunks_on_tile (math::vector_3d const& pos, Fun&&);
 
@@ -314,12 +333,28 @@ public:
   math::vector_3d const& vertexCenter();
 
   void recalc_norms (MapChunk*) const;
+  //! with the heights of all chunks gathered once
+  void recalc_norms (std::vector<MapChunk*> const&) const;
 
   bool need_model_updates = false;
 
+  //! the chunks touched through the chunk iterators and the transforms of
+  //! the models selected at begin_action are undone as one action
+  void begin_action();
+  void end_action();
+  bool undo();
+  bool redo();
+
 private:
   void update_models_by_filename();
 
+  void capture_for_history (MapChunk* chunk);
+  noggit::action_history::state history_state (std::uint64_t key);
+  void restore_history_state (std::uint64_t key, noggit::action_history::state const& state);
+
+  //! heights of the loaded chunks [first, last], counted from the origin
+  noggit::heightfield gather_heights (int first_chunk_x, int first_chunk_z, int last_chunk_x, int last_chunk_z) const;
+
   std::set<MapChunk*>& vertexBorderChunks();
 
   std::set<MapTile*> _vertex_tiles;
@@ -338,6 +373,8 @@ private:
 
   float _view_distance;
 
+  noggit::action_history _history;
+
   std::unique_ptr<opengl::program> _mcnk_program;;
   std::unique_ptr<opengl::program> _mfbo_program;
   std::unique_ptr<opengl::program> _m2_program;
@@ -0,0 +1,273 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#include <noggit/action_history.hpp>
+
+#include <algorithm>
+
+namespace noggit
+{
+  namespace
+  {
+    void write_varint (std::vector<std::uint8_t>& out, std::size_t value)
+    {
+      while (value >= 0x80)
+      {
+        out.push_back (static_cast<std::uint8_t> (value | 0x80));
+        value >>= 7;
+      }
+      out.push_back (static_cast<std::uint8_t> (value));
+    }
+
+    std::size_t read_varint (std::vector<std::uint8_t> const& in, std::size_t& offset)
+    {
+      std::size_t value (0);
+      for (int shift (0); ; shift += 7)
+      {
+        std::uint8_t const byte (in.at (offset++));
+        value |= static_cast<std::size_t> (byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+          return value;
+        }
+      }
+    }
+
+    std::uint8_t byte_at (action_history::state const& state, std::size_t i)
+    {
+      return i < state.size() ? state[i] : 0;
+    }
+  }
+
+  action_history::action_history (std::size_t memory_budget)
+    : _memory_budget (memory_budget)
+  {}
+
+  void action_history::begin()
+  {
+    _recording = true;
+  }
+
+  bool action_history::needs_capture (std::uint64_t key) const
+  {
+    return _recording && !_captured.count (key);
+  }
+
+  void action_history::capture (std::uint64_t key, state before)
+  {
+    if (_recording)
+    {
+      _captured.emplace (key, std::move (before));
+    }
+  }
+
+  void action_history::end (state_of const& current_state)
+  {
+    if (!_recording)
+    {
+      return;
+    }
+    _recording = false;
+
+    action changes;
+
+    for (auto const& captured : _captured)
+    {
+      state const& before (captured.second);
+      state const after (current_state (captured.first));
+
+      if (before == after)
+      {
+        continue;
+      }
+
+      changes.push_back ( { captured.first
+                          , before.size()
+                          , after.size()
+                          , hash (before)
+                          , hash (after)
+                          , difference (before, after)
+                          }
+                        );
+    }
+
+    _captured.clear();
+
+    if (changes.empty())
+    {
+      return;
+    }
+
+    for (action const& undone : _redo)
+    {
+      _memory_usage -= memory_usage (undone);
+    }
+    _redo.clear();
+
+    _memory_usage += memory_usage (changes);
+    _undo.emplace_back (std::move (changes));
+
+    trim();
+  }
+
+  void action_history::clear()
+  {
+    _undo.clear();
+    _redo.clear();
+    _captured.clear();
+    _recording = false;
+    _memory_usage = 0;
+  }
+
+  bool action_history::undo (state_of const& current_state, restore const& restore_state)
+  {
+    return step (_undo, _redo, true, current_state, restore_state);
+  }
+
+  bool action_history::redo (state_of const& current_state, restore const& restore_state)
+  {
+    return step (_redo, _undo, false, current_state, restore_state);
+  }
+
+  bool action_history::step ( std::deque<action>& from
+                            , std::deque<action>& to
+                            , bool backwards
+                            , state_of const& current_state
+                            , restore const& restore_state
+                            )
+  {
+    if (_recording || from.empty())
+    {
+      return false;
+    }
+
+    action& changes (from.back());
+
+    std::vector<state> states;
+    states.reserve (changes.size());
+
+    // nothing is touched unless every object is still as the action left it
+    for (delta const& change : changes)
+    {
+      states.emplace_back (current_state (change.key));
+
+      std::size_t const size (backwards ? change.after_size : change.before_size);
+      std::uint64_t const expected (backwards ? change.after_hash : change.before_hash);
+
+      if (states.back().size() != size || hash (states.back()) != expected)
+      {
+        clear();
+        return false;
+      }
+    }
+
+    for (std::size_t i (0); i < changes.size(); ++i)
+    {
+      delta const& change (changes[i]);
+      restore_state
+        ( change.key
+        , apply ( states[i]
+                , change.difference
+                , backwards ? change.before_size : change.after_size
+                )
+        );
+    }
+
+    to.emplace_back (std::move (changes));
+    from.pop_back();
+
+    return true;
+  }
+
+  void action_history::trim()
+  {
+    while (_memory_usage > _memory_budget && _undo.size() > 1)
+    {
+      _memory_usage -= memory_usage (_undo.front());
+      _undo.pop_front();
+    }
+  }
+
+  std::vector<std::uint8_t> action_history::difference (state const& a, state const& b)
+  {
+    std::size_t const size (std::max (a.size(), b.size()));
+
+    std::vector<std::uint8_t> out;
+
+    std::size_t i (0);
+    while (i < size)
+    {
+      std::size_t const zeros_begin (i);
+      while (i < size && byte_at (a, i) == byte_at (b, i))
+      {
+        ++i;
+      }
+
+      // single equal bytes between changes are cheaper kept as literals
+      std::size_t const literals_begin (i);
+      while ( i < size
+            && ( byte_at (a, i) != byte_at (b, i)
+               || (i + 1 < size && byte_at (a, i + 1) != byte_at (b, i + 1))
+               )
+            )
+      {
+        ++i;
+      }
+
+      write_varint (out, literals_begin - zeros_begin);
+      write_varint (out, i - literals_begin);
+      for (std::size_t j (literals_begin); j < i; ++j)
+      {
+        out.push_back (byte_at (a, j) ^ byte_at (b, j));
+      }
+    }
+
+    out.shrink_to_fit();
+    return out;
+  }
+
+  action_history::state action_history::apply ( state const& from
+                                               , std::vector<std::uint8_t> const& difference
+                                               , std::size_t to_size
+                                               )
+  {
+    state to (from);
+    to.resize (std::max (from.size(), to_size), 0);
+
+    std::size_t offset (0);
+    std::size_t i (0);
+    while (offset < difference.size())
+    {
+      i += read_varint (difference, offset);
+      std::size_t const literals (read_varint (difference, offset));
+      for (std::size_t end (i + literals); i < end; ++i)
+      {
+        to.at (i) ^= difference.at (offset++);
+      }
+    }
+
+    to.resize (to_size);
+    return to;
+  }
+
+  std::uint64_t action_history::hash (state const& bytes)
+  {
+    // FNV-1a
+    std::uint64_t value (14695981039346656037ull);
+    for (std::uint8_t byte : bytes)
+    {
+      value ^= byte;
+      value *= 1099511628211ull;
+    }
+    return value;
+  }
+
+  std::size_t action_history::memory_usage (action const& changes)
+  {
+    std::size_t usage (sizeof (action) + changes.capacity() * sizeof (delta));
+    for (delta const& change : changes)
+    {
+      usage += change.difference.capacity();
+    }
+    return usage;
+  }
+}
@@ -0,0 +1,165 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace noggit
+{
+  //! Undo and redo of edits, made of the changes to the state of every
+  //! object an action touched. States are opaque bytes the owner provides
+  //! and restores by key. The state before the first change of an object
+  //! is captured when it's touched, and the action only keeps the xor of
+  //! the states before and after with its runs of zeros compressed away.
+  //! Applying it to either state gives the other, so one difference serves
+  //! undo and redo. The oldest actions are dropped past the memory budget.
+  class action_history
+  {
+  public:
+    using state = std::vector<std::uint8_t>;
+    using state_of = std::function<state (std::uint64_t key)>;
+    using restore = std::function<void (std::uint64_t key, state const&)>;
+
+    explicit action_history (std::size_t memory_budget);
+
+    action_history (action_history const&) = delete;
+    action_history (action_history&&) = delete;
+    action_history& operator= (action_history const&) = delete;
+    action_history& operator= (action_history&&) = delete;
+
+    //! does nothing if an action is already being recorded
+    void begin();
+    bool recording() const { return _recording; }
+    //! whether the state of key is yet to be captured in this action
+    bool needs_capture (std::uint64_t key) const;
+    //! only the first capture of a key in an action is kept
+    void capture (std::uint64_t key, state before);
+    //! keeps the objects whose state differs from the captured one
+    void end (state_of const&);
+
+    void clear();
+
+    bool can_undo() const { return !_undo.empty(); }
+    bool can_redo() const { return !_redo.empty(); }
+    //! false if there is nothing to undo or if an object changed without
+    //! being recorded since, in which case the whole history is dropped as
+    //! its differences don't apply anymore
+    bool undo (state_of const&, restore const&);
+    bool redo (state_of const&, restore const&);
+
+    std::size_t memory_usage() const { return _memory_usage; }
+
+    //! xor of the states, the shorter one padded with zeros, as pairs of
+    //! varint counts of zero bytes and of the literal bytes that follow
+    static std::vector<std::uint8_t> difference (state const& a, state const& b);
+    //! the other state of the difference, given one of them
+    static state apply ( state const& from
+                       , std::vector<std::uint8_t> const& difference
+                       , std::size_t to_size
+                       );
+
+  private:
+    struct delta
+    {
+      std::uint64_t key;
+      std::size_t before_size;
+      std::size_t after_size;
+      std::uint64_t before_hash;
+      std::uint64_t after_hash;
+      std::vector<std::uint8_t> difference;
+    };
+    using action = std::vector<delta>;
+
+    static std::uint64_t hash (state const&);
+    static std::size_t memory_usage (action const&);
+
+    bool step ( std::deque<action>& from
+              , std::deque<action>& to
+              , bool backwards
+              , state_of const&
+              , restore const&
+              );
+    //! drops the oldest actions past the budget, always keeping the last
+    void trim();
+
+    std::size_t const _memory_budget;
+    std::size_t _memory_usage = 0;
+
+    bool _recording = false;
+    std::unordered_map<std::uint64_t, state> _captured;
+
+    std::deque<action> _undo;
+    std::deque<action> _redo;
+  };
+
+  //! appends trivially copyable values to a state
+  class state_writer
+  {
+  public:
+    explicit state_writer (action_history::state& state) : _state (state) {}
+
+    template<typename T>
+      void write (T const& value)
+    {
+      write (&value, 1);
+    }
+    template<typename T>
+      void write (T const* values, std::size_t count)
+    {
+      std::size_t const offset (_state.size());
+      _state.resize (offset + sizeof (T) * count);
+      std::memcpy (_state.data() + offset, values, sizeof (T) * count);
+    }
+    void write (std::string const& value)
+    {
+      write (static_cast<std::uint32_t> (value.size()));
+      write (value.data(), value.size());
+    }
+
+  private:
+    action_history::state& _state;
+  };
+
+  //! reads back what a state_writer wrote, in the same order
+  class state_reader
+  {
+  public:
+    explicit state_reader (action_history::state const& state) : _state (state) {}
+
+    template<typename T>
+      T read()
+    {
+      T value;
+      read (&value, 1);
+      return value;
+    }
+    template<typename T>
+      void read (T* values, std::size_t count)
+    {
+      if (_offset + sizeof (T) * count > _state.size())
+      {
+        throw std::logic_error ("state_reader: read past the end of the state");
+      }
+      std::memcpy (values, _state.data() + _offset, sizeof (T) * count);
+      _offset += sizeof (T) * count;
+    }
+    std::string read_string()
+    {
+      std::string value (read<std::uint32_t>(), '\0');
+      read (&value[0], value.size());
+      return value;
+    }
+
+  private:
+    action_history::state const& _state;
+    std::size_t _offset = 0;
+  };
+}
@@ -0,0 +1,131 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#include <noggit/alpha_edit_pool.hpp>
+#include <noggit/TextureManager.h> // scoped_blp_texture_reference
+#include <noggit/texture_set.hpp>
+
+#include <cassert>
+#include <new>
+
+namespace noggit
+{
+  namespace
+  {
+    //! enough for a brush stamp over a few chunks without going to the
+    //! allocator after a compaction
+    std::size_t const blocks_kept_when_compacting = 16;
+  }
+
+  alpha_edit_pool::~alpha_edit_pool()
+  {
+    for (void* block : _free_blocks)
+    {
+      ::operator delete (block);
+    }
+  }
+
+  void* alpha_edit_pool::allocate (std::size_t size)
+  {
+    {
+      std::lock_guard<std::mutex> const lock (_mutex);
+
+      assert (!_block_size || _block_size == size);
+      _block_size = size;
+      ++_blocks_in_use;
+
+      if (!_free_blocks.empty())
+      {
+        void* block (_free_blocks.back());
+        _free_blocks.pop_back();
+        return block;
+      }
+    }
+
+    try
+    {
+      return ::operator new (size);
+    }
+    catch (...)
+    {
+      std::lock_guard<std::mutex> const lock (_mutex);
+      --_blocks_in_use;
+      throw;
+    }
+  }
+
+  void alpha_edit_pool::deallocate (void* block)
+  {
+    if (!block)
+    {
+      return;
+    }
+
+    std::lock_guard<std::mutex> const lock (_mutex);
+    --_blocks_in_use;
+    _free_blocks.push_back (block);
+  }
+
+  void alpha_edit_pool::touch (TextureSet* texture_set)
+  {
+    std::lock_guard<std::mutex> const lock (_mutex);
+    _last_edit[texture_set] = clock::now();
+  }
+
+  void alpha_edit_pool::forget (TextureSet* texture_set)
+  {
+    std::lock_guard<std::mutex> const lock (_mutex);
+    _last_edit.erase (texture_set);
+  }
+
+  void alpha_edit_pool::compact (clock::duration idle)
+  {
+    std::vector<TextureSet*> idle_sets;
+    std::vector<void*> unused_blocks;
+
+    {
+      std::lock_guard<std::mutex> const lock (_mutex);
+
+      clock::time_point const now (clock::now());
+      for (auto const& last_edit : _last_edit)
+      {
+        if (now - last_edit.second >= idle)
+        {
+          idle_sets.push_back (last_edit.first);
+        }
+      }
+    }
+
+    // forgets the texture set and gives its block back
+    for (TextureSet* texture_set : idle_sets)
+    {
+      texture_set->apply_alpha_changes();
+    }
+
+    {
+      std::lock_guard<std::mutex> const lock (_mutex);
+
+      while (_free_blocks.size() > blocks_kept_when_compacting)
+      {
+        unused_blocks.push_back (_free_blocks.back());
+        _free_blocks.pop_back();
+      }
+    }
+
+    for (void* block : unused_blocks)
+    {
+      ::operator delete (block);
+    }
+  }
+
+  std::size_t alpha_edit_pool::resident_bytes() const
+  {
+    std::lock_guard<std::mutex> const lock (_mutex);
+    return _blocks_in_use * _block_size;
+  }
+
+  std::size_t alpha_edit_pool::pooled_bytes() const
+  {
+    std::lock_guard<std::mutex> const lock (_mutex);
+    return _free_blocks.size() * _block_size;
+  }
+}
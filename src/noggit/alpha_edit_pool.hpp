@@ -0,0 +1,64 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class TextureSet;
+
+namespace noggit
+{
+  //! Memory of the temporary alphamaps of the texture sets being painted.
+  //! Blocks are recycled since painting over many chunks acquires and
+  //! releases them all the time. Texture sets holding a block report when
+  //! they are edited so the ones no longer painted on can give theirs back.
+  class alpha_edit_pool
+  {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    static alpha_edit_pool& instance()
+    {
+      static alpha_edit_pool pool;
+      return pool;
+    }
+
+    alpha_edit_pool() = default;
+    ~alpha_edit_pool();
+
+    alpha_edit_pool (alpha_edit_pool const&) = delete;
+    alpha_edit_pool (alpha_edit_pool&&) = delete;
+    alpha_edit_pool& operator= (alpha_edit_pool const&) = delete;
+    alpha_edit_pool& operator= (alpha_edit_pool&&) = delete;
+
+    //! \note size has to be the same for every call
+    void* allocate (std::size_t size);
+    void deallocate (void*);
+
+    //! the texture set's edit state was just changed
+    void touch (TextureSet*);
+    //! the texture set no longer has edit state or is destroyed
+    void forget (TextureSet*);
+
+    //! Applies the edits of the texture sets not touched for idle, which
+    //! releases their blocks, and frees unused blocks.
+    //! \note has to be called by the thread editing the texture sets
+    void compact (clock::duration idle);
+
+    //! memory of the blocks in use
+    std::size_t resident_bytes() const;
+    //! memory of the blocks kept for reuse
+    std::size_t pooled_bytes() const;
+
+  private:
+    mutable std::mutex _mutex;
+    std::size_t _block_size = 0;
+    std::size_t _blocks_in_use = 0;
+    std::vector<void*> _free_blocks;
+    std::unordered_map<TextureSet*, clock::time_point> _last_edit;
+  };
+}
@@ -268,6 +268,12 @@ Noggit::Noggit(int argc, char *argv[])
     format.setSamples (4);
   }
 
+  if (settings.value ("opengl_debug_output", false).toBool())
+  {
+    // errors are reported through GL_KHR_debug instead of glGetError()
+    format.setOption (QSurfaceFormat::DebugContext);
+  }
+
   QSurfaceFormat::setDefaultFormat (format);
 
   QOpenGLContext context;
@@ -0,0 +1,121 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#include <noggit/async_file_writer.hpp>
+
+#include <noggit/Log.h>
+#include <noggit/MPQ.h>
+
+#include <algorithm>
+
+namespace noggit
+{
+  async_file_writer::async_file_writer()
+  {
+    _thread = std::make_unique<std::thread>(&async_file_writer::process_queue, this);
+  }
+
+  async_file_writer::~async_file_writer()
+  {
+    wait_for_all();
+
+    {
+      // under the lock so that the worker can't miss it between checking
+      // its predicate and waiting
+      std::lock_guard<std::mutex> const lock (_mutex);
+      _stop = true;
+    }
+    _state_changed.notify_all();
+
+    _thread->join();
+  }
+
+  void async_file_writer::write (std::string const& filename, std::vector<char> content)
+  {
+    std::lock_guard<std::mutex> const lock (_mutex);
+
+    _queue.emplace_back (filename, std::move (content));
+    ++_pending;
+    _state_changed.notify_all();
+  }
+
+  void async_file_writer::wait_for (std::string const& filename)
+  {
+    std::string const normalized (mpq::normalized_filename (filename));
+
+    std::unique_lock<std::mutex> lock (_mutex);
+
+    _state_changed.wait
+    ( lock
+    , [&]
+      {
+        return std::none_of
+          ( _queue.begin(), _queue.end()
+          , [&] (std::pair<std::string, std::vector<char>> const& file)
+            {
+              return mpq::normalized_filename (file.first) == normalized;
+            }
+          );
+      }
+    );
+  }
+
+  void async_file_writer::wait_for_all()
+  {
+    std::unique_lock<std::mutex> lock (_mutex);
+
+    _state_changed.wait
+    ( lock
+    , [&]
+      {
+        return _queue.empty();
+      }
+    );
+  }
+
+  void async_file_writer::process_queue()
+  {
+    while (!_stop.load())
+    {
+      std::pair<std::string, std::vector<char>>* file;
+
+      {
+        std::unique_lock<std::mutex> lock (_mutex);
+
+        _state_changed.wait
+        ( lock
+        , [&]
+          {
+            return _stop.load() || !_queue.empty();
+          }
+        );
+
+        if (_stop.load())
+        {
+          return;
+        }
+
+        // stays in the queue while being written so that wait_for()
+        // doesn't return too early
+        file = &_queue.front();
+      }
+
+      try
+      {
+        MPQFile f (file->first);
+        f.setBuffer (file->second);
+        f.SaveFile();
+      }
+      catch (std::exception const& e)
+      {
+        LogError << "Saving \"" << file->first << "\" failed: " << e.what() << std::endl;
+      }
+
+      {
+        std::lock_guard<std::mutex> const lock (_mutex);
+        _queue.pop_front();
+        --_pending;
+        _state_changed.notify_all();
+      }
+    }
+  }
+}
@@ -0,0 +1,55 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace noggit
+{
+  //! Writes already serialized files to the project directory in the
+  //! background. Pending files are written before destruction.
+  class async_file_writer
+  {
+  public:
+    async_file_writer();
+    ~async_file_writer();
+
+    async_file_writer(async_file_writer const&) = delete;
+    async_file_writer(async_file_writer&&) = delete;
+    async_file_writer& operator= (async_file_writer const&) = delete;
+    async_file_writer& operator= (async_file_writer&&) = delete;
+
+    void write (std::string const& filename, std::vector<char> content);
+
+    //! blocks until the given file isn't waiting to be written anymore,
+    //! e.g. before reading it again
+    void wait_for (std::string const& filename);
+    void wait_for_all();
+
+    std::size_t pending() const { return _pending; }
+
+  private:
+    void process_queue();
+
+    std::atomic<bool> _stop = {false};
+    std::atomic<std::size_t> _pending = {0};
+    std::mutex _mutex;
+    std::condition_variable _state_changed;
+
+    // writes are queued in order, so a file saved twice ends up with
+    // the latest content
+    std::deque<std::pair<std::string, std::vector<char>>> _queue;
+
+    // only use one thread, the disk isn't any faster with more
+    std::unique_ptr<std::thread> _thread;
+  };
+}
@@ -0,0 +1,98 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#pragma once
+
+#include <boost/optional.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace noggit
+{
+  //! Row of a DBC record by the uint in one of its fields, usually the id.
+  //! Ids are mostly compact, so they are looked up in an array spanning
+  //! [min, max] id and only fall back to hashing when that array would be
+  //! mostly empty. If an id is used twice, the first row wins.
+  class dbc_index
+  {
+  public:
+    dbc_index() = default;
+    dbc_index ( unsigned char const* records
+              , std::size_t record_size
+              , std::size_t record_count
+              , std::size_t field
+              )
+    {
+      if (!record_count)
+      {
+        return;
+      }
+
+      auto const id_of ([&] (std::size_t row)
+      {
+        std::uint32_t id;
+        std::memcpy (&id, records + row * record_size + field * 4, sizeof (id));
+        return id;
+      });
+
+      std::uint32_t min_id (id_of (0));
+      std::uint32_t max_id (min_id);
+      for (std::size_t row (1); row < record_count; ++row)
+      {
+        min_id = std::min (min_id, id_of (row));
+        max_id = std::max (max_id, id_of (row));
+      }
+
+      std::uint64_t const range (std::uint64_t (max_id) - min_id + 1);
+      _dense = range <= 4 * std::uint64_t (record_count) + 1024;
+      _min_id = min_id;
+
+      if (_dense)
+      {
+        _rows.assign (range, 0);
+        for (std::size_t row (record_count); row-- > 0;)
+        {
+          _rows[id_of (row) - min_id] = static_cast<std::uint32_t> (row + 1);
+        }
+      }
+      else
+      {
+        _sparse.reserve (record_count);
+        for (std::size_t row (0); row < record_count; ++row)
+        {
+          _sparse.emplace (id_of (row), static_cast<std::uint32_t> (row));
+        }
+      }
+    }
+
+    boost::optional<std::size_t> row (std::uint32_t id) const
+    {
+      if (_dense)
+      {
+        if (id < _min_id || id - _min_id >= _rows.size() || !_rows[id - _min_id])
+        {
+          return boost::none;
+        }
+        return std::size_t (_rows[id - _min_id] - 1);
+      }
+
+      auto const it (_sparse.find (id));
+      if (it == _sparse.end())
+      {
+        return boost::none;
+      }
+      return std::size_t (it->second);
+    }
+
+  private:
+    bool _dense = true;
+    std::uint32_t _min_id = 0;
+    //! row + 1, 0 if the id isn't used
+    std::vector<std::uint32_t> _rows;
+    std::unordered_map<std::uint32_t, std::uint32_t> _sparse;
+  };
+}
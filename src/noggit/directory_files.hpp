@@ -0,0 +1,47 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#pragma once
+
+#include <boost/filesystem.hpp>
+#include <boost/range/iterator_range.hpp>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace noggit
+{
+  //! Regular files below root with their path relative to it, however
+  //! root is spelled (trailing separators, drive roots, "." or "..").
+  //! Empty if root isn't a directory.
+  inline std::vector<std::pair<std::string, boost::filesystem::path>>
+    directory_files (boost::filesystem::path const& root)
+  {
+    std::vector<std::pair<std::string, boost::filesystem::path>> files;
+
+    boost::system::error_code ec;
+    if (!boost::filesystem::is_directory (root, ec))
+    {
+      return files;
+    }
+
+    boost::filesystem::path const base (boost::filesystem::canonical (root, ec));
+    if (ec)
+    {
+      return files;
+    }
+
+    for ( auto const& entry
+        : boost::make_iterator_range
+            (boost::filesystem::recursive_directory_iterator (base, ec), {})
+        )
+    {
+      if (boost::filesystem::is_regular_file (entry.path(), ec))
+      {
+        files.emplace_back (entry.path().lexically_relative (base).string(), entry.path());
+      }
+    }
+
+    return files;
+  }
+}
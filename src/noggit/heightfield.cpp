@@ -0,0 +1,226 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#include <noggit/heightfield.hpp>
+#include <noggit/MapHeaders.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define NOGGIT_HEIGHTFIELD_SSE
+  #include <emmintrin.h>
+#endif
+
+namespace noggit
+{
+  namespace
+  {
+    //! mapbufsize vertices, each double row is 9 outer and 8 inner ones
+    int const vertex_count = 9 * 9 + 8 * 8;
+  }
+
+  heightfield::heightfield (int first_chunk_x, int first_chunk_z, int last_chunk_x, int last_chunk_z)
+    : _first_chunk_x (first_chunk_x)
+    , _first_chunk_z (first_chunk_z)
+    , _chunks_x (std::max (0, last_chunk_x - first_chunk_x + 1))
+    , _chunks_z (std::max (0, last_chunk_z - first_chunk_z + 1))
+    , _first_row (first_chunk_z * 16)
+    , _first_column (first_chunk_x * 8)
+    , _rows (_chunks_z * 16 + 1)
+    , _columns (_chunks_x * 8 + 1)
+    , _heights (_rows * _columns, 0.f)
+    , _known (_rows * _columns, 0)
+  {}
+
+  int heightfield::chunk_at (float coordinate)
+  {
+    return static_cast<int> (std::floor (coordinate / CHUNKSIZE));
+  }
+
+  void heightfield::vertex_index (float xbase, float zbase, int i, int& row, int& column)
+  {
+    // bases are multiples of CHUNKSIZE, don't let rounding pick the wrong one
+    int const chunk_x (chunk_at (xbase + CHUNKSIZE / 2.f));
+    int const chunk_z (chunk_at (zbase + CHUNKSIZE / 2.f));
+
+    bool const inner ((i % 17) >= 9);
+    row = chunk_z * 16 + (i / 17) * 2 + (inner ? 1 : 0);
+    column = chunk_x * 8 + (i % 17) - (inner ? 9 : 0);
+  }
+
+  void heightfield::set_chunk (int chunk_x, int chunk_z, math::vector_3d const* vertices)
+  {
+    if ( chunk_x < _first_chunk_x || chunk_x >= _first_chunk_x + _chunks_x
+       || chunk_z < _first_chunk_z || chunk_z >= _first_chunk_z + _chunks_z
+       )
+    {
+      return;
+    }
+
+    for (int i (0); i < vertex_count; ++i)
+    {
+      bool const inner ((i % 17) >= 9);
+      int const row (chunk_z * 16 + (i / 17) * 2 + (inner ? 1 : 0) - _first_row);
+      int const column (chunk_x * 8 + (i % 17) - (inner ? 9 : 0) - _first_column);
+
+      _heights[row * _columns + column] = vertices[i].y;
+      _known[row * _columns + column] = 1;
+    }
+  }
+
+  float heightfield::height (int row, int column, float fallback) const
+  {
+    row -= _first_row;
+    column -= _first_column;
+
+    if (row < 0 || row >= _rows || column < 0 || column >= _columns - (row % 2))
+    {
+      return fallback;
+    }
+
+    std::size_t const index (row * _columns + column);
+    return _known[index] ? _heights[index] : fallback;
+  }
+
+  boost::optional<float> heightfield::height (float x, float z) const
+  {
+    int const row (static_cast<int> (std::floor (z / (UNITSIZE * 0.5f) + 0.5f)));
+    int const column
+      (static_cast<int> (std::floor ((x - UNITSIZE * 0.5f * (row & 1)) / UNITSIZE + 0.5f)));
+
+    float const unknown (std::numeric_limits<float>::quiet_NaN());
+    float const h (height (row, column, unknown));
+
+    return boost::make_optional (!std::isnan (h), h);
+  }
+
+  blur_kernel::blur_kernel (heightfield const& heights, math::vector_3d const& center, float radius)
+    : _center (center)
+    , _radius (radius)
+    , _units (static_cast<int> (radius / UNITSIZE))
+    , _columns (2 * _units + 1)
+  {
+    int const rows (4 * _units + 1);
+
+    _heights.resize (rows * _columns);
+    _known.resize (rows * _columns);
+
+    for (int j (-2 * _units); j <= 2 * _units; ++j)
+    {
+      float const z (_center.z + j * UNITSIZE / 2);
+
+      for (int k (-_units); k <= _units; ++k)
+      {
+        float const x (_center.x + k * UNITSIZE + (j % 2) * UNITSIZE / 2.0f);
+        auto const h (heights.height (x, z));
+
+        std::size_t const index ((j + 2 * _units) * _columns + k + _units);
+        _heights[index] = h.get_value_or (0.f);
+        _known[index] = h ? 1.f : 0.f;
+      }
+    }
+  }
+
+  void blur_kernel::average ( float z
+                            , float first_x
+                            , int count
+                            , boost::optional<float>* averages
+                            ) const
+  {
+    std::vector<float> total_height (count, 0.f);
+    std::vector<float> total_weight (count, 0.f);
+    std::vector<float> weights;
+    float const inverse_radius (1.f / _radius);
+
+    for (int j (-2 * _units); j <= 2 * _units; ++j)
+    {
+      float const dz (_center.z + j * UNITSIZE / 2 - z);
+
+      if (std::abs (dz) > _radius)
+      {
+        continue;
+      }
+
+      // the distance of vertex i to sample k only depends on k - i, so
+      // the weights are computed once for all vertices of the row
+      float const half_width (std::sqrt (_radius * _radius - dz * dz));
+      float const offset (first_x - (_center.x + (j % 2) * UNITSIZE / 2.0f));
+
+      // samples farther away get a weight of 0, so the range may be wider
+      int const first_shift (static_cast<int> (std::floor ((offset - half_width) / UNITSIZE)));
+      int const last_shift (static_cast<int> (std::ceil ((offset + half_width) / UNITSIZE)));
+
+      weights.resize (last_shift - first_shift + 1);
+      for (int shift (first_shift); shift <= last_shift; ++shift)
+      {
+        float const dx (offset - shift * UNITSIZE);
+        float const dist (std::sqrt (dx * dx + dz * dz));
+        weights[shift - first_shift] = std::max (0.f, 1.f - dist * inverse_radius);
+      }
+
+      float const* heights (&_heights[(j + 2 * _units) * _columns + _units]);
+      float const* known (&_known[(j + 2 * _units) * _columns + _units]);
+
+      for (int i (0); i < count; ++i)
+      {
+        int const first_k (std::max (-_units, i + first_shift));
+        int const last_k (std::min (_units, i + last_shift));
+        int const samples (last_k - first_k + 1);
+
+        if (samples <= 0)
+        {
+          continue;
+        }
+
+        float const* weight (weights.data() + (first_k - i - first_shift));
+        float const* sample_height (heights + first_k);
+        float const* sample_known (known + first_k);
+
+        float sum_height (0.f);
+        float sum_weight (0.f);
+        int n (0);
+
+#ifdef NOGGIT_HEIGHTFIELD_SSE
+        __m128 sum_height4 (_mm_setzero_ps());
+        __m128 sum_weight4 (_mm_setzero_ps());
+
+        for (; n + 4 <= samples; n += 4)
+        {
+          __m128 const w (_mm_loadu_ps (weight + n));
+          sum_height4 = _mm_add_ps (sum_height4, _mm_mul_ps (w, _mm_loadu_ps (sample_height + n)));
+          sum_weight4 = _mm_add_ps (sum_weight4, _mm_mul_ps (w, _mm_loadu_ps (sample_known + n)));
+        }
+
+        float partial_height[4];
+        float partial_weight[4];
+        _mm_storeu_ps (partial_height, sum_height4);
+        _mm_storeu_ps (partial_weight, sum_weight4);
+        sum_height = (partial_height[0] + partial_height[1]) + (partial_height[2] + partial_height[3]);
+        sum_weight = (partial_weight[0] + partial_weight[1]) + (partial_weight[2] + partial_weight[3]);
+#endif
+
+        for (; n < samples; ++n)
+        {
+          sum_height += weight[n] * sample_height[n];
+          sum_weight += weight[n] * sample_known[n];
+        }
+
+        total_height[i] += sum_height;
+        total_weight[i] += sum_weight;
+      }
+    }
+
+    for (int i (0); i < count; ++i)
+    {
+      if (total_weight[i] > 0.f)
+      {
+        averages[i] = total_height[i] / total_weight[i];
+      }
+      else
+      {
+        averages[i] = boost::none;
+      }
+    }
+  }
+}
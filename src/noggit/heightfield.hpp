@@ -0,0 +1,84 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#pragma once
+
+#include <math/vector_3d.hpp>
+
+#include <boost/optional.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace noggit
+{
+  //! Heights of the vertices of a rectangle of chunks as one lattice, so
+  //! brushes can sample the terrain without going through World for every
+  //! sample. Row r lies at z = r * UNITSIZE / 2 and starts at x = 0 for
+  //! even and at x = UNITSIZE / 2 for odd rows, vertices are UNITSIZE
+  //! apart. Vertices of chunks not set are unknown.
+  class heightfield
+  {
+  public:
+    //! chunks [first, last] counted from the map's origin
+    heightfield (int first_chunk_x, int first_chunk_z, int last_chunk_x, int last_chunk_z);
+
+    //! chunk containing the coordinate, either x or z
+    static int chunk_at (float coordinate);
+    //! lattice position of vertex i of the chunk with the given base
+    static void vertex_index (float xbase, float zbase, int i, int& row, int& column);
+
+    int first_chunk_x() const { return _first_chunk_x; }
+    int first_chunk_z() const { return _first_chunk_z; }
+    int last_chunk_x() const { return _first_chunk_x + _chunks_x - 1; }
+    int last_chunk_z() const { return _first_chunk_z + _chunks_z - 1; }
+
+    //! copies the heights of the mapbufsize vertices of a chunk
+    void set_chunk (int chunk_x, int chunk_z, math::vector_3d const* vertices);
+
+    //! height of the lattice vertex or fallback if unknown
+    float height (int row, int column, float fallback) const;
+    //! height of the vertex closest to (x, z), like World::GetVertex()
+    boost::optional<float> height (float x, float z) const;
+
+  private:
+    int _first_chunk_x;
+    int _first_chunk_z;
+    int _chunks_x;
+    int _chunks_z;
+    int _first_row;
+    int _first_column;
+    int _rows;
+    int _columns;
+    std::vector<float> _heights;
+    std::vector<std::uint8_t> _known;
+  };
+
+  //! Weighted average of the terrain around a position as done by the
+  //! blur brush: samples are taken on a lattice spaced like the vertices
+  //! but centered on the brush and weighted by 1 - distance / radius. The
+  //! samples are read once, so every vertex of a stroke sees the terrain
+  //! as it was before the stroke.
+  class blur_kernel
+  {
+  public:
+    blur_kernel (heightfield const&, math::vector_3d const& center, float radius);
+
+    //! averages of count vertices on a row at z, UNITSIZE apart starting
+    //! at first_x, none if no sample within the radius is known
+    void average ( float z
+                 , float first_x
+                 , int count
+                 , boost::optional<float>* averages
+                 ) const;
+
+  private:
+    math::vector_3d _center;
+    float _radius;
+    //! samples are [-_units, _units] columns of [-2 * _units, 2 * _units] rows
+    int _units;
+    int _columns;
+    std::vector<float> _heights;
+    //! 1 or 0, multiplied with the weight
+    std::vector<float> _known;
+  };
+}
@@ -0,0 +1,209 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#include <noggit/instance_grid.hpp>
+
+#include <math/grid_traversal.hpp>
+#include <noggit/MapHeaders.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace noggit
+{
+  namespace
+  {
+    float const cell_size = CHUNKSIZE;
+    //! larger instances (e.g. whole cities) are tested for every ray
+    //! instead of being put into this many cells
+    int const max_cells_per_entry = 256;
+  }
+
+  std::uint64_t instance_grid::key (int x, int z)
+  {
+    return (static_cast<std::uint64_t> (static_cast<std::uint32_t> (x)) << 32)
+         | static_cast<std::uint32_t> (z);
+  }
+
+  instance_grid::cell_index instance_grid::cell_of (float x, float z) const
+  {
+    return { static_cast<int> (std::floor (x / cell_size))
+           , static_cast<int> (std::floor (z / cell_size))
+           };
+  }
+
+  void instance_grid::insert (std::uint32_t uid, math::vector_3d const& a, math::vector_3d const& b)
+  {
+    remove (uid);
+
+    bounds const box {uid, math::min (a, b), math::max (a, b), true};
+
+    entry e;
+    e.first = cell_of (box.min.x, box.min.z);
+    e.last = cell_of (box.max.x, box.max.z);
+
+    long long const cell_count ( (static_cast<long long> (e.last.x) - e.first.x + 1)
+                               * (static_cast<long long> (e.last.z) - e.first.z + 1)
+                               );
+    e.in_cells = cell_count <= max_cells_per_entry;
+
+    if (e.in_cells)
+    {
+      for (int z (e.first.z); z <= e.last.z; ++z)
+      {
+        for (int x (e.first.x); x <= e.last.x; ++x)
+        {
+          _cells[key (x, z)].push_back (box);
+        }
+      }
+
+      if (_max_cell.x < _min_cell.x)
+      {
+        _min_cell = e.first;
+        _max_cell = e.last;
+        _min_y = box.min.y;
+        _max_y = box.max.y;
+      }
+      else
+      {
+        _min_cell = {std::min (_min_cell.x, e.first.x), std::min (_min_cell.z, e.first.z)};
+        _max_cell = {std::max (_max_cell.x, e.last.x), std::max (_max_cell.z, e.last.z)};
+        _min_y = std::min (_min_y, box.min.y);
+        _max_y = std::max (_max_y, box.max.y);
+      }
+    }
+    else
+    {
+      _everywhere.push_back (box);
+    }
+
+    _entries.emplace (uid, e);
+  }
+
+  void instance_grid::insert_unbounded (std::uint32_t uid)
+  {
+    remove (uid);
+
+    entry e;
+    e.in_cells = false;
+
+    _everywhere.push_back ({uid, {}, {}, false});
+    _entries.emplace (uid, e);
+  }
+
+  void instance_grid::remove (std::uint32_t uid)
+  {
+    auto const it (_entries.find (uid));
+    if (it == _entries.end())
+    {
+      return;
+    }
+
+    auto const erase_from ([uid] (std::vector<bounds>& boxes)
+    {
+      auto const pos ( std::find_if ( boxes.begin(), boxes.end()
+                                    , [uid] (bounds const& box) { return box.uid == uid; }
+                                    )
+                     );
+      if (pos != boxes.end())
+      {
+        *pos = boxes.back();
+        boxes.pop_back();
+      }
+    });
+
+    entry const& e (it->second);
+    if (e.in_cells)
+    {
+      for (int z (e.first.z); z <= e.last.z; ++z)
+      {
+        for (int x (e.first.x); x <= e.last.x; ++x)
+        {
+          auto const cell (_cells.find (key (x, z)));
+          erase_from (cell->second);
+          if (cell->second.empty())
+          {
+            _cells.erase (cell);
+          }
+        }
+      }
+    }
+    else
+    {
+      erase_from (_everywhere);
+    }
+
+    _entries.erase (it);
+  }
+
+  void instance_grid::clear()
+  {
+    _entries.clear();
+    _cells.clear();
+    _everywhere.clear();
+    _min_cell = {0, 0};
+    _max_cell = {-1, -1};
+  }
+
+  std::vector<std::uint32_t> instance_grid::unbounded() const
+  {
+    std::vector<std::uint32_t> uids;
+    for (bounds const& box : _everywhere)
+    {
+      if (!box.bounded)
+      {
+        uids.push_back (box.uid);
+      }
+    }
+    return uids;
+  }
+
+  void instance_grid::visit ( std::vector<bounds> const& boxes
+                            , math::ray const& ray
+                            , std::vector<std::uint32_t>& uids
+                            ) const
+  {
+    for (bounds const& box : boxes)
+    {
+      if (!box.bounded || ray.intersect_bounds (box.min, box.max))
+      {
+        uids.push_back (box.uid);
+      }
+    }
+  }
+
+  void instance_grid::candidates (math::ray const& ray, std::vector<std::uint32_t>& uids) const
+  {
+    std::size_t const first_candidate (uids.size());
+
+    visit (_everywhere, ray, uids);
+
+    if (_max_cell.x >= _min_cell.x)
+    {
+      walk (ray, uids);
+    }
+
+    // instances spanning several cells were found more than once
+    std::sort (uids.begin() + first_candidate, uids.end());
+    uids.erase (std::unique (uids.begin() + first_candidate, uids.end()), uids.end());
+  }
+
+  void instance_grid::walk (math::ray const& ray, std::vector<std::uint32_t>& uids) const
+  {
+    math::traverse_grid
+      ( ray
+      , {_min_cell.x * cell_size, _min_y, _min_cell.z * cell_size}
+      , {(_max_cell.x + 1) * cell_size, _max_y, (_max_cell.z + 1) * cell_size}
+      , _max_cell.x - _min_cell.x + 1
+      , _max_cell.z - _min_cell.z + 1
+      , [&] (int x, int z)
+        {
+          auto const boxes (_cells.find (key (_min_cell.x + x, _min_cell.z + z)));
+          if (boxes != _cells.end())
+          {
+            visit (boxes->second, ray, uids);
+          }
+          return false;
+        }
+      );
+  }
+}
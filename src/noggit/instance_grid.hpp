@@ -0,0 +1,82 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#pragma once
+
+#include <math/ray.hpp>
+#include <math/vector_3d.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace noggit
+{
+  //! Uniform grid on the xz plane over the bounding boxes of instances,
+  //! identified by their uid, so a ray only has to be tested against the
+  //! instances in the cells it passes through.
+  //! \note not thread safe, world_model_instances_storage guards it
+  class instance_grid
+  {
+  public:
+    instance_grid() = default;
+
+    instance_grid (instance_grid const&) = delete;
+    instance_grid (instance_grid&&) = delete;
+    instance_grid& operator= (instance_grid const&) = delete;
+    instance_grid& operator= (instance_grid&&) = delete;
+
+    //! replaces the bounds if uid is already stored
+    void insert (std::uint32_t uid, math::vector_3d const& min, math::vector_3d const& max);
+    //! for instances whose bounds aren't known yet, always a candidate
+    void insert_unbounded (std::uint32_t uid);
+    void remove (std::uint32_t uid);
+    void clear();
+
+    //! uids stored without bounds, in no particular order
+    std::vector<std::uint32_t> unbounded() const;
+
+    //! every uid whose bounds may be hit by the ray, each once
+    void candidates (math::ray const&, std::vector<std::uint32_t>& uids) const;
+
+  private:
+    struct cell_index
+    {
+      int x;
+      int z;
+    };
+
+    struct entry
+    {
+      //! [first, last] cells, unused if not in cells
+      cell_index first;
+      cell_index last;
+      bool in_cells;
+    };
+
+    struct bounds
+    {
+      std::uint32_t uid;
+      math::vector_3d min;
+      math::vector_3d max;
+      bool bounded;
+    };
+
+    static std::uint64_t key (int x, int z);
+    cell_index cell_of (float x, float z) const;
+    void visit (std::vector<bounds> const&, math::ray const&, std::vector<std::uint32_t>& uids) const;
+    void walk (math::ray const&, std::vector<std::uint32_t>& uids) const;
+
+    std::unordered_map<std::uint32_t, entry> _entries;
+    //! bounds are copied into every cell to not have to look them up
+    std::unordered_map<std::uint64_t, std::vector<bounds>> _cells;
+    //! unbounded and too large to be put in cells
+    std::vector<bounds> _everywhere;
+
+    //! cells ever used and their height range, traversal is clipped to them
+    cell_index _min_cell = {0, 0};
+    cell_index _max_cell = {-1, -1};
+    float _min_y = 0.f;
+    float _max_y = 0.f;
+  };
+}
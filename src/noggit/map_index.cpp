@@ -11,12 +11,15 @@
   #include <mysql/mysql.h>
 #endif
 #include <noggit/map_index.hpp>
+#include <noggit/thread_pool.hpp>
 #include <noggit/uid_storage.hpp>
 
 #include <QtCore/QSettings>
 
 #include <boost/range/adaptor/map.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <forward_list>
 
 MapIndex::MapIndex (const std::string &pBasename, int map_id, World* world)
@@ -144,10 +147,36 @@ void MapIndex::saveall (World* world)
 
   saveMaxUID();
 
+  std::vector<MapTile*> tiles;
+
   for (MapTile* tile : loaded_tiles())
   {
-    tile->saveTile(world);
-    tile->changed = false;
+    tiles.push_back(tile);
+  }
+
+  save_tiles(tiles, world);
+}
+
+void MapIndex::save_tiles(std::vector<MapTile*> const& tiles, World* world)
+{
+  std::vector<std::vector<char>> contents(tiles.size());
+
+  noggit::thread_pool::instance().parallel_for
+    ( tiles.size()
+    , [&] (std::size_t i)
+      {
+        contents[i] = tiles[i]->serialize(world);
+      }
+    );
+
+  for (std::size_t i = 0; i < tiles.size(); ++i)
+  {
+    tiles[i]->changed = false;
+
+    if (!contents[i].empty())
+    {
+      _tile_writer.write(tiles[i]->filename, std::move(contents[i]));
+    }
   }
 }
 
@@ -316,14 +345,28 @@ void MapIndex::setFlag(bool to, math::vector_3d const& pos, uint32_t flag)
   }
 }
 
-MapTile* MapIndex::loadTile(const tile_index& tile, bool reloading)
+MapTile* MapIndex::loadTile(const tile_index& tile, bool reloading, async_priority priority)
 {
   if (!hasTile(tile))
   {
     return nullptr;
   }
 
-  if (tileLoaded(tile) || tileAwaitingLoading(tile))
+  if (tileAwaitingLoading(tile))
+  {
+    MapTile* adt = mTiles[tile.z][tile.x].tile.get();
+
+    // e.g. a prefetched tile which is needed right now
+    if (priority < adt->loading_priority())
+    {
+      adt->set_loading_priority(priority);
+      AsyncLoader::instance().reprioritize(adt);
+    }
+
+    return adt;
+  }
+
+  if (tileLoaded(tile))
   {
     return mTiles[tile.z][tile.x].tile.get();
   }
@@ -337,20 +380,88 @@ MapTile* MapIndex::loadTile(const tile_index& tile, bool reloading)
     return nullptr;
   }
 
-  mTiles[tile.z][tile.x].tile = std::make_unique<MapTile> (tile.x, tile.z, filename.str(), mBigAlpha, true, use_mclq_green_lava(), reloading, _world);
+  // don't read a previous version of a tile which is still being saved
+  _tile_writer.wait_for(filename.str());
+
+  set_tile (tile, std::make_unique<MapTile> (tile.x, tile.z, filename.str(), mBigAlpha, true, use_mclq_green_lava(), reloading, _world));
 
   MapTile* adt = mTiles[tile.z][tile.x].tile.get();
 
+  adt->set_loading_priority(priority);
   AsyncLoader::instance().queue_for_load(adt);
 
   return adt;
 }
 
+void MapIndex::prefetch_tiles(math::vector_3d const& position, math::vector_3d const& velocity)
+{
+  // how far ahead tiles are requested, in seconds
+  float const prefetch_time = 4.f;
+  float const next_tile_time = 1.f;
+
+  tile_index const current(position);
+  std::vector<tile_index> corridor;
+
+  math::vector_3d const direction(velocity.x, 0.f, velocity.z);
+  float const speed = direction.length();
+
+  // slower than that the 3x3 tiles around the camera are enough
+  if (speed > CHUNKSIZE)
+  {
+    math::vector_3d const forward(direction / speed);
+    math::vector_3d const side(-forward.z, 0.f, forward.x);
+
+    // farther tiles would be unloaded again right away
+    float const reach = std::min(speed * prefetch_time, std::max(_unload_dist - 1, 1) * TILESIZE);
+
+    for (float ahead = TILESIZE / 2.f; ahead <= reach; ahead += TILESIZE / 2.f)
+    {
+      for (float aside : {-TILESIZE, 0.f, TILESIZE})
+      {
+        tile_index const tile(position + forward * ahead + side * aside);
+
+        if (hasTile(tile) && std::find(corridor.begin(), corridor.end(), tile) == corridor.end())
+        {
+          corridor.push_back(tile);
+        }
+      }
+    }
+
+    tile_index const next(position + velocity * next_tile_time);
+
+    if (!(next == current))
+    {
+      loadTile(next);
+    }
+
+    for (tile_index const& tile : corridor)
+    {
+      loadTile(tile, false, async_priority::low);
+    }
+  }
+
+  for (tile_index const& tile : _prefetched_tiles)
+  {
+    bool const still_ahead = std::find(corridor.begin(), corridor.end(), tile) != corridor.end();
+    bool const around_camera = tile.dist(current) < 2.f;
+
+    if (!still_ahead && !around_camera && tileAwaitingLoading(tile)
+       && mTiles[tile.z][tile.x].tile->loading_priority() == async_priority::low
+       && AsyncLoader::instance().cancel(mTiles[tile.z][tile.x].tile.get())
+       )
+    {
+      set_tile(tile, nullptr);
+    }
+  }
+
+  _prefetched_tiles = std::move(corridor);
+}
+
 void MapIndex::reloadTile(const tile_index& tile)
 {
   if (tileLoaded(tile))
   {
-    mTiles[tile.z][tile.x].tile.reset();
+    set_tile(tile, nullptr);
     loadTile(tile, true);
   }
 }
@@ -359,18 +470,37 @@ void MapIndex::unloadTiles(const tile_index& tile)
 {
   if (((clock() / CLOCKS_PER_SEC) - _last_unload_time) > _unload_interval)
   {
-    for (MapTile* adt : loaded_tiles())
+    // unloading changes the list of tiles
+    std::vector<MapTile*> const loaded (loaded_tiles().begin(), loaded_tiles().end());
+
+    for (MapTile* adt : loaded)
     {
       if (tile.dist(adt->index) > _unload_dist)
       {
-        //Only unload adts not marked to save
-        if (!adt->changed.load())
+        //Only unload adts not marked to save nor about to be needed again
+        if (!adt->changed.load() && std::find(_prefetched_tiles.begin(), _prefetched_tiles.end(), adt->index) == _prefetched_tiles.end())
         {
           unloadTile(adt->index);
         }
       }
     }
 
+    // don't keep loading tiles which are out of range by now
+    for (MapTileEntry* entry = _first_entry_with_tile; entry;)
+    {
+      MapTile* adt = entry->tile.get();
+      entry = entry->next;
+
+      if ( !adt->finishedLoading()
+        && tile.dist(adt->index) > _unload_dist
+        && std::find(_prefetched_tiles.begin(), _prefetched_tiles.end(), adt->index) == _prefetched_tiles.end()
+        && AsyncLoader::instance().cancel(adt)
+         )
+      {
+        set_tile(adt->index, nullptr);
+      }
+    }
+
     _last_unload_time = clock() / CLOCKS_PER_SEC;
   }
 }
@@ -380,8 +510,9 @@ void MapIndex::unloadTile(const tile_index& tile)
   // unloads a tile with givn cords
   if (tileLoaded(tile))
   {
-    mTiles[tile.z][tile.x].tile = nullptr;
+    // tile may be the index of the tile being unloaded
     Log << "Unload Tile " << tile.x << "-" << tile.z << std::endl;
+    set_tile(tile, nullptr);
   }
 }
 
@@ -407,7 +538,7 @@ void MapIndex::saveTile(const tile_index& tile, World* world)
 	if (tileLoaded(tile))
 	{
     saveMaxUID();
-		mTiles[tile.z][tile.x].tile->saveTile(world);
+		save_tiles({mTiles[tile.z][tile.x].tile.get()}, world);
 	}
 }
 
@@ -422,14 +553,17 @@ void MapIndex::saveChanged (World* world)
 
   saveMaxUID();
 
+  std::vector<MapTile*> tiles;
+
   for (MapTile* tile : loaded_tiles())
   {
     if (tile->changed.load())
     {
-      tile->saveTile(world);
-      tile->changed = false;
+      tiles.push_back(tile);
     }
   }
+
+  save_tiles(tiles, world);
 }
 
 bool MapIndex::hasAGlobalWMO()
@@ -463,6 +597,68 @@ void MapIndex::setAdt(bool value)
   noadt = value;
 }
 
+std::vector<MapTile*> MapIndex::tiles_in_range (math::vector_3d const& pos, float radius)
+{
+  std::vector<MapTile*> tiles;
+
+  auto const tile_at
+    ( [] (float coordinate)
+      {
+        return static_cast<int> (std::max (0.f, std::min (63.f, std::floor (coordinate / TILESIZE))));
+      }
+    );
+
+  for (int z (tile_at (pos.z - radius)); z <= tile_at (pos.z + radius); ++z)
+  {
+    for (int x (tile_at (pos.x - radius)); x <= tile_at (pos.x + radius); ++x)
+    {
+      tile_index const index (x, z);
+
+      if ( !hasTile (index)
+        || misc::getShortestDist (pos.x, pos.z, x * TILESIZE, z * TILESIZE, TILESIZE) > radius
+         )
+      {
+        continue;
+      }
+
+      if (MapTile* tile = loadTile (index))
+      {
+        tiles.push_back (tile);
+      }
+    }
+  }
+
+  return tiles;
+}
+
+void MapIndex::set_tile (tile_index const& index, std::unique_ptr<MapTile> tile)
+{
+  MapTileEntry& entry (mTiles[index.z][index.x]);
+
+  if (!entry.tile && tile)
+  {
+    entry.previous = nullptr;
+    entry.next = _first_entry_with_tile;
+    if (_first_entry_with_tile)
+    {
+      _first_entry_with_tile->previous = &entry;
+    }
+    _first_entry_with_tile = &entry;
+  }
+  else if (entry.tile && !tile)
+  {
+    (entry.previous ? entry.previous->next : _first_entry_with_tile) = entry.next;
+    if (entry.next)
+    {
+      entry.next->previous = entry.previous;
+    }
+    entry.previous = nullptr;
+    entry.next = nullptr;
+  }
+
+  entry.tile = std::move (tile);
+}
+
 MapTile* MapIndex::getTile(const tile_index& tile) const
 {
   return (tile.is_valid() ? mTiles[tile.z][tile.x].tile.get() : nullptr);
@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <noggit/async_file_writer.hpp>
 #include <noggit/map_enums.hpp>
 #include <noggit/MapHeaders.h>
 #include <noggit/MapTile.h>
@@ -17,6 +18,7 @@
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <vector>
 
 
 enum class uid_fix_status
@@ -36,6 +38,9 @@ private:
   std::unique_ptr<MapTile> tile;
   bool onDisc;
 
+  //! neighbours in MapIndex's list of entries having a tile
+  MapTileEntry* previous = nullptr;
+  MapTileEntry* next = nullptr;
 
   MapTileEntry() : flags(0), tile(nullptr) {}
 
@@ -45,113 +50,80 @@ private:
 class MapIndex
 {
 public:
-  template<bool Load>
-    struct tile_iterator
-      : std::iterator<std::forward_iterator_tag, MapTile*, std::ptrdiff_t, MapTile**, MapTile* const&>
+  //! walks the entries having a tile, skipping the ones still loading
+  struct loaded_tile_iterator
+    : std::iterator<std::forward_iterator_tag, MapTile*, std::ptrdiff_t, MapTile**, MapTile* const&>
   {
-    template<typename Pred>
-      tile_iterator (MapIndex* index, tile_index tile, Pred pred)
-        : _index (index)
-        , _tile (std::move (tile))
-        , _pred (std::move (pred))
+    explicit loaded_tile_iterator (MapTileEntry const* entry = nullptr)
+      : _entry (entry)
     {
-      if (!_pred (_tile, _index->getTile (_tile)))
-      {
-        ++(*this);
-      }
+      skip_loading();
     }
 
-    tile_iterator()
-      : _index (nullptr)
-      , _tile (0, 0)
-      , _pred ([] (tile_index const&, MapTile*) { return false; })
-    {}
-
-    bool operator== (tile_iterator const& other) const
+    bool operator== (loaded_tile_iterator const& other) const
     {
-      return std::tie (_index, _tile) == std::tie (other._index, other._tile);
+      return _entry == other._entry;
     }
-    bool operator!= (tile_iterator const& other) const
+    bool operator!= (loaded_tile_iterator const& other) const
     {
       return !operator== (other);
     }
 
-    tile_iterator& operator++()
+    loaded_tile_iterator& operator++()
     {
-      do
-      {
-        ++_tile.x;
-
-        if (_tile.x == 64)
-        {
-          _tile.x = 0;
-          ++_tile.z;
-
-          if (_tile.z == 64)
-          {
-            _tile.x = 0;
-            _tile.z = 0;
-            _index = nullptr;
-            break;
-          }
-        }
-      }
-      while (!_pred (_tile, _index->getTile (_tile)));
-
+      _entry = _entry->next;
+      skip_loading();
       return *this;
     }
 
-    tile_iterator operator++ (int) const
+    loaded_tile_iterator operator++ (int)
     {
-      tile_iterator it (*this);
-      ++it;
+      loaded_tile_iterator it (*this);
+      ++(*this);
       return it;
     }
 
     MapTile* operator*() const
     {
-      return Load ? _index->loadTile (_tile) : _index->getTile (_tile);
+      return _entry->tile.get();
     }
     MapTile* operator->() const
     {
       return operator*();
     }
 
-    MapIndex* _index;
-    tile_index _tile;
-    std::function<bool (tile_index const&, MapTile*)> _pred;
+  private:
+    void skip_loading()
+    {
+      while (_entry && !_entry->tile->finishedLoading())
+      {
+        _entry = _entry->next;
+      }
+    }
+
+    MapTileEntry const* _entry;
   };
 
-  template<bool Load>
-    auto tiles ( std::function<bool (tile_index const&, MapTile*)> pred
-               = [] (tile_index const&, MapTile*) { return true; }
-               )
+  //! \note don't load or unload tiles while iterating
+  auto loaded_tiles() const
   {
     return boost::make_iterator_range
-      (tile_iterator<Load> {this, {0, 0}, pred}, tile_iterator<Load>{});
+      (loaded_tile_iterator {_first_entry_with_tile}, loaded_tile_iterator{});
   }
 
-  auto loaded_tiles()
-  {
-    return tiles<false>
-      ([] (tile_index const&, MapTile* tile) { return !!tile && tile->finishedLoading(); });
-  }
-
-  auto tiles_in_range (math::vector_3d const& pos, float radius)
-  {
-    return tiles<true>
-      ( [this, pos, radius] (tile_index const& index, MapTile*)
-        {
-          return hasTile(index) && misc::getShortestDist
-            (pos.x, pos.z, index.x * TILESIZE, index.z * TILESIZE, TILESIZE) <= radius;
-        }
-      );
-  }
+  //! existing tiles closer than radius to pos on the xz plane, their
+  //! loading is requested if needed
+  std::vector<MapTile*> tiles_in_range (math::vector_3d const& pos, float radius);
 
   MapIndex(const std::string& pBasename, int map_id, World*);
 
   void enterTile(const tile_index& tile);
-  MapTile *loadTile(const tile_index& tile, bool reloading = false);
+  MapTile *loadTile(const tile_index& tile, bool reloading = false, async_priority priority = async_priority::high);
+
+  //! Requests the tiles along the path the camera is heading to, the
+  //! velocity is in yards per second. Requested tiles the camera turned
+  //! away from are dropped if they haven't been loaded yet.
+  void prefetch_tiles (math::vector_3d const& position, math::vector_3d const& velocity);
 
   void update_model_tile(const tile_index& tile, model_update type, uint32_t uid);
 
@@ -164,6 +136,8 @@ public:
 
   void saveTile(const tile_index& tile, World*);
   void saveChanged (World*);
+  //! number of saved tiles not written to disk yet
+  std::size_t tiles_being_written() const { return _tile_writer.pending(); }
   void reloadTile(const tile_index& tile);
   void unloadTiles(const tile_index& tile);  // unloads all tiles more then x adts away from given
   void unloadTile(const tile_index& tile);  // unload given tile
@@ -212,6 +186,12 @@ public:
 private:
 	uint32_t getHighestGUIDFromFile(const std::string& pFilename) const;
 
+  //! serializes the tiles in parallel, writing them happens in the background
+  void save_tiles (std::vector<MapTile*> const& tiles, World*);
+
+  //! replaces the tile of an entry, keeping the list of entries having one
+  void set_tile (tile_index const&, std::unique_ptr<MapTile>);
+
   bool _uid_fix_all_in_progress = false;
 
   const std::string basename;
@@ -226,6 +206,11 @@ private:
   int _unload_interval;
   int _unload_dist;
 
+  // tiles within the predicted camera path, they aren't unloaded
+  std::vector<tile_index> _prefetched_tiles;
+
+  noggit::async_file_writer _tile_writer;
+
   // Is the WDT telling us to use a different alphamap structure.
   bool mBigAlpha;
   bool mHasAGlobalWMO;
@@ -242,6 +227,8 @@ private:
 
   // Holding all MapTiles there can be in a World.
   MapTileEntry mTiles[64][64];
+  //! entries having a tile, loaded or not, linked through the entries
+  MapTileEntry* _first_entry_with_tile = nullptr;
 
   //! \todo REMOVE!
   World* _world;
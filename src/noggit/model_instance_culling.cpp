@@ -0,0 +1,101 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#include <noggit/model_instance_culling.hpp>
+
+#include <noggit/Model.h>
+#include <noggit/ModelInstance.h>
+
+#include <cmath>
+#include <limits>
+
+namespace noggit
+{
+  void model_instance_culling::update (Model& model, std::vector<ModelInstance*> const& instances)
+  {
+    if ( _model == &model
+       && _generation == model.instances_generation
+       && _instances == instances
+       )
+    {
+      return;
+    }
+
+    _model = &model;
+    _instances = instances;
+
+    for (auto* component : {&_x, &_y, &_z, &_radius, &_max_distance})
+    {
+      component->clear();
+      component->reserve (instances.size());
+    }
+    _transforms.clear();
+    _transforms.reserve (instances.size());
+
+    for (ModelInstance* instance : instances)
+    {
+      // recalculates the extents and thus the size category if needed
+      instance->extents();
+
+      math::vector_3d const pos (instance->get_pos());
+      _x.push_back (pos.x);
+      _y.push_back (pos.y);
+      _z.push_back (pos.z);
+      _radius.push_back (model.rad * instance->scale);
+      _max_distance.push_back ( instance->size_cat < 1.f ? 30.f
+                              : instance->size_cat < 4.f ? 150.f
+                              : instance->size_cat < 25.f ? 300.f
+                              : std::numeric_limits<float>::max()
+                              );
+      _transforms.push_back (instance->transform_matrix_transposed());
+    }
+
+    // read last as extents() may have changed it
+    _generation = model.instances_generation;
+  }
+
+  std::vector<math::matrix_4x4> const& model_instance_culling::cull
+    ( math::frustum const& frustum
+    , float cull_distance
+    , math::vector_3d const& camera
+    , display_mode display
+    )
+  {
+    std::size_t const count (_transforms.size());
+
+    _visible.resize (count);
+    frustum.intersectsSpheres ( _x.data(), _y.data(), _z.data(), _radius.data()
+                              , count, _visible.data()
+                              );
+
+    if (display == display_mode::in_3D)
+    {
+      for (std::size_t i (0); i < count; ++i)
+      {
+        float const dx (_x[i] - camera.x);
+        float const dy (_y[i] - camera.y);
+        float const dz (_z[i] - camera.z);
+        float const dist (std::sqrt (dx * dx + dy * dy + dz * dz) - _radius[i]);
+        _visible[i] &= dist < cull_distance && dist <= _max_distance[i];
+      }
+    }
+    else
+    {
+      for (std::size_t i (0); i < count; ++i)
+      {
+        float const dist (std::abs (_y[i] - camera.y) - _radius[i]);
+        _visible[i] &= dist < cull_distance && dist <= _max_distance[i];
+      }
+    }
+
+    _visible_transforms.clear();
+    for (std::size_t i (0); i < count; ++i)
+    {
+      if (_visible[i])
+      {
+        _visible_transforms.push_back (_transforms[i]);
+      }
+    }
+
+    return _visible_transforms;
+  }
+}
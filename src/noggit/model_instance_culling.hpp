@@ -0,0 +1,59 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#pragma once
+
+#include <math/frustum.hpp>
+#include <math/matrix_4x4.hpp>
+#include <math/vector_3d.hpp>
+#include <noggit/tool_enums.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Model;
+class ModelInstance;
+
+namespace noggit
+{
+  //! Contiguous copy of the bounding spheres and transformations of the
+  //! instances of one model, so culling them doesn't have to visit every
+  //! ModelInstance each frame. Rebuilt when the instance list changes or
+  //! an instance of the model recalculated its extents.
+  class model_instance_culling
+  {
+  public:
+    model_instance_culling() = default;
+
+    model_instance_culling (model_instance_culling const&) = delete;
+    model_instance_culling (model_instance_culling&&) = default;
+    model_instance_culling& operator= (model_instance_culling const&) = delete;
+    model_instance_culling& operator= (model_instance_culling&&) = default;
+
+    //! \note model has to be loaded
+    void update (Model& model, std::vector<ModelInstance*> const& instances);
+
+    //! transposed transformations of the visible instances, valid until
+    //! the next call
+    std::vector<math::matrix_4x4> const& cull ( math::frustum const&
+                                              , float cull_distance
+                                              , math::vector_3d const& camera
+                                              , display_mode
+                                              );
+
+  private:
+    Model const* _model = nullptr;
+    std::size_t _generation = 0;
+    std::vector<ModelInstance*> _instances;
+
+    std::vector<float> _x, _y, _z;
+    //! model radius * instance scale
+    std::vector<float> _radius;
+    //! small models are culled earlier depending on their size category
+    std::vector<float> _max_distance;
+    std::vector<math::matrix_4x4> _transforms;
+
+    std::vector<std::uint8_t> _visible;
+    std::vector<math::matrix_4x4> _visible_transforms;
+  };
+}
@@ -37,25 +37,23 @@ namespace noggit
     {
       std::string const normalized (_normalize (filename));
 
+      T* obj;
+
       {
+        // counting and creating has to happen at once: as soon as the count
+        // is non-zero, concurrent callers expect the element to exist
         boost::mutex::scoped_lock const lock(_mutex);
 
-        if ([&] { return _counts[normalized]++; }())
+        if (_counts[normalized]++)
         {
           return &_elements.at (normalized);
         }
+
+        obj = &_elements.emplace ( std::piecewise_construct
+                                 , std::forward_as_tuple (normalized)
+                                 , std::forward_as_tuple (normalized, args...)
+                                 ).first->second;
       }
-        
-
-      T* const obj ( [&]
-                     {
-                       boost::mutex::scoped_lock const lock(_mutex);
-                       return &_elements.emplace ( std::piecewise_construct
-                                                 , std::forward_as_tuple (normalized)
-                                                 , std::forward_as_tuple (normalized, args...)
-                                                 ).first->second;
-                     }()
-                   );
 
       AsyncLoader::instance().queue_for_load(static_cast<AsyncObject*>(obj));
 
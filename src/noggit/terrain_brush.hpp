@@ -0,0 +1,369 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#pragma once
+
+#include <noggit/tool_enums.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define NOGGIT_TERRAIN_BRUSH_SSE
+  #include <emmintrin.h>
+#endif
+
+//! Brushes applied to the vertices of a chunk given as separate arrays of
+//! x, z and the edited values, so four vertices can be done at once. The
+//! brush type is resolved once per call, the kernels are instantiated for
+//! every type and are written once for both float and four floats.
+namespace noggit
+{
+  namespace terrain_brush
+  {
+    namespace detail
+    {
+      inline float load (float const* p, float) { return *p; }
+      inline void store (float* p, float v) { *p = v; }
+      inline float select (bool mask, float a, float b) { return mask ? a : b; }
+      inline bool both (bool a, bool b) { return a && b; }
+      inline bool any (bool mask) { return mask; }
+      inline float abs (float v) { return std::abs (v); }
+      inline float sqrt (float v) { return std::sqrt (v); }
+      inline float min (float a, float b) { return std::min (a, b); }
+      inline float max (float a, float b) { return std::max (a, b); }
+      //! rounded to the nearest integer and 2^that
+      inline float round (float v) { return std::nearbyint (v); }
+      inline float exp2_of_integer (float n) { return std::ldexp (1.f, static_cast<int> (n)); }
+
+#ifdef NOGGIT_TERRAIN_BRUSH_SSE
+      struct mask4
+      {
+        __m128 v;
+      };
+
+      struct float4
+      {
+        float4 (__m128 value) : v (value) {}
+        float4 (float value) : v (_mm_set1_ps (value)) {}
+
+        __m128 v;
+      };
+
+      inline float4 operator+ (float4 a, float4 b) { return _mm_add_ps (a.v, b.v); }
+      inline float4 operator- (float4 a, float4 b) { return _mm_sub_ps (a.v, b.v); }
+      inline float4 operator* (float4 a, float4 b) { return _mm_mul_ps (a.v, b.v); }
+      inline float4 operator/ (float4 a, float4 b) { return _mm_div_ps (a.v, b.v); }
+      inline float4 operator- (float4 a) { return _mm_sub_ps (_mm_setzero_ps(), a.v); }
+      inline mask4 operator< (float4 a, float4 b) { return {_mm_cmplt_ps (a.v, b.v)}; }
+      inline mask4 operator<= (float4 a, float4 b) { return {_mm_cmple_ps (a.v, b.v)}; }
+      inline mask4 operator>= (float4 a, float4 b) { return {_mm_cmpge_ps (a.v, b.v)}; }
+
+      inline float4 load (float const* p, float4) { return _mm_loadu_ps (p); }
+      inline void store (float* p, float4 v) { _mm_storeu_ps (p, v.v); }
+      inline float4 select (mask4 mask, float4 a, float4 b)
+      {
+        return _mm_or_ps (_mm_and_ps (mask.v, a.v), _mm_andnot_ps (mask.v, b.v));
+      }
+      inline mask4 both (mask4 a, mask4 b) { return {_mm_and_ps (a.v, b.v)}; }
+      inline bool any (mask4 mask) { return _mm_movemask_ps (mask.v) != 0; }
+      inline float4 abs (float4 v) { return _mm_andnot_ps (_mm_set1_ps (-0.f), v.v); }
+      inline float4 sqrt (float4 v) { return _mm_sqrt_ps (v.v); }
+      inline float4 min (float4 a, float4 b) { return _mm_min_ps (a.v, b.v); }
+      inline float4 max (float4 a, float4 b) { return _mm_max_ps (a.v, b.v); }
+      inline float4 round (float4 v) { return _mm_cvtepi32_ps (_mm_cvtps_epi32 (v.v)); }
+      inline float4 exp2_of_integer (float4 n)
+      {
+        return _mm_castsi128_ps
+          (_mm_slli_epi32 (_mm_add_epi32 (_mm_cvtps_epi32 (n.v), _mm_set1_epi32 (127)), 23));
+      }
+#endif
+
+      //! e^a for a <= 0, results below the normal range are flushed to 0
+      template<typename T>
+        T exp (T a)
+      {
+        float const lowest (-87.f);
+        T const clamped (max (a, lowest));
+        T const n (round (clamped * 1.44269504f));
+        // ln 2 split in two so r stays exact
+        T const r (clamped - n * 0.693145752f - n * 1.42860677e-6f);
+        T const p
+          (1.f + r * (1.f + r * (0.5f + r * (1.f / 6.f + r * (1.f / 24.f + r * (1.f / 120.f + r * (1.f / 720.f)))))));
+        return select (a < lowest, T (0.f), p * exp2_of_integer (n));
+      }
+
+      //! cos (t) for t in [0, 1], as t is relative to the radius
+      template<typename T>
+        T cos_within_radius (T t)
+      {
+        T const s (t * t);
+        return 1.f + s * (-1.f / 2.f + s * (1.f / 24.f + s * (-1.f / 720.f + s * (1.f / 40320.f + s * (-1.f / 3628800.f)))));
+      }
+
+      //! calls kernel (T{}, i) for the vertices i, four at a time if possible
+      template<typename Kernel>
+        bool for_all_vertices (std::size_t count, Kernel&& kernel)
+      {
+        bool changed (false);
+        std::size_t i (0);
+
+#ifdef NOGGIT_TERRAIN_BRUSH_SSE
+        for (; i + 4 <= count; i += 4)
+        {
+          changed = kernel (float4 (0.f), i) || changed;
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+          changed = kernel (0.f, i) || changed;
+        }
+
+        return changed;
+      }
+
+      //! adds change (dist) to the heights within the radius
+      template<typename Change>
+        bool raise ( float const* x, float const* z, float* y, std::size_t count
+                   , float center_x, float center_z, float radius
+                   , Change&& change
+                   )
+      {
+        return for_all_vertices
+          ( count
+          , [&] (auto zero, std::size_t i)
+            {
+              using T = decltype (zero);
+              T const dx (load (x + i, zero) - center_x);
+              T const dz (load (z + i, zero) - center_z);
+              T const dist (sqrt (dx * dx + dz * dz));
+              auto const inside (dist < T (radius));
+
+              store (y + i, load (y + i, zero) + select (inside, change (dist), zero));
+              return any (inside);
+            }
+          );
+      }
+    }
+
+    //! MapChunk::changeTerrain: raises the heights y of the vertices at
+    //! (x, z) around the center by change, scaled by the falloff of the
+    //! eTerrainType brush. Unknown brush types don't change anything.
+    //! \returns whether any vertex was within the brush
+    inline bool change_heights ( int brush
+                               , float const* x, float const* z, float* y, std::size_t count
+                               , float center_x, float center_z
+                               , float change, float radius, float inner_radius
+                               )
+    {
+      using namespace detail;
+
+      switch (brush)
+      {
+      case eTerrainType_Flat:
+        return raise ( x, z, y, count, center_x, center_z, radius
+                     , [&] (auto dist) { return decltype (dist) (change); }
+                     );
+      case eTerrainType_Linear:
+        return raise ( x, z, y, count, center_x, center_z, radius
+                     , [&] (auto dist) { return change * (1.0f - dist * (1.0f - inner_radius) / radius); }
+                     );
+      case eTerrainType_Smooth:
+        return raise ( x, z, y, count, center_x, center_z, radius
+                     , [&] (auto dist) { return change / (1.0f + dist / radius); }
+                     );
+      case eTerrainType_Polynom:
+        return raise ( x, z, y, count, center_x, center_z, radius
+                     , [&] (auto dist)
+                       {
+                         auto const t (dist / radius);
+                         return change * (t * t + t + 1.0f);
+                       }
+                     );
+      case eTerrainType_Trigo:
+        return raise ( x, z, y, count, center_x, center_z, radius
+                     , [&] (auto dist) { return change * cos_within_radius (dist / radius); }
+                     );
+      case eTerrainType_Gaussian:
+      {
+        // 1 / (2 * 0.39^2), the inner part is as high as its border
+        float const spread (1.f / (2.f * 0.39f * 0.39f));
+        float const inner_change (change * std::exp (-inner_radius * inner_radius * spread));
+
+        return raise ( x, z, y, count, center_x, center_z, radius
+                     , [&] (auto dist)
+                       {
+                         using T = decltype (dist);
+                         auto const t (dist / radius);
+                         return select ( dist < T (radius * inner_radius)
+                                       , T (inner_change)
+                                       , change * exp (-(t * t) * spread)
+                                       );
+                       }
+                     );
+      }
+      case eTerrainType_Quadra:
+      {
+        float const half_size (std::abs (radius / 2));
+
+        return for_all_vertices
+          ( count
+          , [&] (auto zero, std::size_t i)
+            {
+              using T = decltype (zero);
+              T const dx (load (x + i, zero) - center_x);
+              T const dz (load (z + i, zero) - center_z);
+              T const dist (sqrt (dx * dx + dz * dz));
+              auto const inside (both (abs (dx) < T (half_size), abs (dz) < T (half_size)));
+
+              store ( y + i
+                    , load (y + i, zero)
+                    + select (inside, change * (1.0f - dist * inner_radius / radius), zero)
+                    );
+              return any (inside);
+            }
+          );
+      }
+      default:
+        return false;
+      }
+    }
+
+    //! MapChunk::flattenTerrain: moves the heights y within the radius
+    //! towards the plane through origin rising by slope along direction,
+    //! by a ratio depending on the eFlattenType brush. Vertices above the
+    //! plane are only moved if lower is set, ones below if raise is set.
+    //! \returns whether any vertex was moved
+    inline bool flatten_heights ( int brush
+                                , float const* x, float const* z, float* y, std::size_t count
+                                , float center_x, float center_z
+                                , float remain, float radius
+                                , bool raise, bool lower
+                                , float origin_x, float origin_y, float origin_z
+                                , float direction_x, float direction_z, float slope
+                                )
+    {
+      using namespace detail;
+
+      // pow (remain, 1 + t) == remain * e^(t * ln (remain))
+      float const log_remain (remain > 0.f ? std::log (remain) : 0.f);
+
+      auto const flatten
+        ( [&] (auto ratio)
+          {
+            return for_all_vertices
+              ( count
+              , [&] (auto zero, std::size_t i)
+                {
+                  using T = decltype (zero);
+                  T const vx (load (x + i, zero));
+                  T const vz (load (z + i, zero));
+                  T const vy (load (y + i, zero));
+                  T const dx (vx - center_x);
+                  T const dz (vz - center_z);
+                  T const dist (sqrt (dx * dx + dz * dz));
+                  T const target
+                    (origin_y + ((vx - origin_x) * direction_x + (vz - origin_z) * direction_z) * slope);
+
+                  auto apply (dist < T (radius));
+                  if (!lower)
+                  {
+                    apply = both (apply, target >= vy);
+                  }
+                  if (!raise)
+                  {
+                    apply = both (apply, target <= vy);
+                  }
+
+                  store (y + i, select (apply, ratio (dist, vy, target), vy));
+                  return any (apply);
+                }
+              );
+          }
+        );
+
+      auto const interpolate
+        ( [] (auto percentage, auto start, auto end)
+          {
+            return start * (1.0f - percentage) + end * percentage;
+          }
+        );
+
+      switch (brush)
+      {
+      case eFlattenType_Flat:
+        return flatten ( [&] (auto, auto vy, auto target)
+                         {
+                           return interpolate (decltype (vy) (remain), vy, target);
+                         }
+                       );
+      case eFlattenType_Linear:
+        return flatten ( [&] (auto dist, auto vy, auto target)
+                         {
+                           return interpolate (remain * (1.f - dist / radius), vy, target);
+                         }
+                       );
+      case eFlattenType_Smooth:
+        return flatten ( [&] (auto dist, auto vy, auto target)
+                         {
+                           using T = decltype (dist);
+                           T const ratio
+                             (remain > 0.f ? remain * exp (dist / radius * log_remain) : T (0.f));
+                           return interpolate (ratio, vy, target);
+                         }
+                       );
+      case eFlattenType_Origin:
+        return flatten ( [&] (auto, auto vy, auto)
+                         {
+                           return decltype (vy) (origin_y);
+                         }
+                       );
+      default:
+        return false;
+      }
+    }
+
+    //! MapChunk::ChangeMCCV: blends the colors (r, g, b) of the vertices
+    //! within the radius towards the target by change at the center down
+    //! to 0 at the border, clamped to [0, 2].
+    //! \returns whether any vertex was within the brush
+    inline bool blend_colors ( float const* x, float const* z
+                             , float* r, float* g, float* b, std::size_t count
+                             , float center_x, float center_z
+                             , float change, float radius
+                             , float target_r, float target_g, float target_b
+                             )
+    {
+      using namespace detail;
+
+      return for_all_vertices
+        ( count
+        , [&] (auto zero, std::size_t i)
+          {
+            using T = decltype (zero);
+            T const dx (load (x + i, zero) - center_x);
+            T const dz (load (z + i, zero) - center_z);
+            T const dist (sqrt (dx * dx + dz * dz));
+            auto const inside (dist <= T (radius));
+            T const edit (change * (1.0f - dist / radius));
+
+            auto const blend
+              ( [&] (float* channel, float target)
+                {
+                  T const value (load (channel + i, zero));
+                  T const blended (min (max (value + (target - value) * edit, 0.0f), 2.0f));
+                  store (channel + i, select (inside, blended, value));
+                }
+              );
+
+            blend (r, target_r);
+            blend (g, target_g);
+            blend (b, target_b);
+
+            return any (inside);
+          }
+        );
+    }
+  }
+}
@@ -9,10 +9,223 @@
 #include <noggit/texture_set.hpp>
 
 #include <algorithm>    // std::min
+#include <cmath>
 #include <iostream>     // std::cout
+#include <limits>
 
 #include <boost/utility/in_place_factory.hpp>
 
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define NOGGIT_ALPHA_PAINTING_SSE
+  #include <emmintrin.h>
+#endif
+
+namespace
+{
+  //! [first, last) texels of a row
+  struct texel_span
+  {
+    int first;
+    int last;
+  };
+
+  //! texels of the row whose center is within radius of (x, z), with the
+  //! same distance test as when checking every texel of the chunk
+  texel_span texels_in_circle (int row, float xbase, float zbase, float x, float z, float radius)
+  {
+    float const center_z (zbase + (row + 0.5f) * TEXDETAILSIZE);
+    float const dz (center_z - z);
+
+    if (std::abs (dz) > radius)
+    {
+      return {0, 0};
+    }
+
+    auto const inside ([&] (int i)
+    {
+      return misc::dist (x, z, xbase + (i + 0.5f) * TEXDETAILSIZE, center_z) <= radius;
+    });
+    auto const texel_at ([&] (float pos)
+    {
+      return static_cast<int> (std::max (0.f, std::min (64.f, (pos - xbase) / TEXDETAILSIZE - 0.5f)));
+    });
+
+    // one texel wider than needed, rounding may put the estimate off by one
+    float const half_width (std::sqrt (radius * radius - dz * dz));
+    texel_span span {texel_at (x - half_width), std::min (64, texel_at (x + half_width) + 2)};
+
+    while (span.first < span.last && !inside (span.first))
+    {
+      ++span.first;
+    }
+    while (span.last > span.first && !inside (span.last - 1))
+    {
+      --span.last;
+    }
+
+    return span;
+  }
+
+  //! Brush::getValue() without branches, dist is at most the radius
+  struct brush_falloff
+  {
+    brush_falloff (Brush const& brush)
+      : radius (brush.getRadius())
+    {
+      float const outer (radius - brush.getHardness() * radius);
+      inverse_outer = outer > 0.f ? 1.f / outer : std::numeric_limits<float>::max();
+    }
+
+    float operator() (float dist) const
+    {
+      return std::min (1.f, std::max (0.f, (radius - dist) * inverse_outer));
+    }
+
+    float radius;
+    float inverse_outer;
+  };
+
+  //! moves the alpha of the target layer towards strength and takes the
+  //! difference from the other layers in proportion to their alpha
+  inline bool paint_texel ( float* const* layers
+                          , int layer_count
+                          , int target
+                          , std::size_t offset
+                          , float falloff
+                          , float strength
+                          , float pressure
+                          )
+  {
+    float const current_alpha (layers[target][offset]);
+
+    if (misc::float_equals (current_alpha, strength))
+    {
+      return false;
+    }
+
+    float const sum_other_alphas (1.f - current_alpha);
+    float const alpha_change ((strength - current_alpha) * pressure * falloff);
+    // the other layers are all empty if the target is full
+    float const scale (sum_other_alphas > 0.f ? alpha_change / sum_other_alphas : 0.f);
+
+    for (int layer (0); layer < layer_count; ++layer)
+    {
+      if (layer == target)
+      {
+        layers[layer][offset] += alpha_change;
+      }
+      else
+      {
+        layers[layer][offset] -= layers[layer][offset] * scale;
+      }
+    }
+
+    return true;
+  }
+
+  //! paint_texel() for a span of texels of a row, layers point to the
+  //! start of the row and the distance to the brush at (x, z) is
+  //! computed like in texels_in_circle()
+  bool paint_texels ( float* const* layers
+                    , int layer_count
+                    , int target
+                    , int row
+                    , texel_span span
+                    , float xbase
+                    , float zbase
+                    , float x
+                    , float z
+                    , brush_falloff const& falloff
+                    , float strength
+                    , float pressure
+                    )
+  {
+    bool changed (false);
+    int i (span.first);
+    float const dz ((zbase + (row + 0.5f) * TEXDETAILSIZE) - z);
+
+#ifdef NOGGIT_ALPHA_PAINTING_SSE
+    __m128 const zero (_mm_setzero_ps());
+    __m128 const one (_mm_set1_ps (1.f));
+    __m128 const epsilon (_mm_set1_ps (std::numeric_limits<float>::epsilon()));
+    __m128 const abs_mask (_mm_castsi128_ps (_mm_set1_epi32 (0x7fffffff)));
+    __m128 const radius (_mm_set1_ps (falloff.radius));
+    __m128 const inverse_outer (_mm_set1_ps (falloff.inverse_outer));
+    __m128 const strength4 (_mm_set1_ps (strength));
+    __m128 const pressure4 (_mm_set1_ps (pressure));
+    __m128 const dz2 (_mm_set1_ps (dz * dz));
+    __m128 const texel_size (_mm_set1_ps (TEXDETAILSIZE));
+    __m128 const xbase4 (_mm_set1_ps (xbase));
+    __m128 const x4 (_mm_set1_ps (x));
+    __m128 const texel_center (_mm_setr_ps (0.5f, 1.5f, 2.5f, 3.5f));
+
+    int painted (0);
+
+    for (; i + 4 <= span.last; i += 4)
+    {
+      std::size_t const offset (i);
+
+      __m128 const index (_mm_add_ps (_mm_set1_ps (static_cast<float> (i)), texel_center));
+      __m128 const dx (_mm_sub_ps (_mm_add_ps (xbase4, _mm_mul_ps (index, texel_size)), x4));
+      __m128 const dist (_mm_sqrt_ps (_mm_add_ps (_mm_mul_ps (dx, dx), dz2)));
+      __m128 const value
+        (_mm_min_ps (one, _mm_max_ps (zero, _mm_mul_ps (_mm_sub_ps (radius, dist), inverse_outer))));
+
+      __m128 const current_alpha (_mm_loadu_ps (layers[target] + offset));
+
+      // !misc::float_equals (current_alpha, strength)
+      __m128 const tolerance
+        (_mm_mul_ps (_mm_max_ps (one, _mm_max_ps (current_alpha, strength4)), epsilon));
+      __m128 const paint
+        (_mm_cmpnlt_ps (_mm_and_ps (_mm_sub_ps (current_alpha, strength4), abs_mask), tolerance));
+
+      __m128 const alpha_change
+        ( _mm_and_ps ( paint
+                     , _mm_mul_ps (_mm_mul_ps (_mm_sub_ps (strength4, current_alpha), pressure4), value)
+                     )
+        );
+      __m128 const sum_other_alphas (_mm_sub_ps (one, current_alpha));
+      __m128 const scale
+        ( _mm_and_ps ( _mm_cmpgt_ps (sum_other_alphas, zero)
+                     , _mm_div_ps (alpha_change, sum_other_alphas)
+                     )
+        );
+
+      for (int layer (0); layer < layer_count; ++layer)
+      {
+        float* alpha (layers[layer] + offset);
+
+        if (layer == target)
+        {
+          _mm_storeu_ps (alpha, _mm_add_ps (current_alpha, alpha_change));
+        }
+        else
+        {
+          __m128 const a (_mm_loadu_ps (alpha));
+          _mm_storeu_ps (alpha, _mm_sub_ps (a, _mm_mul_ps (a, scale)));
+        }
+      }
+
+      painted |= _mm_movemask_ps (paint);
+    }
+
+    changed = painted != 0;
+#endif
+
+    for (; i < span.last; ++i)
+    {
+      float const dx ((xbase + (i + 0.5f) * TEXDETAILSIZE) - x);
+      float const dist (std::sqrt (dx * dx + dz * dz));
+
+      changed |= paint_texel ( layers, layer_count, target, i
+                             , falloff (dist), strength, pressure
+                             );
+    }
+
+    return changed;
+  }
+}
+
 TextureSet::TextureSet (MapChunkHeader const& header, MPQFile* f, size_t base, MapTile* tile, bool use_big_alphamaps, bool do_not_fix_alpha_map, bool do_not_convert_alphamaps)
   : nTextures(header.nLayers)
   , _do_not_convert_alphamaps(do_not_convert_alphamaps)
@@ -59,6 +272,11 @@ TextureSet::TextureSet (MapChunkHeader const& header, MPQFile* f, size_t base, M
   }
 }
 
+TextureSet::~TextureSet()
+{
+  discard_temporary_alphamaps();
+}
+
 int TextureSet::addTexture (scoped_blp_texture_reference texture)
 {
   int texLevel = -1;
@@ -79,7 +297,7 @@ int TextureSet::addTexture (scoped_blp_texture_reference texture)
     if (tmp_edit_values && nTextures == 1)
     {
       // default values for the layer 0 are 255 (uint8) or 1.f (float) !
-      tmp_edit_values.get()[0].fill(1.f);
+      (*tmp_edit_values)[0].fill(tmp_edit_alpha_values::from_float(1.f));
     }
   }
 
@@ -189,7 +407,7 @@ void TextureSet::eraseTextures()
   _need_amap_update = true;
   _need_lod_texture_map_update = true;
 
-  tmp_edit_values = boost::none;
+  discard_temporary_alphamaps();
 }
 
 void TextureSet::eraseTexture(size_t id)
@@ -210,7 +428,7 @@ void TextureSet::eraseTexture(size_t id)
 
     if (tmp_edit_values)
     {
-      tmp_edit_values.get()[i].swap(tmp_edit_values.get()[i+1]);
+      (*tmp_edit_values)[i].swap((*tmp_edit_values)[i+1]);
     }
 
     _layers_info[i] = _layers_info[i + 1];
@@ -221,6 +439,9 @@ void TextureSet::eraseTexture(size_t id)
     alphamaps[nTextures - 2] = boost::none;
   }
 
+  // may run on a worker thread which can't destroy the gl texture if this
+  // was its last reference
+  _erased_textures.emplace_back(std::move(textures[id]));
   textures.erase(textures.begin()+id);
   nTextures--;
 
@@ -230,13 +451,18 @@ void TextureSet::eraseTexture(size_t id)
   // set the default values for the temporary alphamap too
   if (tmp_edit_values)
   {
-    tmp_edit_values.get()[nTextures].fill(0.f);
+    (*tmp_edit_values)[nTextures].fill(0);
   }
 
   _need_amap_update = true;
   _need_lod_texture_map_update = true;
 }
 
+void TextureSet::release_erased_textures()
+{
+  _erased_textures.clear();
+}
+
 bool TextureSet::canPaintTexture(scoped_blp_texture_reference const& texture)
 {
   if (nTextures)
@@ -292,13 +518,13 @@ bool TextureSet::eraseUnusedTextures()
 
   if (tmp_edit_values)
   {
-    auto& amaps = tmp_edit_values.get();
+    auto& amaps = *tmp_edit_values;
 
     for (int i = 0; i < 4096 && visible_tex.size() < nTextures; ++i)
     {
       for (int layer = 0; layer < nTextures; ++layer)
       {
-        if (amaps[layer][i] > 0.f)
+        if (amaps[layer][i] > 0)
         {
           visible_tex.emplace(i);
         }
@@ -374,7 +600,7 @@ bool TextureSet::paintTexture(float xbase, float zbase, float x, float z, Brush*
 {
   bool changed = false;
 
-  float zPos, xPos, dist, radius;
+  float radius;
 
   int tex_layer = get_texture_index_or_add (std::move (texture), strength);
 
@@ -391,46 +617,47 @@ bool TextureSet::paintTexture(float xbase, float zbase, float x, float z, Brush*
   }
 
   create_temporary_alphamaps_if_needed();
-  auto& amaps = tmp_edit_values.get();
+  auto& amaps = *tmp_edit_values;
 
-  zPos = zbase;
+  std::array<std::array<float, 64>, 4> row;
+  float* const layers[4] = {row[0].data(), row[1].data(), row[2].data(), row[3].data()};
+  brush_falloff const falloff (*brush);
 
+  // only the texels under the brush are visited, a row at a time, and
+  // painted in float
   for (int j = 0; j < 64; j++)
   {
-    xPos = xbase;
-    for (int i = 0; i < 64; ++i)
+    texel_span const span = texels_in_circle(j, xbase, zbase, x, z, radius);
+
+    if (span.first == span.last)
     {
-      dist = misc::dist(x, z, xPos + TEXDETAILSIZE / 2.0f, zPos + TEXDETAILSIZE / 2.0f);
+      continue;
+    }
 
-      if (dist<=radius)
+    for (int layer = 0; layer < nTextures; ++layer)
+    {
+      for (int i = span.first; i < span.last; ++i)
       {
-        std::size_t offset = i + 64 * j;
-
-        float current_alpha = amaps[tex_layer][i + 64 * j];
-        float sum_other_alphas = 1.f - current_alpha;
-        float alpha_change = (strength - current_alpha)* pressure * brush->getValue(dist);
+        row[layer][i] = tmp_edit_alpha_values::to_float(amaps[layer][j * 64 + i]);
+      }
+    }
 
-        if (!misc::float_equals(current_alpha, strength))
+    if (paint_texels ( layers, nTextures, tex_layer, j, span
+                     , xbase, zbase, x, z
+                     , falloff, strength, pressure
+                     )
+       )
+    {
+      for (int layer = 0; layer < nTextures; ++layer)
+      {
+        for (int i = span.first; i < span.last; ++i)
         {
-          for (int layer = 0; layer < nTextures; ++layer)
-          {
-            if (layer == tex_layer)
-            {
-              amaps[layer][offset] += alpha_change;
-            }
-            else
-            {
-              amaps[layer][offset] -= alpha_change * (amaps[layer][offset] / sum_other_alphas);
-            }
-          }
-
-          changed = true;
+          amaps[layer][j * 64 + i] = tmp_edit_alpha_values::from_float(row[layer][i]);
         }
       }
 
-      xPos += TEXDETAILSIZE;
+      changed = true;
     }
-    zPos += TEXDETAILSIZE;
   }
 
   if (!changed)
@@ -472,7 +699,6 @@ bool TextureSet::replace_texture( float xbase
 
   bool changed = false;
   int old_tex_level = -1, new_tex_level = -1;
-  float x_pos, z_pos = zbase;
 
   for (int i=0; i<nTextures; ++i)
   {
@@ -502,29 +728,22 @@ bool TextureSet::replace_texture( float xbase
   }
 
   create_temporary_alphamaps_if_needed();
-  auto& amap = tmp_edit_values.get();
+  auto& amap = *tmp_edit_values;
+
+  std::uint16_t* const old_alpha = amap[old_tex_level].data();
+  std::uint16_t* const new_alpha = amap[new_tex_level].data();
 
   for (int j = 0; j < 64; j++)
   {
-    x_pos = xbase;
-    for (int i = 0; i < 64; ++i)
-    {
-      dist = misc::dist(x, z, x_pos + TEXDETAILSIZE / 2.0f, z_pos + TEXDETAILSIZE / 2.0f);
-
-      if (dist <= radius)
-      {
-        int offset = j * 64 + i;
+    texel_span const span = texels_in_circle(j, xbase, zbase, x, z, radius);
 
-        amap[new_tex_level][offset] += amap[old_tex_level][offset];
-        amap[old_tex_level][offset] = 0.f;
-
-        changed = true;
-      }
-
-      x_pos += TEXDETAILSIZE;
+    for (int offset = j * 64 + span.first; offset < j * 64 + span.last; ++offset)
+    {
+      new_alpha[offset] = static_cast<std::uint16_t>(std::min(0xffff, new_alpha[offset] + old_alpha[offset]));
+      old_alpha[offset] = 0;
     }
 
-    z_pos += TEXDETAILSIZE;
+    changed |= span.first < span.last;
   }
 
   if (changed)
@@ -772,11 +991,11 @@ void TextureSet::merge_layers(size_t id1, size_t id2)
 
   create_temporary_alphamaps_if_needed();
 
-  auto& amap = tmp_edit_values.get();
+  auto& amap = *tmp_edit_values;
 
   for (int i = 0; i < 64 * 64; ++i)
   {
-    amap[id1][i] += amap[id2][i];
+    amap[id1][i] = static_cast<std::uint16_t>(std::min(0xffff, amap[id1][i] + amap[id2][i]));
     // no need to set the id alphamap to 0, it'll be done in "eraseTexture(id2)"
   }
 
@@ -816,8 +1035,8 @@ void TextureSet::bind_alpha(std::size_t id)
     {
       if (tmp_edit_values)
       {
-        std::vector<float> amap(3 * 64 * 64);
-        auto& tmp_amaps = tmp_edit_values.get();
+        std::vector<std::uint16_t> amap(3 * 64 * 64);
+        auto& tmp_amaps = *tmp_edit_values;
 
         for (int i = 0; i < 64 * 64; ++i)
         {
@@ -827,7 +1046,7 @@ void TextureSet::bind_alpha(std::size_t id)
           }
         }
 
-        gl.texImage2D(GL_TEXTURE_2D, 0, GL_RGB, 64, 64, 0, GL_RGB, GL_FLOAT, amap.data());
+        gl.texImage2D(GL_TEXTURE_2D, 0, GL_RGB, 64, 64, 0, GL_RGB, GL_UNSIGNED_SHORT, amap.data());
       }
       else
       {
@@ -931,23 +1150,15 @@ uint8_t TextureSet::sum_alpha(size_t offset) const
   return sum;
 }
 
-namespace
-{
-  inline std::uint8_t float_alpha_to_uint8(float a)
-  {
-    return static_cast<std::uint8_t>(std::max(0.f, std::min(255.f, std::round(a))));
-  }
-}
-
 bool TextureSet::apply_alpha_changes()
 {
   if (!tmp_edit_values || nTextures < 2)
   {
-    tmp_edit_values = boost::none;
+    discard_temporary_alphamaps();
     return false;
   }
 
-  auto& new_amaps = tmp_edit_values.get();
+  auto& new_amaps = *tmp_edit_values;
 
   for (int alpha_layer = 0; alpha_layer < nTextures - 1; ++alpha_layer)
   {
@@ -955,7 +1166,7 @@ bool TextureSet::apply_alpha_changes()
 
     for (int i = 0; i < 64 * 64; ++i)
     {
-      values[i] = float_alpha_to_uint8(new_amaps[alpha_layer + 1][i] * 255.f);
+      values[i] = tmp_edit_alpha_values::to_uint8(new_amaps[alpha_layer + 1][i]);
     }
 
     alphamaps[alpha_layer]->setAlpha(values.data());
@@ -964,34 +1175,116 @@ bool TextureSet::apply_alpha_changes()
   _need_amap_update = true;
   _need_lod_texture_map_update = true;
 
-  tmp_edit_values = boost::none;
+  discard_temporary_alphamaps();
 
   return true;
 }
 
+void TextureSet::save_state(noggit::state_writer& writer) const
+{
+  writer.write(static_cast<std::uint32_t>(nTextures));
+
+  for (size_t i = 0; i < nTextures; ++i)
+  {
+    writer.write(textures[i]->filename);
+    writer.write(_layers_info[i]);
+  }
+
+  // alphas being edited are saved as they will be applied
+  std::array<std::uint8_t, 64 * 64> values;
+
+  for (size_t alpha_layer = 0; alpha_layer + 1 < nTextures; ++alpha_layer)
+  {
+    for (int i = 0; i < 64 * 64; ++i)
+    {
+      values[i] = tmp_edit_values
+                ? tmp_edit_alpha_values::to_uint8((*tmp_edit_values)[alpha_layer + 1][i])
+                : alphamaps[alpha_layer] ? alphamaps[alpha_layer]->getAlpha(i) : 0
+                ;
+    }
+
+    writer.write(values.data(), values.size());
+  }
+}
+
+void TextureSet::restore_state(noggit::state_reader& reader)
+{
+  size_t const count = reader.read<std::uint32_t>();
+
+  // built before releasing the current textures to keep the shared ones loaded
+  std::vector<scoped_blp_texture_reference> restored;
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    restored.emplace_back(reader.read_string());
+    _layers_info[i] = reader.read<ENTRY_MCLY>();
+  }
+
+  textures.swap(restored);
+  nTextures = count;
+
+  discard_temporary_alphamaps();
+
+  std::array<std::uint8_t, 64 * 64> values;
+
+  for (size_t alpha_layer = 0; alpha_layer < alphamaps.size(); ++alpha_layer)
+  {
+    if (alpha_layer + 1 < nTextures)
+    {
+      reader.read(values.data(), values.size());
+
+      alphamaps[alpha_layer] = boost::in_place();
+      alphamaps[alpha_layer]->setAlpha(values.data());
+    }
+    else
+    {
+      alphamaps[alpha_layer] = boost::none;
+    }
+  }
+
+  _need_amap_update = true;
+  _need_lod_texture_map_update = true;
+}
+
 void TextureSet::create_temporary_alphamaps_if_needed()
 {
-  if (tmp_edit_values || nTextures < 2)
+  if (nTextures < 2)
+  {
+    return;
+  }
+
+  noggit::alpha_edit_pool::instance().touch(this);
+
+  if (tmp_edit_values)
   {
     return;
   }
 
-  tmp_edit_values.emplace();
+  tmp_edit_values.reset(new tmp_edit_alpha_values());
 
-  tmp_edit_alpha_values& values = tmp_edit_values.get();
+  tmp_edit_alpha_values& values = *tmp_edit_values;
 
   for (int i = 0; i < 64 * 64; ++i)
   {
-    float base_alpha = 1.f;
+    int base_alpha = 0xffff;
 
     for (int alpha_layer = 0; alpha_layer < nTextures-1; ++alpha_layer)
     {
-      float f = static_cast<float>(alphamaps[alpha_layer]->getAlpha(i)) / 255.f;
+      std::uint16_t alpha = alphamaps[alpha_layer]->getAlpha(i) * 257;
 
-      values[alpha_layer + 1][i] = f;
-      base_alpha -= f;
+      values[alpha_layer + 1][i] = alpha;
+      base_alpha -= alpha;
     }
 
-    values[0][i] = base_alpha;
+    values[0][i] = static_cast<std::uint16_t>(std::max(0, base_alpha));
+  }
+}
+
+void TextureSet::discard_temporary_alphamaps()
+{
+  if (tmp_edit_values)
+  {
+    tmp_edit_values.reset();
+    noggit::alpha_edit_pool::instance().forget(this);
   }
 }
@@ -2,19 +2,26 @@
 
 #pragma once
 
+#include <math/vector_2d.hpp>
 #include <noggit/MPQ.h>
+#include <noggit/action_history.hpp>
+#include <noggit/alpha_edit_pool.hpp>
 #include <noggit/alphamap.hpp>
 #include <noggit/MapHeaders.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <array>
+#include <memory>
 
 class Brush;
 class MapTile;
 
+// alphas in [0, 1] as 16 bit fixed point: an 8 bit alpha a is stored as
+// a * 257, so texels not painted on come back unchanged
 struct tmp_edit_alpha_values
 {
-  using alpha_layer = std::array<float, 64 * 64>;
+  using alpha_layer = std::array<std::uint16_t, 64 * 64>;
   // use 4 "alphamaps" for an easier editing
   std::array<alpha_layer, 4> map;
 
@@ -22,6 +29,28 @@ struct tmp_edit_alpha_values
   {
     return map.at(i);
   }
+
+  static float to_float(std::uint16_t alpha)
+  {
+    return alpha * (1.f / 65535.f);
+  }
+  static std::uint16_t from_float(float alpha)
+  {
+    return static_cast<std::uint16_t>(std::max(0.f, std::min(65535.f, alpha * 65535.f + 0.5f)));
+  }
+  static std::uint8_t to_uint8(std::uint16_t alpha)
+  {
+    return static_cast<std::uint8_t>((alpha * 255u + 32767u) / 65535u);
+  }
+
+  static void* operator new(std::size_t size)
+  {
+    return noggit::alpha_edit_pool::instance().allocate(size);
+  }
+  static void operator delete(void* ptr)
+  {
+    noggit::alpha_edit_pool::instance().deallocate(ptr);
+  }
 };
 
 class TextureSet
@@ -29,12 +58,14 @@ class TextureSet
 public:
   TextureSet() = delete;
   TextureSet(MapChunkHeader const& header, MPQFile* f, size_t base, MapTile* tile, bool use_big_alphamaps, bool do_not_fix_alpha_map, bool do_not_convert_alphamaps);
+  ~TextureSet();
 
   math::vector_2d anim_uv_offset(int id, int animtime) const;
 
   void bindTexture(size_t id, size_t activeTexture);
 
   int addTexture(scoped_blp_texture_reference texture);
+  //! the erased texture is only released by release_erased_textures()
   void eraseTexture(size_t id);
   void eraseTextures();
   // return true if at least 1 texture has been erased
@@ -75,6 +106,13 @@ public:
   std::vector<uint8_t> lod_texture_map();
 
   bool apply_alpha_changes();
+
+  //! on a thread with the opengl context, the textures may be destroyed
+  void release_erased_textures();
+
+  //! layers and their alphas, at 8 bit, for the action history
+  void save_state(noggit::state_writer& writer) const;
+  void restore_state(noggit::state_reader& reader);
 private:
   int get_texture_index_or_add (scoped_blp_texture_reference texture, float target);
 
@@ -86,6 +124,7 @@ private:
   void update_lod_texture_map();
 
   std::vector<scoped_blp_texture_reference> textures;
+  std::vector<scoped_blp_texture_reference> _erased_textures;
   std::array<boost::optional<Alphamap>, 3> alphamaps;
   opengl::texture amap_gl_tex;
   bool _need_amap_update = true;
@@ -96,9 +135,11 @@ private:
 
   ENTRY_MCLY _layers_info[4];
 
-  boost::optional<tmp_edit_alpha_values> tmp_edit_values;
+  // only allocated while the chunk is being painted on
+  std::unique_ptr<tmp_edit_alpha_values> tmp_edit_values;
 
   void create_temporary_alphamaps_if_needed();
+  void discard_temporary_alphamaps();
 
   bool _do_not_convert_alphamaps;
 };
@@ -0,0 +1,61 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#include <noggit/thread_pool.hpp>
+
+namespace noggit
+{
+  thread_pool::thread_pool (std::size_t thread_count)
+  {
+    for (std::size_t i (0); i < thread_count; ++i)
+    {
+      _threads.emplace_back (&thread_pool::process, this);
+    }
+  }
+
+  thread_pool::~thread_pool()
+  {
+    {
+      std::lock_guard<std::mutex> const lock (_mutex);
+      _stop = true;
+    }
+    _state_changed.notify_all();
+
+    for (auto& thread : _threads)
+    {
+      thread.join();
+    }
+  }
+
+  void thread_pool::post (std::function<void()> task)
+  {
+    {
+      std::lock_guard<std::mutex> const lock (_mutex);
+      _tasks.emplace_back (std::move (task));
+    }
+    _state_changed.notify_one();
+  }
+
+  void thread_pool::process()
+  {
+    while (true)
+    {
+      std::function<void()> task;
+
+      {
+        std::unique_lock<std::mutex> lock (_mutex);
+
+        _state_changed.wait (lock, [&] { return _stop || !_tasks.empty(); });
+
+        if (_stop)
+        {
+          return;
+        }
+
+        task = std::move (_tasks.front());
+        _tasks.pop_front();
+      }
+
+      task();
+    }
+  }
+}
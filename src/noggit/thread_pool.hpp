@@ -0,0 +1,143 @@
+// This file is part of Noggit3, licensed under GNU General Public License (version 3).
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace noggit
+{
+  //! Worker threads shared by everything splitting a job into independent
+  //! parts, e.g. decoding the 256 chunks of a tile.
+  //! \note a single queue is enough, there's no need for work stealing:
+  //! parallel_for only posts one helper per thread and they, along with
+  //! the calling thread, pick the next index from a shared counter, so
+  //! threads finishing early simply take more indices
+  class thread_pool
+  {
+  public:
+    static thread_pool& instance()
+    {
+      static thread_pool pool (std::max (1u, std::thread::hardware_concurrency()));
+      return pool;
+    }
+
+    explicit thread_pool (std::size_t thread_count);
+    ~thread_pool();
+
+    thread_pool() = delete;
+    thread_pool (thread_pool const&) = delete;
+    thread_pool (thread_pool&&) = delete;
+    thread_pool& operator= (thread_pool const&) = delete;
+    thread_pool& operator= (thread_pool&&) = delete;
+
+    std::size_t thread_count() const { return _threads.size(); }
+
+    //! Calls fun (i) for every i in [0, count) and returns once all of
+    //! them are done. The calling thread works on the calls too, so this
+    //! can safely be used from within a task of the pool. The first
+    //! exception thrown by fun is rethrown once all calls are done.
+    template<typename Fun>
+      void parallel_for (std::size_t count, Fun&& fun);
+
+    //! Calls fun() on one of the threads. The returned future is ready
+    //! once it is done and rethrows what fun threw.
+    template<typename Fun>
+      std::future<void> async (Fun&& fun);
+
+  private:
+    void post (std::function<void()> task);
+    void process();
+
+    std::mutex _mutex;
+    std::condition_variable _state_changed;
+    std::atomic<bool> _stop = {false};
+    std::deque<std::function<void()>> _tasks;
+    std::vector<std::thread> _threads;
+  };
+
+  template<typename Fun>
+    void thread_pool::parallel_for (std::size_t count, Fun&& fun)
+  {
+    if (count == 0)
+    {
+      return;
+    }
+
+    struct state
+    {
+      std::atomic<std::size_t> next = {0};
+      std::atomic<std::size_t> done = {0};
+      std::mutex mutex;
+      std::condition_variable all_done;
+      std::exception_ptr exception;
+    };
+
+    auto const shared (std::make_shared<state>());
+
+    // helpers starting after everything is done don't touch fun anymore,
+    // which is why referencing it after returning is fine
+    auto const work
+      ( [shared, count, &fun]
+        {
+          for (std::size_t i; (i = shared->next++) < count;)
+          {
+            try
+            {
+              fun (i);
+            }
+            catch (...)
+            {
+              std::lock_guard<std::mutex> const lock (shared->mutex);
+              if (!shared->exception)
+              {
+                shared->exception = std::current_exception();
+              }
+            }
+
+            if (++shared->done == count)
+            {
+              std::lock_guard<std::mutex> const lock (shared->mutex);
+              shared->all_done.notify_all();
+            }
+          }
+        }
+      );
+
+    for (std::size_t i (1); i < std::min (count, _threads.size() + 1); ++i)
+    {
+      post (work);
+    }
+
+    work();
+
+    std::unique_lock<std::mutex> lock (shared->mutex);
+    shared->all_done.wait (lock, [&] { return shared->done == count; });
+
+    if (shared->exception)
+    {
+      std::rethrow_exception (shared->exception);
+    }
+  }
+
+  template<typename Fun>
+    std::future<void> thread_pool::async (Fun&& fun)
+  {
+    // std::function needs something copyable
+    auto const task
+      (std::make_shared<std::packaged_task<void()>> (std::forward<Fun> (fun)));
+    std::future<void> result (task->get_future());
+    post ([task] { (*task)(); });
+    return result;
+  }
+}
@@ -2,6 +2,7 @@
 
 #include <noggit/ui/SettingsPanel.h>
 
+#include <noggit/MPQ.h>
 #include <noggit/TextureManager.h>
 #include <util/qt/overload.hpp>
 
@@ -142,9 +143,11 @@ namespace noggit
       layout->addRow ("VSync", _vsync_cb = new QCheckBox (this));
       layout->addRow ("Anti Aliasing", _anti_aliasing_cb = new QCheckBox(this));
       layout->addRow ("Fullscreen", _fullscreen_cb = new QCheckBox(this));
+      layout->addRow ("OpenGL debug output", _opengl_debug_output_cb = new QCheckBox(this));
       _vsync_cb->setToolTip("Require restart");
       _anti_aliasing_cb->setToolTip("Require restart");
       _fullscreen_cb->setToolTip("Require restart");
+      _opengl_debug_output_cb->setToolTip("Report OpenGL errors through GL_KHR_debug, require restart");
 
       layout->addRow ( "View Distance"
                      , viewDistanceField = new QDoubleSpinBox
@@ -171,6 +174,10 @@ namespace noggit
 
       layout->addRow("Additional file loading log", _additional_file_loading_log = new QCheckBox(this));
 
+      layout->addRow ("File loading threads (0 = auto)", _loader_thread_count = new QSpinBox(this));
+      _loader_thread_count->setRange(0, 64);
+      _loader_thread_count->setToolTip("Requires a restart");
+
       auto warning (new QWidget (this));
       new QHBoxLayout (warning);
       auto icon (new QLabel (warning));
@@ -221,11 +228,13 @@ namespace noggit
       _undock_small_texture_palette->setChecked (_settings->value ("undock_small_texture_palette/enabled", true).toBool());
       _vsync_cb->setChecked (_settings->value ("vsync", false).toBool());
       _anti_aliasing_cb->setChecked (_settings->value ("anti_aliasing", false).toBool());
+      _opengl_debug_output_cb->setChecked (_settings->value ("opengl_debug_output", false).toBool());
       _fullscreen_cb->setChecked (_settings->value ("fullscreen", false).toBool());
       _adt_unload_dist->setValue(_settings->value("unload_dist", 5).toInt());
       _adt_unload_check_interval->setValue(_settings->value("unload_interval", 5).toInt());
       _uid_cb->setChecked(_settings->value("uid_startup_check", true).toBool());
       _additional_file_loading_log->setChecked(_settings->value("additional_file_loading_log", false).toBool());
+      _loader_thread_count->setValue(_settings->value("loader_thread_count", 0).toInt());
 
 #ifdef USE_MYSQL_UID_STORAGE
       _mysql_box->setChecked (_settings->value ("project/mysql/enabled").toBool());
@@ -254,11 +263,13 @@ namespace noggit
       _settings->setValue ("undock_small_texture_palette/enabled", _undock_small_texture_palette->isChecked());
       _settings->setValue ("vsync", _vsync_cb->isChecked());
       _settings->setValue ("anti_aliasing", _anti_aliasing_cb->isChecked());
+      _settings->setValue ("opengl_debug_output", _opengl_debug_output_cb->isChecked());
       _settings->setValue ("fullscreen", _fullscreen_cb->isChecked());
       _settings->setValue ("unload_dist", _adt_unload_dist->value());
       _settings->setValue ("unload_interval", _adt_unload_check_interval->value());
       _settings->setValue ("uid_startup_check", _uid_cb->isChecked());
       _settings->setValue ("additional_file_loading_log", _additional_file_loading_log->isChecked());
+      _settings->setValue ("loader_thread_count", _loader_thread_count->value());
 
 #ifdef USE_MYSQL_UID_STORAGE
       _settings->setValue ("project/mysql/enabled", _mysql_box->isChecked());
@@ -274,6 +285,8 @@ namespace noggit
       _settings->setValue ("wireframe/color", _wireframe_color->color());      
 
 	  _settings->sync();
+
+      noggit::mpq::rescan_project_directory();
     }
   }
 }
@@ -53,6 +53,7 @@ namespace noggit
       QCheckBox* _vsync_cb;
 
       QCheckBox* _additional_file_loading_log;
+      QSpinBox* _loader_thread_count;
 
       QGroupBox* _mysql_box;
 #ifdef USE_MYSQL_UID_STORAGE
@@ -68,6 +69,7 @@ namespace noggit
       color_widgets::ColorSelector* _wireframe_color;
       QCheckBox* _anti_aliasing_cb;
       QCheckBox* _fullscreen_cb;
+      QCheckBox* _opengl_debug_output_cb;
 
       QSettings* _settings;
     public:
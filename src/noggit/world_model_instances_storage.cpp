@@ -45,7 +45,7 @@ namespace noggit
     }
     else if(!unsafe_uid_is_used(uid))
     {
-      _m2s.emplace(uid, instance);
+      unsafe_update_bounds(_m2s.emplace(uid, instance).first->second);
       _instance_count_per_uid[uid] = 1;
       return uid;
     }
@@ -92,7 +92,7 @@ namespace noggit
     }
     else if (!unsafe_uid_is_used(uid))
     {
-      _wmos.emplace(uid, instance);
+      unsafe_update_bounds(_wmos.emplace(uid, instance).first->second);
       _instance_count_per_uid[uid] = 1;
       return uid;
     }
@@ -114,6 +114,7 @@ namespace noggit
       {
         _world->updateTilesModel(&it->second, model_update::remove);
         _instance_count_per_uid.erase(it->first);
+        _m2_grid.remove(it->first);
         it = _m2s.erase(it);
       }
       else
@@ -127,6 +128,7 @@ namespace noggit
       {
         _world->updateTilesWMO(&it->second, model_update::remove);
         _instance_count_per_uid.erase(it->first);
+        _wmo_grid.remove(it->first);
         it = _wmos.erase(it);
       }
       else
@@ -149,6 +151,7 @@ namespace noggit
         _world->updateTilesModel(instance, model_update::remove);
 
         _instance_count_per_uid.erase(instance->uid);
+        _m2_grid.remove(instance->uid);
         _m2s.erase(instance->uid);
       }
       else if (it.which() == eEntry_WMO)
@@ -158,6 +161,7 @@ namespace noggit
         _world->updateTilesWMO(instance, model_update::remove);
 
         _instance_count_per_uid.erase(instance->mUniqueID);
+        _wmo_grid.remove(instance->mUniqueID);
         _wmos.erase(instance->mUniqueID);
       }
     }
@@ -168,6 +172,8 @@ namespace noggit
     std::unique_lock<std::mutex> const lock (_mutex);
 
     _instance_count_per_uid.erase(uid);
+    _m2_grid.remove(uid);
+    _wmo_grid.remove(uid);
     _m2s.erase(uid);
     _wmos.erase(uid);
   }
@@ -187,6 +193,8 @@ namespace noggit
       _world->remove_from_selection(uid);
 
       _instance_count_per_uid.erase(uid);
+      _m2_grid.remove(uid);
+      _wmo_grid.remove(uid);
       _m2s.erase(uid);
       _wmos.erase(uid);
     }
@@ -197,10 +205,54 @@ namespace noggit
     std::unique_lock<std::mutex> const lock (_mutex);
 
     _instance_count_per_uid.clear();
+    _m2_grid.clear();
+    _wmo_grid.clear();
     _m2s.clear();
     _wmos.clear();
   }
 
+  void world_model_instances_storage::update_bounds(ModelInstance* instance)
+  {
+    std::unique_lock<std::mutex> const lock (_mutex);
+    unsafe_update_bounds(*instance);
+  }
+  void world_model_instances_storage::update_bounds(WMOInstance* instance)
+  {
+    std::unique_lock<std::mutex> const lock (_mutex);
+    unsafe_update_bounds(*instance);
+  }
+
+  void world_model_instances_storage::unsafe_update_bounds(ModelInstance& instance)
+  {
+    if (instance.model->finishedLoading())
+    {
+      auto const& extents(instance.extents());
+      _m2_grid.insert(instance.uid, extents[0], extents[1]);
+    }
+    else
+    {
+      _m2_grid.insert_unbounded(instance.uid);
+    }
+  }
+  void world_model_instances_storage::unsafe_update_bounds(WMOInstance& instance)
+  {
+    // the extents are read from the adt and don't depend on the wmo being loaded
+    _wmo_grid.insert(instance.mUniqueID, instance.extents[0], instance.extents[1]);
+  }
+
+  void world_model_instances_storage::unsafe_update_bounds_of_loaded_models()
+  {
+    for (std::uint32_t uid : _m2_grid.unbounded())
+    {
+      ModelInstance& instance(_m2s.at(uid));
+
+      if (instance.model->finishedLoading())
+      {
+        unsafe_update_bounds(instance);
+      }
+    }
+  }
+
   boost::optional<ModelInstance*> world_model_instances_storage::get_model_instance(std::uint32_t uid)
   {
     std::unique_lock<std::mutex> const lock (_mutex);
@@ -286,6 +338,7 @@ namespace noggit
           _world->updateTilesWMO(&rhs->second, model_update::remove);
 
           _instance_count_per_uid.erase(rhs->second.mUniqueID);
+          _wmo_grid.remove(rhs->second.mUniqueID);
           rhs = _wmos.erase(rhs);
           deleted_uids++;
         }
@@ -307,6 +360,7 @@ namespace noggit
           _world->updateTilesModel(&rhs->second, model_update::remove);
 
           _instance_count_per_uid.erase(rhs->second.uid);
+          _m2_grid.remove(rhs->second.uid);
           rhs = _m2s.erase(rhs);
           deleted_uids++;
         }
@@ -2,8 +2,10 @@
 
 #pragma once
 
+#include <math/ray.hpp>
 #include <noggit/ModelInstance.h>
 #include <noggit/Selection.h>
+#include <noggit/instance_grid.hpp>
 #include <noggit/tile_index.hpp>
 #include <noggit/WMOInstance.h>
 
@@ -12,6 +14,7 @@
 #include <functional>
 #include <mutex>
 #include <unordered_map>
+#include <vector>
 
 class World;
 
@@ -47,6 +50,10 @@ namespace noggit
 
     void clear();
 
+    //! to call after an instance was moved, rotated or scaled
+    void update_bounds(ModelInstance* instance);
+    void update_bounds(WMOInstance* instance);
+
     void clear_duplicates();
 
     bool uid_duplicates_found() const
@@ -61,6 +68,10 @@ namespace noggit
     std::uint32_t unsafe_add_wmo_instance_no_world_upd(WMOInstance instance);
     boost::optional<ModelInstance*> unsafe_get_model_instance(std::uint32_t uid);
     boost::optional<WMOInstance*> unsafe_get_wmo_instance(std::uint32_t uid);
+    void unsafe_update_bounds(ModelInstance& instance);
+    void unsafe_update_bounds(WMOInstance& instance);
+    // models still loading when added don't have bounds yet
+    void unsafe_update_bounds_of_loaded_models();
 
   public:
     template<typename Fun>
@@ -101,6 +112,37 @@ namespace noggit
       }
     }
 
+    // only visits the instances whose bounds may be hit by the ray
+    template<typename Fun>
+      void for_each_m2_instance_on_ray(math::ray const& ray, Fun&& function)
+    {
+      std::unique_lock<std::mutex> const lock (_mutex);
+
+      unsafe_update_bounds_of_loaded_models();
+
+      std::vector<std::uint32_t> uids;
+      _m2_grid.candidates(ray, uids);
+
+      for (std::uint32_t uid : uids)
+      {
+        function(_m2s.at(uid));
+      }
+    }
+
+    template<typename Fun>
+      void for_each_wmo_instance_on_ray(math::ray const& ray, Fun&& function)
+    {
+      std::unique_lock<std::mutex> const lock (_mutex);
+
+      std::vector<std::uint32_t> uids;
+      _wmo_grid.candidates(ray, uids);
+
+      for (std::uint32_t uid : uids)
+      {
+        function(_wmos.at(uid));
+      }
+    }
+
   private:
     World* _world;
     std::mutex _mutex;
@@ -110,5 +152,9 @@ namespace noggit
     wmo_instance_umap _wmos;
 
     std::unordered_map<std::uint32_t, int> _instance_count_per_uid;
+
+    // spatial index for picking, kept in sync with _m2s and _wmos
+    instance_grid _m2_grid;
+    instance_grid _wmo_grid;
   };
 }
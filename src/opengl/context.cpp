@@ -10,6 +10,7 @@
 #include <boost/current_function.hpp>
 
 #include <QtCore/QSysInfo>
+#include <QtGui/QOpenGLDebugLogger>
 #include <QtGui/QOpenGLFunctions>
 #include <QtOpenGLExtensions/QOpenGLExtensions>
 
@@ -32,14 +33,64 @@ namespace opengl
       static constexpr char const* const name = "GL_ARB_vertex_program";
     };
 
+    //! set while the current context reports errors through a
+    //! GL_KHR_debug logger, in which case glGetError() isn't polled
+    bool debug_output_active = false;
+
+    void log_debug_message (QOpenGLDebugMessage const& message)
+    {
+      if (message.severity() == QOpenGLDebugMessage::HighSeverity)
+      {
+        LogError << "GL: " << message.message().toStdString() << std::endl;
+      }
+      else
+      {
+        LogDebug << "GL: " << message.message().toStdString() << std::endl;
+      }
+    }
+
+    void start_debug_output (QOpenGLContext* context)
+    {
+      if (context->findChild<QOpenGLDebugLogger*>())
+      {
+        return;
+      }
+
+      auto logger (new QOpenGLDebugLogger (context));
+      if (!logger->initialize())
+      {
+        LogError << "GL: debug context requested but GL_KHR_debug is not available, falling back to glGetError()" << std::endl;
+        delete logger;
+        return;
+      }
+
+      QObject::connect (logger, &QOpenGLDebugLogger::messageLogged, &log_debug_message);
+      logger->startLogging (QOpenGLDebugLogger::SynchronousLogging);
+    }
+
+    bool has_debug_output (QOpenGLContext* context)
+    {
+      auto logger (context->findChild<QOpenGLDebugLogger*>());
+      return logger && logger->isLogging();
+    }
+
+    //! \note With NOGGIT_DO_NOT_VERIFY_OPENGL_CONTEXT and
+    //! NOGGIT_DO_NOT_CHECK_FOR_OPENGL_ERRORS both defined, this does nothing
+    //! but find the version and extension functions.
     struct verify_context_and_check_for_gl_errors
     {
       template<typename ExtraInfo> verify_context_and_check_for_gl_errors
           (QOpenGLContext* current_context, char const* function, ExtraInfo&& extra_info)
         : _current_context (current_context)
         , _function (function)
+#ifndef NOGGIT_DO_NOT_CHECK_FOR_OPENGL_ERRORS
         , _extra_info (extra_info)
+#endif
       {
+#ifdef NOGGIT_DO_NOT_CHECK_FOR_OPENGL_ERRORS
+        (void) extra_info;
+#endif
+#ifndef NOGGIT_DO_NOT_VERIFY_OPENGL_CONTEXT
         if (!_current_context)
         {
           throw std::runtime_error (std::string(_function) + ": called without active OpenGL context: no context at all");
@@ -52,6 +103,7 @@ namespace opengl
         {
           throw std::runtime_error (std::string(_function) + ": called without active OpenGL context: not current context");
         }
+#endif
       }
       verify_context_and_check_for_gl_errors (QOpenGLContext* current_context, char const* function)
         : verify_context_and_check_for_gl_errors (current_context, function, &verify_context_and_check_for_gl_errors::no_extra_info)
@@ -82,19 +134,21 @@ namespace opengl
       QOpenGLContext* _current_context;
       char const* _function;
       static std::string no_extra_info() { return {}; }
+#ifndef NOGGIT_DO_NOT_CHECK_FOR_OPENGL_ERRORS
       std::function<std::string()> _extra_info;
+#endif
 
       ~verify_context_and_check_for_gl_errors()
       {
 #ifndef NOGGIT_DO_NOT_CHECK_FOR_OPENGL_ERRORS
-        if (inside_gl_begin_end)
+        if (inside_gl_begin_end || debug_output_active)
         {
           return;
         }
 
         std::string errors;
         std::size_t error_count = 0;
-        while (GLenum error = glGetError() && error_count < 10)
+        for (GLenum error = glGetError(); error != GL_NO_ERROR && error_count < 10; error = glGetError())
         {
           switch (error)
           {
@@ -140,6 +194,7 @@ namespace opengl
     : _context (context_)
     , _old_context (_context._current_context)
     , _old_core_func (context_._3_3_core_func)
+    , _old_debug_output_active (debug_output_active)
   {
     _context._current_context = current_context;
     _context._3_3_core_func = current_context->versionFunctions<QOpenGLFunctions_3_3_Core>();
@@ -148,11 +203,18 @@ namespace opengl
     {
       throw std::runtime_error("Noggit requires OpenGL 3.3 core functions");
     }
+
+    if (current_context->format().testOption (QSurfaceFormat::DebugContext))
+    {
+      start_debug_output (current_context);
+    }
+    debug_output_active = has_debug_output (current_context);
   }
   context::scoped_setter::~scoped_setter()
   {
     _context._current_context = _old_context;
     _context._3_3_core_func = _old_core_func;
+    debug_output_active = _old_debug_output_active;
   }
   context::save_current_context::save_current_context (context& context_)
     : _is_current ( context_._current_context
@@ -580,6 +642,17 @@ namespace opengl
     return std::string(log.data());
   }
 
+  void context::getActiveAttrib (GLuint program, GLuint index, GLsizei buf_size, GLsizei* length, GLint* size, GLenum* type, GLchar* name)
+  {
+    verify_context_and_check_for_gl_errors const _ (_current_context, BOOST_CURRENT_FUNCTION);
+    return _current_context->functions()->glGetActiveAttrib (program, index, buf_size, length, size, type, name);
+  }
+  void context::getActiveUniform (GLuint program, GLuint index, GLsizei buf_size, GLsizei* length, GLint* size, GLenum* type, GLchar* name)
+  {
+    verify_context_and_check_for_gl_errors const _ (_current_context, BOOST_CURRENT_FUNCTION);
+    return _current_context->functions()->glGetActiveUniform (program, index, buf_size, length, size, type, name);
+  }
+
   GLint context::getAttribLocation (GLuint program, GLchar const* name)
   {
     verify_context_and_check_for_gl_errors const _ (_current_context, BOOST_CURRENT_FUNCTION);
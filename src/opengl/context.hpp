@@ -24,6 +24,7 @@ namespace opengl
       context& _context;
       QOpenGLContext* _old_context;
       QOpenGLFunctions_3_3_Core* _old_core_func;
+      bool _old_debug_output_active;
     };
 
     struct save_current_context
@@ -128,6 +129,8 @@ namespace opengl
     void validate_program (GLuint program);
     GLint get_program (GLuint program, GLenum pname);
     std::string get_program_info_log(GLuint program);
+    void getActiveAttrib (GLuint program, GLuint index, GLsizei buf_size, GLsizei* length, GLint* size, GLenum* type, GLchar* name);
+    void getActiveUniform (GLuint program, GLuint index, GLsizei buf_size, GLsizei* length, GLint* size, GLenum* type, GLchar* name);
 
     GLint getAttribLocation (GLuint program, GLchar const* name);
     void vertexAttribPointer (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, GLvoid const* pointer);
@@ -14,6 +14,7 @@
 #include <QFile>
 #include <QTextStream>
 
+#include <algorithm>
 #include <stdexcept>
 #include <list>
 #include <regex>
@@ -114,11 +115,15 @@ namespace opengl
 #ifdef  VALIDATE_OPENGL_PROGRAMS
     gl.validate_program(*_handle);
 #endif
+
+    resolve_locations();
   }
   program::program (program&& other)
     : _handle (boost::none)
   {
     std::swap (_handle, other._handle);
+    std::swap (_uniforms, other._uniforms);
+    std::swap (_attribs, other._attribs);
   }
   program::~program()
   {
@@ -128,14 +133,96 @@ namespace opengl
     }
   }
 
-  //! \todo cache lookups?
-  GLuint program::uniform_location (std::string const& name) const
+  void program::resolve_locations()
+  {
+    auto const add
+      ( [] (std::unordered_map<std::uint32_t, GLuint>& locations, std::string const& name, GLuint location)
+        {
+          if (!locations.emplace (shader_variable (name).hash, location).second)
+          {
+            throw std::logic_error ("hash collision for shader variable " + name);
+          }
+        }
+      );
+
+    std::vector<GLchar> name_buffer
+      ( std::max ( gl.get_program (*_handle, GL_ACTIVE_UNIFORM_MAX_LENGTH)
+                 , gl.get_program (*_handle, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH)
+                 ) + 1
+      );
+
+    for (GLint i (0); i < gl.get_program (*_handle, GL_ACTIVE_UNIFORMS); ++i)
+    {
+      GLsizei length;
+      GLint size;
+      GLenum type;
+      gl.getActiveUniform (*_handle, i, name_buffer.size(), &length, &size, &type, name_buffer.data());
+
+      std::string name (name_buffer.data(), length);
+
+      // built-ins like gl_ModelViewMatrix don't have a location
+      if (name.compare (0, 3, "gl_") == 0)
+      {
+        continue;
+      }
+
+      GLint const location (gl.getUniformLocation (*_handle, name.c_str()));
+
+      // arrays are reported as "name[0]", they are used as "name" as well
+      // as "name[i]" which all have their own location
+      std::size_t const subscript (name.rfind ("[0]"));
+      if (subscript != std::string::npos && subscript + 3 == name.size())
+      {
+        name.resize (subscript);
+        add (_uniforms, name, location);
+
+        for (GLint element (1); element < size; ++element)
+        {
+          std::string const element_name (name + "[" + std::to_string (element) + "]");
+          add (_uniforms, element_name, gl.getUniformLocation (*_handle, element_name.c_str()));
+        }
+
+        name += "[0]";
+      }
+
+      add (_uniforms, name, location);
+    }
+
+    for (GLint i (0); i < gl.get_program (*_handle, GL_ACTIVE_ATTRIBUTES); ++i)
+    {
+      GLsizei length;
+      GLint size;
+      GLenum type;
+      gl.getActiveAttrib (*_handle, i, name_buffer.size(), &length, &size, &type, name_buffer.data());
+
+      std::string const name (name_buffer.data(), length);
+
+      if (name.compare (0, 3, "gl_") == 0)
+      {
+        continue;
+      }
+
+      add (_attribs, name, gl.getAttribLocation (*_handle, name.c_str()));
+    }
+  }
+
+  GLuint program::uniform_location (shader_variable const& name) const
   {
-    return gl.getUniformLocation (*_handle, name.c_str());
+    auto const it (_uniforms.find (name.hash));
+    if (it == _uniforms.end())
+    {
+      throw std::invalid_argument ("uniform " + std::string (name.name) + " does not exist in shader\n");
+    }
+    return it->second;
   }
-  GLuint program::attrib_location (std::string const& name) const
+  GLuint program::attrib_location (shader_variable const& name) const
   {
-    return gl.getAttribLocation (*_handle, name.c_str());
+    auto const it (_attribs.find (name.hash));
+    if (it == _attribs.end())
+    {
+      throw std::invalid_argument ("attribute " + std::string (name.name) + " does not exist in shader\n");
+    }
+    return it->second;
   }
 
   namespace scoped
@@ -155,73 +242,73 @@ namespace opengl
       gl.useProgram (_old);
     }
 
-    void use_program::uniform (std::string const& name, GLint value)
+    void use_program::uniform (shader_variable const& name, GLint value)
     {
-      gl.uniform1i (uniform_location (name), value);
+      gl.uniform1i (_program.uniform_location (name), value);
     }
-    void use_program::uniform (std::string const& name, GLfloat value)
+    void use_program::uniform (shader_variable const& name, GLfloat value)
     {
-      gl.uniform1f (uniform_location (name), value);
+      gl.uniform1f (_program.uniform_location (name), value);
     }
-    void use_program::uniform (std::string const& name, std::vector<int> const& value)
+    void use_program::uniform (shader_variable const& name, std::vector<int> const& value)
     {
-      gl.uniform1iv (uniform_location(name), value.size(), value.data());
+      gl.uniform1iv (_program.uniform_location (name), value.size(), value.data());
     }
-    void use_program::uniform (std::string const& name, math::vector_2d const& value)
+    void use_program::uniform (shader_variable const& name, math::vector_2d const& value)
     {
-      gl.uniform2fv (uniform_location (name), 1, value);
+      gl.uniform2fv (_program.uniform_location (name), 1, value);
     }
-    void use_program::uniform (std::string const& name, math::vector_3d const& value)
+    void use_program::uniform (shader_variable const& name, math::vector_3d const& value)
     {
-      gl.uniform3fv (uniform_location (name), 1, value);
+      gl.uniform3fv (_program.uniform_location (name), 1, value);
     }
-    void use_program::uniform (std::string const& name, math::vector_4d const& value)
+    void use_program::uniform (shader_variable const& name, math::vector_4d const& value)
     {
-      gl.uniform4fv (uniform_location (name), 1, value);
+      gl.uniform4fv (_program.uniform_location (name), 1, value);
     }
-    void use_program::uniform (std::string const& name, math::matrix_4x4 const& value)
+    void use_program::uniform (shader_variable const& name, math::matrix_4x4 const& value)
     {
-      gl.uniformMatrix4fv (uniform_location (name), 1, GL_FALSE, value);
+      gl.uniformMatrix4fv (_program.uniform_location (name), 1, GL_FALSE, value);
     }
 
-    void use_program::sampler (std::string const& name, GLenum texture_slot, texture* tex)
+    void use_program::sampler (shader_variable const& name, GLenum texture_slot, texture* tex)
     {
       uniform (name, GLint (texture_slot - GL_TEXTURE0));
       texture::set_active_texture (texture_slot - GL_TEXTURE0);
       tex->bind();
     }
 
-    void use_program::attrib (std::string const& name, std::vector<float> const& data)
+    void use_program::attrib (shader_variable const& name, std::vector<float> const& data)
     {
-      GLuint const location (attrib_location (name));
+      GLuint const location (_program.attrib_location (name));
       gl.enableVertexAttribArray (location);
       _enabled_vertex_attrib_arrays.emplace (location);
       gl.vertexAttribPointer (location, 1, GL_FLOAT, GL_FALSE, 0, data.data());
     }
-    void use_program::attrib (std::string const& name, std::vector<math::vector_2d> const& data)
+    void use_program::attrib (shader_variable const& name, std::vector<math::vector_2d> const& data)
     {
-      GLuint const location (attrib_location (name));
+      GLuint const location (_program.attrib_location (name));
       gl.enableVertexAttribArray (location);
       _enabled_vertex_attrib_arrays.emplace (location);
       gl.vertexAttribPointer (location, 2, GL_FLOAT, GL_FALSE, 0, data.data());
     }
-    void use_program::attrib (std::string const& name, std::vector<math::vector_3d> const& data)
+    void use_program::attrib (shader_variable const& name, std::vector<math::vector_3d> const& data)
     {
-      GLuint const location (attrib_location (name));
+      GLuint const location (_program.attrib_location (name));
       gl.enableVertexAttribArray (location);
       _enabled_vertex_attrib_arrays.emplace (location);
       gl.vertexAttribPointer (location, 3, GL_FLOAT, GL_FALSE, 0, data.data());
     }
-    void use_program::attrib (std::string const& name, math::vector_3d const* data)
+    void use_program::attrib (shader_variable const& name, math::vector_3d const* data)
     {
-      GLuint const location (attrib_location (name));
+      GLuint const location (_program.attrib_location (name));
       gl.enableVertexAttribArray (location);
       _enabled_vertex_attrib_arrays.emplace (location);
       gl.vertexAttribPointer (location, 3, GL_FLOAT, GL_FALSE, 0, data);
     }
-    void use_program::attrib (std::string const& name, math::matrix_4x4 const* data, GLuint divisor)
+    void use_program::attrib (shader_variable const& name, math::matrix_4x4 const* data, GLuint divisor)
     {
-      GLuint const location (attrib_location (name));
+      GLuint const location (_program.attrib_location (name));
       math::vector_4d const* vec4_ptr = reinterpret_cast<math::vector_4d const*>(data);
 
       for (GLuint i = 0; i < 4; ++i)
@@ -232,65 +319,29 @@ namespace opengl
         gl.vertexAttribDivisor(location + i, divisor);
       }      
     }
-    void use_program::attrib (std::string const& name, GLsizei size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* data)
+    void use_program::attrib (shader_variable const& name, GLsizei size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* data)
     {
-      GLuint const location (attrib_location (name));
+      GLuint const location (_program.attrib_location (name));
       gl.enableVertexAttribArray (location);
       _enabled_vertex_attrib_arrays.emplace (location);
       gl.vertexAttribPointer (location, size, type, normalized, stride, data);
     }
-    void use_program::attrib (std::string const& name, GLuint buffer, GLsizei size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* data)
+    void use_program::attrib (shader_variable const& name, GLuint buffer, GLsizei size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* data)
     {
-      GLuint const location (attrib_location (name));
+      GLuint const location (_program.attrib_location (name));
       gl.enableVertexAttribArray (location);
       _enabled_vertex_attrib_arrays.emplace (location);
       scoped::buffer_binder<GL_ARRAY_BUFFER> const bind (buffer);
       gl.vertexAttribPointer (location, size, type, normalized, stride, data);
     }
 
-    void use_program::attrib_divisor(std::string const& name, GLuint divisor, GLsizei range)
+    void use_program::attrib_divisor(shader_variable const& name, GLuint divisor, GLsizei range)
     {
-      GLuint const location (attrib_location (name));
+      GLuint const location (_program.attrib_location (name));
       for (GLuint i = 0; i < range; ++i)
       {
         gl.vertexAttribDivisor(location + i, divisor);
       }
     }
-
-    GLuint use_program::uniform_location (std::string const& name)
-    {
-      auto it = _uniforms.find (name);
-      if (it != _uniforms.end())
-      {
-        return it->second;
-      }
-
-      GLuint loc = _program.uniform_location (name);
-      if (loc == -1)
-      {
-        throw std::invalid_argument ("uniform " + name + " does not exist in shader\n");
-      }
-      _uniforms[name] = loc;      
-      return loc;
-    }
-
-    GLuint use_program::attrib_location (std::string const& name)
-    {
-      auto it = _attribs.find (name);
-      if (it != _attribs.end())
-      {
-        return it->second;
-      }
-      else
-      {
-        GLuint loc = _program.attrib_location (name);
-        if (loc == -1)
-        {
-          throw std::invalid_argument ("attribute " + name + " does not exist in shader\n");
-        }
-        _attribs[name] = loc;
-        return loc;
-      }
-    }
   }
 }
@@ -7,6 +7,7 @@
 
 #include <boost/optional.hpp>
 
+#include <cstdint>
 #include <initializer_list>
 #include <map>
 #include <set>
@@ -24,6 +25,33 @@ namespace math
 
 namespace opengl
 {
+  //! Name of a uniform or attribute. Programs resolve the locations of
+  //! all their variables when linking and look them up by the name's
+  //! hash, which is computed at compile time for string literals.
+  struct shader_variable
+  {
+    constexpr shader_variable (char const* name_)
+      : name (name_)
+      , hash (fnv1a (name_))
+    {}
+    shader_variable (std::string const& name_)
+      : shader_variable (name_.c_str())
+    {}
+
+    static constexpr std::uint32_t fnv1a (char const* str)
+    {
+      std::uint32_t value = 2166136261u;
+      for (; *str; ++str)
+      {
+        value = (value ^ static_cast<unsigned char> (*str)) * 16777619u;
+      }
+      return value;
+    }
+
+    char const* name;
+    std::uint32_t hash;
+  };
+
   struct shader
   {
     shader(GLenum type, std::string const& source);
@@ -54,12 +82,16 @@ namespace opengl
     program& operator= (program&&) = delete;
 
   private:
-    inline GLuint uniform_location (std::string const& name) const;
-    inline GLuint attrib_location (std::string const& name) const;
+    void resolve_locations();
+
+    GLuint uniform_location (shader_variable const& name) const;
+    GLuint attrib_location (shader_variable const& name) const;
 
     friend struct scoped::use_program;
 
     boost::optional<GLuint> _handle;
+    std::unordered_map<std::uint32_t, GLuint> _uniforms;
+    std::unordered_map<std::uint32_t, GLuint> _attribs;
   };
 
   namespace scoped
@@ -74,34 +106,28 @@ namespace opengl
       use_program& operator= (use_program const&) = delete;
       use_program& operator= (use_program&&) = delete;
 
-      void uniform (std::string const& name, std::vector<int> const&);
-      void uniform (std::string const& name, GLint);
-      void uniform (std::string const& name, GLfloat);
-      void uniform (std::string const& name, math::vector_2d const&);
-      void uniform (std::string const& name, math::vector_3d const&);
-      void uniform (std::string const& name, math::vector_4d const&);
-      void uniform (std::string const& name, math::matrix_4x4 const&);
-      template<typename T> void uniform (std::string const&, T) = delete;
+      void uniform (shader_variable const& name, std::vector<int> const&);
+      void uniform (shader_variable const& name, GLint);
+      void uniform (shader_variable const& name, GLfloat);
+      void uniform (shader_variable const& name, math::vector_2d const&);
+      void uniform (shader_variable const& name, math::vector_3d const&);
+      void uniform (shader_variable const& name, math::vector_4d const&);
+      void uniform (shader_variable const& name, math::matrix_4x4 const&);
+      template<typename T> void uniform (shader_variable const&, T) = delete;
 
-      void sampler (std::string const& name, GLenum texture_slot, texture*);
+      void sampler (shader_variable const& name, GLenum texture_slot, texture*);
 
-      void attrib (std::string const& name, std::vector<float> const&);
-      void attrib (std::string const& name, std::vector<math::vector_2d> const&);
-      void attrib (std::string const& name, std::vector<math::vector_3d> const&);
-      void attrib (std::string const& name, math::vector_3d const*);
-      void attrib (std::string const& name, math::matrix_4x4 const*, GLuint divisor = 0);
-      void attrib (std::string const& name, GLsizei size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* data);
-      void attrib (std::string const& name, GLuint buffer, GLsizei size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* data);
+      void attrib (shader_variable const& name, std::vector<float> const&);
+      void attrib (shader_variable const& name, std::vector<math::vector_2d> const&);
+      void attrib (shader_variable const& name, std::vector<math::vector_3d> const&);
+      void attrib (shader_variable const& name, math::vector_3d const*);
+      void attrib (shader_variable const& name, math::matrix_4x4 const*, GLuint divisor = 0);
+      void attrib (shader_variable const& name, GLsizei size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* data);
+      void attrib (shader_variable const& name, GLuint buffer, GLsizei size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* data);
 
-      void attrib_divisor(std::string const& name, GLuint divisor, GLsizei range = 1);
+      void attrib_divisor(shader_variable const& name, GLuint divisor, GLsizei range = 1);
 
     private:
-      GLuint uniform_location (std::string const& name);
-      GLuint attrib_location (std::string const& name);
-    
-      std::unordered_map<std::string, GLuint> _uniforms;
-      std::unordered_map<std::string, GLuint> _attribs;
-
       program const& _program;
       std::set<GLuint> _enabled_vertex_attrib_arrays;
 
@@ -0,0 +1,70 @@
+#include <boost/test/included/unit_test.hpp>
+
+#include <math/frustum.hpp>
+#include <math/projection.hpp>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace math
+{
+  namespace
+  {
+    frustum looking_down_negative_z()
+    {
+      // World::draw() passes the transposed model view projection matrix
+      return frustum ( ( perspective (math::degrees (45.f), 1.f, 1.f, 1000.f)
+                       * look_at ({0.f, 0.f, 0.f}, {0.f, 0.f, -1.f}, {0.f, 1.f, 0.f})
+                       ).transposed()
+                     );
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE (spheres_in_front_and_behind)
+  {
+    frustum const f (looking_down_negative_z());
+
+    BOOST_CHECK (f.intersectsSphere ({0.f, 0.f, -10.f}, 1.f));
+    BOOST_CHECK (!f.intersectsSphere ({0.f, 0.f, 10.f}, 1.f));
+    BOOST_CHECK (!f.intersectsSphere ({-100.f, 0.f, -10.f}, 1.f));
+    BOOST_CHECK (!f.intersectsSphere ({0.f, 0.f, -2000.f}, 1.f));
+  }
+
+  // roughly the instance count of a densely populated map
+  BOOST_AUTO_TEST_CASE (batch_matches_single_spheres)
+  {
+    frustum const f (looking_down_negative_z());
+
+    std::mt19937 engine (42);
+    std::uniform_real_distribution<float> coordinate (-1500.f, 1500.f);
+    std::uniform_real_distribution<float> size (0.f, 50.f);
+
+    // not a multiple of four, to cover the remainder
+    std::size_t const count (100003);
+    std::vector<float> x, y, z, radius;
+    for (std::size_t i (0); i < count; ++i)
+    {
+      x.push_back (coordinate (engine));
+      y.push_back (coordinate (engine));
+      z.push_back (coordinate (engine));
+      radius.push_back (size (engine));
+    }
+
+    std::vector<std::uint8_t> visible (count);
+    f.intersectsSpheres (x.data(), y.data(), z.data(), radius.data(), count, visible.data());
+
+    std::size_t visible_count (0);
+    for (std::size_t i (0); i < count; ++i)
+    {
+      BOOST_REQUIRE_EQUAL ( !!visible[i]
+                          , f.intersectsSphere ({x[i], y[i], z[i]}, radius[i])
+                          );
+      visible_count += visible[i];
+    }
+
+    // make sure both outcomes were covered
+    BOOST_CHECK_GT (visible_count, 0u);
+    BOOST_CHECK_LT (visible_count, count);
+  }
+}
@@ -0,0 +1,191 @@
+#include <boost/test/included/unit_test.hpp>
+
+#include <math/grid_traversal.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace math
+{
+  namespace
+  {
+    using cell = std::pair<int, int>;
+
+    std::vector<cell> visited ( ray const& r
+                              , vector_3d const& min
+                              , vector_3d const& max
+                              , int count_x
+                              , int count_z
+                              )
+    {
+      std::vector<cell> cells;
+      traverse_grid ( r, min, max, count_x, count_z
+                    , [&] (int x, int z)
+                      {
+                        cells.emplace_back (x, z);
+                        return false;
+                      }
+                    );
+      return cells;
+    }
+
+    //! [enter, exit] of the ray in the box, enter > exit if it misses it
+    std::pair<float, float> slabs (ray const& r, vector_3d const& min, vector_3d const& max)
+    {
+      float enter (0.f);
+      float exit (std::numeric_limits<float>::max());
+      for (int axis (0); axis < 3; ++axis)
+      {
+        float const o (r.origin()[axis]);
+        float const d (r.direction()[axis]);
+        if (d == 0.f)
+        {
+          if (o < min[axis] || o > max[axis])
+          {
+            return {1.f, 0.f};
+          }
+          continue;
+        }
+        float const t1 ((min[axis] - o) / d);
+        float const t2 ((max[axis] - o) / d);
+        enter = std::max (enter, std::min (t1, t2));
+        exit = std::min (exit, std::max (t1, t2));
+      }
+      return {enter, exit};
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE (cells_are_visited_front_to_back)
+  {
+    ray const r ({0.5f, 0.f, 0.2f}, {1.f, 0.f, 0.7f});
+    auto const cells (visited (r, {0.f, -1.f, 0.f}, {8.f, 1.f, 8.f}, 8, 8));
+
+    BOOST_REQUIRE (!cells.empty());
+    BOOST_CHECK (cells.front() == cell (0, 0));
+
+    float previous (-1.f);
+    for (std::size_t i (0); i < cells.size(); ++i)
+    {
+      if (i)
+      {
+        // neighbours, one step along x or z
+        int const dx (cells[i].first - cells[i - 1].first);
+        int const dz (cells[i].second - cells[i - 1].second);
+        BOOST_CHECK_EQUAL (std::abs (dx) + std::abs (dz), 1);
+      }
+
+      float const enter
+        ( slabs ( r
+                , {float (cells[i].first), -1.f, float (cells[i].second)}
+                , {cells[i].first + 1.f, 1.f, cells[i].second + 1.f}
+                ).first
+        );
+      BOOST_CHECK_GE (enter, previous);
+      previous = enter;
+    }
+
+    BOOST_CHECK (cells.back().first == 7 || cells.back().second == 7);
+  }
+
+  BOOST_AUTO_TEST_CASE (axis_parallel_rays)
+  {
+    vector_3d const min (0.f, -1.f, 0.f);
+    vector_3d const max (4.f, 1.f, 4.f);
+
+    BOOST_CHECK ( visited (ray ({-1.f, 0.f, 2.5f}, {1.f, 0.f, 0.f}), min, max, 4, 4)
+               == (std::vector<cell> {{0, 2}, {1, 2}, {2, 2}, {3, 2}})
+                );
+    BOOST_CHECK ( visited (ray ({1.5f, 0.f, 5.f}, {0.f, 0.f, -1.f}), min, max, 4, 4)
+               == (std::vector<cell> {{1, 3}, {1, 2}, {1, 1}, {1, 0}})
+                );
+    // outside of the grid and parallel to it
+    BOOST_CHECK (visited (ray ({-1.f, 0.f, 5.f}, {1.f, 0.f, 0.f}), min, max, 4, 4).empty());
+  }
+
+  BOOST_AUTO_TEST_CASE (vertical_rays)
+  {
+    vector_3d const min (0.f, -1.f, 0.f);
+    vector_3d const max (4.f, 1.f, 4.f);
+
+    BOOST_CHECK ( visited (ray ({2.5f, 10.f, 0.5f}, {0.f, -1.f, 0.f}), min, max, 4, 4)
+               == (std::vector<cell> {{2, 0}})
+                );
+    BOOST_CHECK (visited (ray ({2.5f, 10.f, 0.5f}, {0.f, 1.f, 0.f}), min, max, 4, 4).empty());
+    BOOST_CHECK (visited (ray ({5.f, 10.f, 0.5f}, {0.f, -1.f, 0.f}), min, max, 4, 4).empty());
+  }
+
+  BOOST_AUTO_TEST_CASE (stops_when_visit_returns_true)
+  {
+    std::vector<cell> cells;
+    traverse_grid ( ray ({-1.f, 0.f, 0.5f}, {1.f, 0.f, 0.f})
+                  , {0.f, -1.f, 0.f}, {8.f, 1.f, 1.f}, 8, 1
+                  , [&] (int x, int z)
+                    {
+                      cells.emplace_back (x, z);
+                      return x == 2;
+                    }
+                  );
+
+    BOOST_CHECK (cells == (std::vector<cell> {{0, 0}, {1, 0}, {2, 0}}));
+  }
+
+  //! grazing rays over the chunks of a 3x3 tile area, as when picking
+  //! terrain close to the horizon, compared to testing every chunk
+  BOOST_AUTO_TEST_CASE (grazing_rays_match_testing_every_cell)
+  {
+    float const chunk_size (533.33333f / 16.f);
+    int const count (3 * 16);
+    vector_3d const min (0.f, -50.f, 0.f);
+    vector_3d const max (count * chunk_size, 50.f, count * chunk_size);
+    // cells barely touched may go either way with rounding
+    float const tolerance (1e-2f);
+
+    std::mt19937 engine (17);
+    std::uniform_real_distribution<float> position (0.f, count * chunk_size);
+    std::uniform_real_distribution<float> angle (0.f, 6.2831853f);
+    std::uniform_real_distribution<float> slope (-0.05f, 0.f);
+
+    for (int i (0); i < 1000; ++i)
+    {
+      float const a (angle (engine));
+      ray const r ( {position (engine), 49.f, position (engine)}
+                  , {std::cos (a), slope (engine), std::sin (a)}
+                  );
+
+      auto const cells (visited (r, min, max, count, count));
+
+      std::vector<std::pair<float, cell>> expected;
+      for (int z (0); z < count; ++z)
+      {
+        for (int x (0); x < count; ++x)
+        {
+          auto const t ( slabs ( r
+                               , {x * chunk_size, min.y, z * chunk_size}
+                               , {(x + 1) * chunk_size, max.y, (z + 1) * chunk_size}
+                               )
+                       );
+          if (t.second - t.first > tolerance)
+          {
+            expected.emplace_back (t.first, cell (x, z));
+          }
+        }
+      }
+      std::sort (expected.begin(), expected.end());
+
+      // every cell crossed is visited, in the order it is entered
+      auto it (cells.begin());
+      for (auto const& crossed : expected)
+      {
+        it = std::find (it, cells.end(), crossed.second);
+        BOOST_REQUIRE (it != cells.end());
+      }
+
+      BOOST_CHECK_LE (cells.size(), expected.size() + 2);
+    }
+  }
+}
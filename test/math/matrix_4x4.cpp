@@ -29,4 +29,25 @@ namespace math
     BOOST_CHECK_EQUAL (matrix_4x4 (matrix_4x4::rotation_xyz, {degrees (0.f), degrees (90.f), degrees (0.f)}) * vector_3d (1.f, 0.f, 0.f), vector_3d (0.f, 0.f, -1.f));
     BOOST_CHECK_EQUAL (matrix_4x4 (matrix_4x4::rotation_xyz, {degrees (0.f), degrees (0.f), degrees (90.f)}) * vector_3d (1.f, 0.f, 0.f), vector_3d (0.f, -1.f, 0.f));
   }
+
+  BOOST_AUTO_TEST_CASE (translation_rotation_scale)
+  {
+    vector_3d const trans (10.0f, 20.0f, -2.0f);
+    quaternion const rot (0.f, 0.7071068f, 0.f, 0.7071068f);
+    vector_3d const scale (2.0f, 3.0f, 0.5f);
+
+    matrix_4x4 const fused (matrix_4x4::translation_rotation_scale, trans, rot, scale);
+    matrix_4x4 const product ( matrix_4x4 (matrix_4x4::translation, trans)
+                             * matrix_4x4 (matrix_4x4::rotation, rot)
+                             * matrix_4x4 (matrix_4x4::scale, scale)
+                             );
+
+    for (std::size_t j (0); j < 4; ++j)
+    {
+      for (std::size_t i (0); i < 4; ++i)
+      {
+        BOOST_CHECK_CLOSE (fused (j, i) + 1.f, product (j, i) + 1.f, 0.0001f);
+      }
+    }
+  }
 }
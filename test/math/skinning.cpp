@@ -0,0 +1,143 @@
+#include <boost/test/included/unit_test.hpp>
+
+#include <math/skinning.hpp>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace math
+{
+  namespace
+  {
+    struct vertex
+    {
+      vector_3d position;
+      std::uint8_t weights[4];
+      std::uint8_t bones[4];
+      vector_3d normal;
+    };
+
+    struct fixture
+    {
+      fixture()
+      {
+        std::mt19937 engine (42);
+        std::uniform_real_distribution<float> coordinate (-10.f, 10.f);
+        std::uniform_real_distribution<float> component (-1.f, 1.f);
+        std::uniform_int_distribution<int> bone (0, bone_count - 1);
+        std::uniform_int_distribution<int> weight (0, 255);
+
+        for (std::size_t i (0); i < bone_count; ++i)
+        {
+          quaternion const rotation
+            (vector_4d (component (engine), component (engine), component (engine), component (engine)).normalize());
+          transforms.emplace_back ( matrix_4x4::translation_rotation_scale
+                                  , vector_3d (coordinate (engine), coordinate (engine), coordinate (engine))
+                                  , rotation
+                                  , vector_3d (1.f, 1.f, 1.f)
+                                  );
+          normal_transforms.emplace_back (matrix_4x4::rotation, rotation);
+        }
+
+        // not a multiple of four, to cover the remainder
+        for (std::size_t i (0); i < 1001; ++i)
+        {
+          vertex v;
+          v.position = {coordinate (engine), coordinate (engine), coordinate (engine)};
+          v.normal = vector_3d (component (engine), component (engine), component (engine)).normalize();
+          for (std::size_t b (0); b < 4; ++b)
+          {
+            v.bones[b] = bone (engine);
+            v.weights[b] = b == 0 ? 1 + weight (engine) % 255 : weight (engine) < 128 ? weight (engine) : 0;
+          }
+          original.push_back (v);
+          vertices.push_back (v.position, v.normal, v.bones, v.weights);
+        }
+      }
+
+      // what Model::animate used to do
+      std::vector<vertex> reference() const
+      {
+        std::vector<vertex> result (original);
+        for (auto& vertex : result)
+        {
+          vector_3d v (0, 0, 0), n (0, 0, 0);
+
+          for (size_t b (0); b < 4; ++b)
+          {
+            if (vertex.weights[b] <= 0)
+              continue;
+
+            vector_3d tv = transforms[vertex.bones[b]] * vertex.position;
+            vector_3d tn = normal_transforms[vertex.bones[b]] * vertex.normal;
+
+            v += tv * (static_cast<float> (vertex.weights[b]) / 255.0f);
+            n += tn * (static_cast<float> (vertex.weights[b]) / 255.0f);
+          }
+
+          vertex.position = v;
+          vertex.normal = n.normalized();
+        }
+        return result;
+      }
+
+      static int const bone_count = 32;
+      std::vector<matrix_4x4> transforms;
+      std::vector<matrix_4x4> normal_transforms;
+      std::vector<vertex> original;
+      skinned_vertices vertices;
+    };
+
+    void check_close (vector_3d const& lhs, vector_3d const& rhs)
+    {
+      BOOST_CHECK_SMALL ((lhs - rhs).length(), 0.001f);
+    }
+  }
+
+  BOOST_FIXTURE_TEST_CASE (scalar_matches_original, fixture)
+  {
+    std::vector<vertex> result (original);
+    skin_scalar ( vertices, 0, vertices.size(), transforms.data(), normal_transforms.data()
+                , &result[0].position, &result[0].normal, sizeof (vertex)
+                );
+
+    std::vector<vertex> const expected (reference());
+    for (std::size_t i (0); i < result.size(); ++i)
+    {
+      BOOST_REQUIRE_EQUAL (result[i].position, expected[i].position);
+      BOOST_REQUIRE_EQUAL (result[i].normal, expected[i].normal);
+    }
+  }
+
+  BOOST_FIXTURE_TEST_CASE (simd_matches_original, fixture)
+  {
+    std::vector<vertex> result (original);
+    skin ( vertices, 0, vertices.size(), transforms.data(), normal_transforms.data()
+         , &result[0].position, &result[0].normal, sizeof (vertex)
+         );
+
+    std::vector<vertex> const expected (reference());
+    for (std::size_t i (0); i < result.size(); ++i)
+    {
+      check_close (result[i].position, expected[i].position);
+      check_close (result[i].normal, expected[i].normal);
+    }
+  }
+
+  BOOST_FIXTURE_TEST_CASE (ranges_leave_other_vertices_alone, fixture)
+  {
+    std::vector<vertex> result (original);
+    skin ( vertices, 5, 11, transforms.data(), normal_transforms.data()
+         , &result[0].position, &result[0].normal, sizeof (vertex)
+         );
+
+    std::vector<vertex> const expected (reference());
+    for (std::size_t i (0); i < 20; ++i)
+    {
+      vertex const& compare_to (i >= 5 && i < 11 ? expected[i] : original[i]);
+      check_close (result[i].position, compare_to.position);
+      check_close (result[i].normal, compare_to.normal);
+    }
+  }
+}
@@ -0,0 +1,209 @@
+#include <boost/test/included/unit_test.hpp>
+
+#include <noggit/action_history.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+
+namespace noggit
+{
+  namespace
+  {
+    using state = action_history::state;
+
+    //! objects edited by the tests, keyed like the world's
+    struct objects
+    {
+      state state_of (std::uint64_t key)
+      {
+        return values[key];
+      }
+      void restore (std::uint64_t key, state const& value)
+      {
+        values[key] = value;
+      }
+
+      bool undo (action_history& history)
+      {
+        return history.undo ( [this] (std::uint64_t key) { return state_of (key); }
+                            , [this] (std::uint64_t key, state const& value) { restore (key, value); }
+                            );
+      }
+      bool redo (action_history& history)
+      {
+        return history.redo ( [this] (std::uint64_t key) { return state_of (key); }
+                            , [this] (std::uint64_t key, state const& value) { restore (key, value); }
+                            );
+      }
+      void end (action_history& history)
+      {
+        history.end ([this] (std::uint64_t key) { return state_of (key); });
+      }
+      void edit (action_history& history, std::uint64_t key, state const& value)
+      {
+        if (history.needs_capture (key))
+        {
+          history.capture (key, state_of (key));
+        }
+        values[key] = value;
+      }
+
+      std::map<std::uint64_t, state> values;
+    };
+
+    state random_state (std::size_t size, std::mt19937& engine)
+    {
+      std::uniform_int_distribution<int> byte (0, 255);
+      state value (size);
+      for (auto& b : value)
+      {
+        b = static_cast<std::uint8_t> (byte (engine));
+      }
+      return value;
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE (difference_applies_both_ways)
+  {
+    std::mt19937 engine (1);
+
+    for (std::size_t size_a : {0, 1, 7, 300, 4096})
+    {
+      for (std::size_t size_b : {0, 1, 7, 300, 4096})
+      {
+        state const a (random_state (size_a, engine));
+        state b (a);
+        b.resize (size_b);
+        for (std::size_t i (0); i < b.size(); i += 5)
+        {
+          b[i] ^= 0x5a;
+        }
+
+        auto const diff (action_history::difference (a, b));
+        BOOST_CHECK (action_history::apply (a, diff, b.size()) == b);
+        BOOST_CHECK (action_history::apply (b, diff, a.size()) == a);
+      }
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE (difference_of_sparse_changes_is_small)
+  {
+    std::mt19937 engine (2);
+    state const a (random_state (1 << 16, engine));
+    state b (a);
+    b[100] ^= 1;
+    b[40000] ^= 2;
+
+    BOOST_CHECK_LT (action_history::difference (a, b).size(), 16u);
+  }
+
+  BOOST_AUTO_TEST_CASE (undo_and_redo_restore_states)
+  {
+    action_history history (1 << 20);
+    objects world;
+    world.values[1] = {1, 2, 3};
+    world.values[2] = {4, 5, 6};
+
+    history.begin();
+    world.edit (history, 1, {1, 9, 3});
+    world.edit (history, 1, {1, 9, 9, 9});
+    world.edit (history, 2, {4, 5, 6});
+    world.end (history);
+
+    history.begin();
+    world.edit (history, 2, {});
+    world.end (history);
+
+    BOOST_REQUIRE (world.undo (history));
+    BOOST_CHECK (world.values[2] == (state {4, 5, 6}));
+    BOOST_REQUIRE (world.undo (history));
+    BOOST_CHECK (world.values[1] == (state {1, 2, 3}));
+    BOOST_CHECK (!history.can_undo());
+
+    BOOST_REQUIRE (world.redo (history));
+    BOOST_CHECK (world.values[1] == (state {1, 9, 9, 9}));
+    BOOST_REQUIRE (world.redo (history));
+    BOOST_CHECK (world.values[2].empty());
+    BOOST_CHECK (!history.can_redo());
+  }
+
+  BOOST_AUTO_TEST_CASE (new_action_drops_redo)
+  {
+    action_history history (1 << 20);
+    objects world;
+    world.values[1] = {1};
+
+    history.begin();
+    world.edit (history, 1, {2});
+    world.end (history);
+    BOOST_REQUIRE (world.undo (history));
+
+    history.begin();
+    world.edit (history, 1, {3});
+    world.end (history);
+
+    BOOST_CHECK (!history.can_redo());
+    BOOST_REQUIRE (world.undo (history));
+    BOOST_CHECK (world.values[1] == (state {1}));
+  }
+
+  BOOST_AUTO_TEST_CASE (unchanged_actions_are_not_kept)
+  {
+    action_history history (1 << 20);
+    objects world;
+    world.values[1] = {1};
+
+    history.begin();
+    world.edit (history, 1, {2});
+    world.edit (history, 1, {1});
+    world.end (history);
+
+    BOOST_CHECK (!history.can_undo());
+    BOOST_CHECK_EQUAL (history.memory_usage(), 0u);
+  }
+
+  BOOST_AUTO_TEST_CASE (unrecorded_change_drops_history)
+  {
+    action_history history (1 << 20);
+    objects world;
+    world.values[1] = {1};
+
+    history.begin();
+    world.edit (history, 1, {2});
+    world.end (history);
+
+    world.values[1] = {5};
+
+    BOOST_CHECK (!world.undo (history));
+    BOOST_CHECK (world.values[1] == (state {5}));
+    BOOST_CHECK (!history.can_undo());
+  }
+
+  BOOST_AUTO_TEST_CASE (oldest_actions_are_dropped_past_the_budget)
+  {
+    std::mt19937 engine (3);
+    action_history history (64 * 1024);
+    objects world;
+
+    for (std::uint64_t key (0); key < 32; ++key)
+    {
+      history.begin();
+      world.edit (history, key, random_state (16 * 1024, engine));
+      world.end (history);
+    }
+
+    BOOST_CHECK_LE (history.memory_usage(), 64u * 1024u);
+
+    std::size_t undone (0);
+    while (world.undo (history))
+    {
+      ++undone;
+    }
+    BOOST_CHECK_GT (undone, 0u);
+    BOOST_CHECK_LT (undone, 32u);
+    BOOST_CHECK (world.values[31].empty());
+  }
+}
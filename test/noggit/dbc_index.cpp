@@ -0,0 +1,113 @@
+#include <boost/test/included/unit_test.hpp>
+
+#include <noggit/dbc_index.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace noggit
+{
+  namespace
+  {
+    std::size_t const field_count = 4;
+    std::size_t const record_size = field_count * 4;
+
+    //! records with the given ids in their first field and their row in
+    //! the second one
+    std::vector<unsigned char> records_with_ids (std::vector<std::uint32_t> const& ids)
+    {
+      std::vector<unsigned char> records (ids.size() * record_size, 0);
+      for (std::uint32_t row (0); row < ids.size(); ++row)
+      {
+        std::memcpy (&records[row * record_size], &ids[row], 4);
+        std::memcpy (&records[row * record_size + 4], &row, 4);
+      }
+      return records;
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE (empty_table)
+  {
+    dbc_index const index (nullptr, record_size, 0, 0);
+
+    BOOST_CHECK (!index.row (0));
+    BOOST_CHECK (!index.row (1));
+  }
+
+  // about the size of the largest tables, e.g. Spell.dbc
+  BOOST_AUTO_TEST_CASE (compact_ids)
+  {
+    std::vector<std::uint32_t> ids;
+    for (std::uint32_t id (1); id <= 60000; ++id)
+    {
+      // every sixth id is unused
+      if (id % 6)
+      {
+        ids.push_back (id);
+      }
+    }
+
+    auto const records (records_with_ids (ids));
+    dbc_index const index (records.data(), record_size, ids.size(), 0);
+
+    for (std::size_t row (0); row < ids.size(); ++row)
+    {
+      BOOST_REQUIRE (index.row (ids[row]));
+      BOOST_REQUIRE_EQUAL (*index.row (ids[row]), row);
+    }
+
+    BOOST_CHECK (!index.row (0));
+    BOOST_CHECK (!index.row (6));
+    BOOST_CHECK (!index.row (60001));
+    BOOST_CHECK (!index.row (0xffffffff));
+  }
+
+  BOOST_AUTO_TEST_CASE (scattered_ids)
+  {
+    std::vector<std::uint32_t> ids;
+    for (std::uint32_t i (0); i < 50000; ++i)
+    {
+      ids.push_back (i * 85931 + 7);
+    }
+    ids.push_back (0xffffffff);
+
+    auto const records (records_with_ids (ids));
+    dbc_index const index (records.data(), record_size, ids.size(), 0);
+
+    for (std::size_t row (0); row < ids.size(); ++row)
+    {
+      BOOST_REQUIRE (index.row (ids[row]));
+      BOOST_REQUIRE_EQUAL (*index.row (ids[row]), row);
+    }
+
+    BOOST_CHECK (!index.row (0));
+    BOOST_CHECK (!index.row (8));
+  }
+
+  BOOST_AUTO_TEST_CASE (first_row_wins_on_duplicate_ids)
+  {
+    std::vector<std::uint32_t> const ids {5, 3, 5, 9, 3};
+
+    auto const records (records_with_ids (ids));
+    dbc_index const index (records.data(), record_size, ids.size(), 0);
+
+    BOOST_CHECK_EQUAL (*index.row (5), 0u);
+    BOOST_CHECK_EQUAL (*index.row (3), 1u);
+    BOOST_CHECK_EQUAL (*index.row (9), 3u);
+    BOOST_CHECK (!index.row (4));
+  }
+
+  BOOST_AUTO_TEST_CASE (other_field)
+  {
+    std::vector<std::uint32_t> const ids {100, 200, 300};
+
+    auto const records (records_with_ids (ids));
+    dbc_index const index (records.data(), record_size, ids.size(), 1);
+
+    // the second field holds the row
+    BOOST_CHECK_EQUAL (*index.row (0), 0u);
+    BOOST_CHECK_EQUAL (*index.row (2), 2u);
+    BOOST_CHECK (!index.row (100));
+  }
+}
@@ -0,0 +1,78 @@
+#include <boost/test/included/unit_test.hpp>
+
+#include <noggit/directory_files.hpp>
+
+#include <boost/filesystem/fstream.hpp>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace noggit
+{
+  namespace
+  {
+    //! a directory with a few files, removed again at the end of the test
+    struct project_directory
+    {
+      project_directory()
+        : root ( boost::filesystem::temp_directory_path()
+               / boost::filesystem::unique_path ("noggit-test-%%%%-%%%%")
+               )
+      {
+        boost::filesystem::create_directories (root / "World" / "Maps");
+        boost::filesystem::ofstream (root / "a.blp") << "a";
+        boost::filesystem::ofstream (root / "World" / "Maps" / "b.adt") << "b";
+      }
+      ~project_directory()
+      {
+        boost::system::error_code ec;
+        boost::filesystem::remove_all (root, ec);
+      }
+
+      std::vector<std::string> relative_files (boost::filesystem::path const& spelling) const
+      {
+        std::vector<std::string> names;
+        for (auto const& file : directory_files (spelling))
+        {
+          BOOST_CHECK (boost::filesystem::is_regular_file (file.second));
+          names.emplace_back (boost::filesystem::path (file.first).generic_string());
+        }
+        std::sort (names.begin(), names.end());
+        return names;
+      }
+
+      boost::filesystem::path const root;
+    };
+
+    std::vector<std::string> const expected {"World/Maps/b.adt", "a.blp"};
+  }
+
+  BOOST_AUTO_TEST_CASE (files_are_relative_to_the_root)
+  {
+    project_directory const project;
+    BOOST_CHECK (project.relative_files (project.root) == expected);
+  }
+
+  BOOST_AUTO_TEST_CASE (trailing_separator_is_ignored)
+  {
+    project_directory const project;
+    BOOST_CHECK (project.relative_files (project.root.string() + "/") == expected);
+    BOOST_CHECK (project.relative_files (project.root.string() + "//") == expected);
+  }
+
+  BOOST_AUTO_TEST_CASE (dot_components_are_ignored)
+  {
+    project_directory const project;
+    BOOST_CHECK (project.relative_files (project.root / ".") == expected);
+    BOOST_CHECK (project.relative_files (project.root / "World" / "..") == expected);
+  }
+
+  BOOST_AUTO_TEST_CASE (missing_directory_has_no_files)
+  {
+    project_directory const project;
+    BOOST_CHECK (directory_files (project.root / "missing").empty());
+    BOOST_CHECK (directory_files (project.root / "a.blp").empty());
+  }
+}
@@ -0,0 +1,300 @@
+#include <boost/test/included/unit_test.hpp>
+
+#include <noggit/terrain_brush.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+namespace noggit
+{
+  namespace
+  {
+    std::size_t const vertex_count = 9 * 9 + 8 * 8;
+    float const unit_size = 533.33333f / 16.f / 8.f;
+    float const tolerance = 1e-4f;
+
+    //! vertices of a chunk at the given base, laid out like MapChunk's
+    struct chunk
+    {
+      chunk (float xbase, float zbase, std::mt19937& engine)
+      {
+        std::uniform_real_distribution<float> height (-50.f, 50.f);
+
+        for (std::size_t i (0); i < vertex_count; ++i)
+        {
+          bool const inner ((i % 17) >= 9);
+          std::size_t const row ((i / 17) * 2 + (inner ? 1 : 0));
+          std::size_t const column ((i % 17) - (inner ? 9 : 0));
+
+          x.push_back (xbase + column * unit_size + (inner ? unit_size / 2.f : 0.f));
+          z.push_back (zbase + row * unit_size / 2.f);
+          y.push_back (height (engine));
+        }
+      }
+
+      std::vector<float> x;
+      std::vector<float> y;
+      std::vector<float> z;
+    };
+
+    float dist (chunk const& c, std::size_t i, float center_x, float center_z)
+    {
+      float const dx (c.x[i] - center_x);
+      float const dz (c.z[i] - center_z);
+      return std::sqrt (dx * dx + dz * dz);
+    }
+
+    //! what MapChunk::changeTerrain did per vertex before the kernels
+    bool reference_change (chunk& c, int brush, float center_x, float center_z, float change, float radius, float inner_radius)
+    {
+      bool changed (false);
+
+      for (std::size_t i (0); i < vertex_count; ++i)
+      {
+        float const xdiff (c.x[i] - center_x);
+        float const zdiff (c.z[i] - center_z);
+        float const d (dist (c, i, center_x, center_z));
+
+        if (brush == eTerrainType_Quadra)
+        {
+          if (std::abs (xdiff) < std::abs (radius / 2) && std::abs (zdiff) < std::abs (radius / 2))
+          {
+            c.y[i] += change * (1.0f - d * inner_radius / radius);
+            changed = true;
+          }
+          continue;
+        }
+
+        if (d >= radius)
+        {
+          continue;
+        }
+
+        changed = true;
+
+        switch (brush)
+        {
+        case eTerrainType_Flat:
+          c.y[i] += change;
+          break;
+        case eTerrainType_Linear:
+          c.y[i] += change * (1.0f - d * (1.0f - inner_radius) / radius);
+          break;
+        case eTerrainType_Smooth:
+          c.y[i] += change / (1.0f + d / radius);
+          break;
+        case eTerrainType_Polynom:
+          c.y[i] += change * ((d / radius) * (d / radius) + d / radius + 1.0f);
+          break;
+        case eTerrainType_Trigo:
+          c.y[i] += change * std::cos (d / radius);
+          break;
+        case eTerrainType_Gaussian:
+          c.y[i] += d < radius * inner_radius
+                  ? change * std::exp (-(std::pow (inner_radius, 2) / (2 * std::pow (0.39f, 2))))
+                  : change * std::exp (-(std::pow (d / radius, 2) / (2 * std::pow (0.39f, 2))));
+          break;
+        }
+      }
+
+      return changed;
+    }
+
+    void check_close (std::vector<float> const& expected, std::vector<float> const& actual)
+    {
+      for (std::size_t i (0); i < expected.size(); ++i)
+      {
+        BOOST_REQUIRE_SMALL (actual[i] - expected[i], tolerance * std::max (1.f, std::abs (expected[i])));
+      }
+    }
+
+    //! brush centers on and around a chunk at (0, 0), radii from less than
+    //! a unit to several chunks
+    template<typename Fun>
+      void for_all_strokes (Fun&& fun)
+    {
+      std::mt19937 engine (24);
+      std::uniform_real_distribution<float> position (-20.f, 55.f);
+
+      for (float radius : {1.f, 3.f, 15.f, 33.f, 120.f})
+      {
+        for (int stroke (0); stroke < 50; ++stroke)
+        {
+          fun (chunk (0.f, 0.f, engine), position (engine), position (engine), radius, engine);
+        }
+      }
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE (change_heights_matches_per_vertex_brushes)
+  {
+    for ( int brush : { eTerrainType_Flat, eTerrainType_Linear, eTerrainType_Smooth
+                      , eTerrainType_Polynom, eTerrainType_Trigo, eTerrainType_Quadra
+                      , eTerrainType_Gaussian
+                      }
+        )
+    {
+      for_all_strokes
+        ( [&] (chunk expected, float center_x, float center_z, float radius, std::mt19937& engine)
+          {
+            float const change (std::uniform_real_distribution<float> (-10.f, 10.f) (engine));
+            float const inner_radius (std::uniform_real_distribution<float> (0.f, 1.f) (engine));
+
+            chunk actual (expected);
+            bool const expected_changed
+              (reference_change (expected, brush, center_x, center_z, change, radius, inner_radius));
+            bool const actual_changed
+              ( terrain_brush::change_heights
+                  ( brush
+                  , actual.x.data(), actual.z.data(), actual.y.data(), vertex_count
+                  , center_x, center_z, change, radius, inner_radius
+                  )
+              );
+
+            BOOST_REQUIRE_EQUAL (expected_changed, actual_changed);
+            check_close (expected.y, actual.y);
+          }
+        );
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE (change_heights_ignores_unknown_brushes)
+  {
+    std::mt19937 engine (1);
+    chunk c (0.f, 0.f, engine);
+    std::vector<float> const heights (c.y);
+
+    BOOST_CHECK ( !terrain_brush::change_heights
+                    ( eTerrainType_Vertex
+                    , c.x.data(), c.z.data(), c.y.data(), vertex_count
+                    , 10.f, 10.f, 5.f, 20.f, 0.5f
+                    )
+                );
+    BOOST_CHECK (c.y == heights);
+  }
+
+  BOOST_AUTO_TEST_CASE (flatten_heights_matches_per_vertex_brushes)
+  {
+    for (int brush : {eFlattenType_Flat, eFlattenType_Linear, eFlattenType_Smooth, eFlattenType_Origin})
+    {
+      for (int mode (1); mode < 4; ++mode)
+      {
+        bool const raise (mode & 1);
+        bool const lower (mode & 2);
+
+        for_all_strokes
+          ( [&] (chunk expected, float center_x, float center_z, float radius, std::mt19937& engine)
+            {
+              std::uniform_real_distribution<float> unit (0.f, 1.f);
+              float const remain (unit (engine));
+              float const origin_x (center_x + 5.f);
+              float const origin_y (unit (engine) * 40.f - 20.f);
+              float const origin_z (center_z - 3.f);
+              float const orientation (unit (engine) * 6.28f);
+              float const slope (std::tan (unit (engine) - 0.5f));
+
+              chunk actual (expected);
+
+              bool expected_changed (false);
+              for (std::size_t i (0); i < vertex_count; ++i)
+              {
+                float const d (dist (expected, i, center_x, center_z));
+                float& y (expected.y[i]);
+                float const ah
+                  ( origin_y
+                  + ( (expected.x[i] - origin_x) * std::cos (orientation)
+                    + (expected.z[i] - origin_z) * std::sin (orientation)
+                    ) * slope
+                  );
+
+                if (d >= radius || (!lower && ah < y) || (!raise && ah > y))
+                {
+                  continue;
+                }
+
+                float const ratio
+                  ( brush == eFlattenType_Flat ? remain
+                  : brush == eFlattenType_Linear ? remain * (1.f - d / radius)
+                  : std::pow (remain, 1.f + d / radius)
+                  );
+                y = brush == eFlattenType_Origin ? origin_y : y * (1.f - ratio) + ah * ratio;
+                expected_changed = true;
+              }
+
+              bool const actual_changed
+                ( terrain_brush::flatten_heights
+                    ( brush
+                    , actual.x.data(), actual.z.data(), actual.y.data(), vertex_count
+                    , center_x, center_z, remain, radius, raise, lower
+                    , origin_x, origin_y, origin_z
+                    , std::cos (orientation), std::sin (orientation), slope
+                    )
+                );
+
+              BOOST_REQUIRE_EQUAL (expected_changed, actual_changed);
+              check_close (expected.y, actual.y);
+            }
+          );
+      }
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE (blend_colors_matches_per_vertex_brush)
+  {
+    for_all_strokes
+      ( [&] (chunk c, float center_x, float center_z, float radius, std::mt19937& engine)
+        {
+          std::uniform_real_distribution<float> color (0.f, 2.f);
+          float const change (std::uniform_real_distribution<float> (0.f, 1.f) (engine));
+          float const target[3] = {color (engine), color (engine), color (engine)};
+
+          std::vector<float> expected[3];
+          for (auto& channel : expected)
+          {
+            for (std::size_t i (0); i < vertex_count; ++i)
+            {
+              channel.push_back (color (engine));
+            }
+          }
+          std::vector<float> actual[3] = {expected[0], expected[1], expected[2]};
+
+          bool expected_changed (false);
+          for (std::size_t i (0); i < vertex_count; ++i)
+          {
+            float const d (dist (c, i, center_x, center_z));
+            if (d > radius)
+            {
+              continue;
+            }
+
+            float const edit (change * (1.0f - d / radius));
+            for (int channel (0); channel < 3; ++channel)
+            {
+              float& value (expected[channel][i]);
+              value += (target[channel] - value) * edit;
+              value = std::min (std::max (value, 0.0f), 2.0f);
+            }
+            expected_changed = true;
+          }
+
+          bool const actual_changed
+            ( terrain_brush::blend_colors
+                ( c.x.data(), c.z.data()
+                , actual[0].data(), actual[1].data(), actual[2].data(), vertex_count
+                , center_x, center_z, change, radius
+                , target[0], target[1], target[2]
+                )
+            );
+
+          BOOST_REQUIRE_EQUAL (expected_changed, actual_changed);
+          for (int channel (0); channel < 3; ++channel)
+          {
+            check_close (expected[channel], actual[channel]);
+          }
+        }
+      );
+  }
+}